@@ -19,15 +19,25 @@
 #include "maidsafe/vault/chunk_store.h"
 
 #include <algorithm>
-#include <future>
-
-#include "boost/filesystem/convenience.hpp"
-#include "boost/lexical_cast.hpp"
-
-#include "maidsafe/common/crypto.h"
+#include <exception>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "boost/exception/diagnostic_information.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/convert.h"
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/utils.h"
 
+#include "maidsafe/vault/chunk_store/chunk_crypto.h"
+#include "maidsafe/vault/chunk_store/file_per_chunk_backend.h"
+#include "maidsafe/vault/chunk_store/pack_file_backend.h"
+
 namespace fs = boost::filesystem;
 
 namespace maidsafe {
@@ -36,241 +46,913 @@ namespace vault {
 
 namespace {
 
-struct UsedSpace {
-  UsedSpace() : directories(), disk_usage(0) {}
-  UsedSpace(UsedSpace&& other)
-      : directories(std::move(other.directories)), disk_usage(std::move(other.disk_usage)) {}
+// Holds the store's own bookkeeping.  The leading '.' can't clash with the hex chunk directories.
+const char kMetadataDirName[] = ".metadata";
+// Records the layout.  Stores which predate it are file per chunk stores with hashed file names.
+// A file per chunk layout is followed by its fan-out depth and, during a migration, the depth
+// being migrated from; stores which predate that record neither, and have the default depth.
+const char kLayoutFileName[] = "layout";
+const char kFilePerChunkLayout[] = "files";
+const char kPackFileLayout[] = "pack";
+const char kNameFilterFileName[] = "names";
+// Under each root of a striped store, holds that device's usage journal.
+const char kDeviceDirName[] = "device";
+// Under each tier's metadata directory, holds the tier's usage journal.
+const char kTierDirName[] = "tier";
+// Under the metadata directory, holds the content of chunks found to be corrupt.
+const char kQuarantineDirName[] = "quarantine";
+// Used to size the name filter and the fan-out, as a guess at the smallest likely average chunk
+// size.
+const std::uint64_t kTypicalChunkSize(256 * 1024);
+
+void InitialiseDiskRoot(const fs::path& disk_root) {
+  boost::system::error_code error_code;
+  if (!fs::exists(disk_root, error_code)) {
+    if (!fs::create_directories(disk_root, error_code)) {
+      LOG(kError) << "Can't create disk root at " << disk_root << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::uninitialised));
+    }
+  } else if (!fs::is_directory(disk_root, error_code)) {
+    LOG(kError) << "Disk root " << disk_root << " is not a directory.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::not_a_directory));
+  }
+}
 
-  std::vector<fs::path> directories;
-  DiskUsage disk_usage;
-};
+std::string FilePerChunkLayout(std::uint32_t depth, std::uint32_t migrating_from) {
+  std::string layout(std::string(kFilePerChunkLayout) + ' ' + std::to_string(depth));
+  if (migrating_from != 0)
+    layout += ' ' + std::to_string(migrating_from);
+  return layout;
+}
 
-UsedSpace GetUsedSpace(fs::path directory) {
-  UsedSpace used_space;
-  try {
-    for (fs::directory_iterator it(directory); it != fs::directory_iterator(); ++it) {
-      if (fs::is_directory(*it))
-        used_space.directories.push_back(it->path());
-      else
-        used_space.disk_usage.data += fs::file_size(*it);
-    }
-  } catch (const std::exception& e) {
-    LOG(kError) << "GetUsedSpace when handling " << directory
-                << " caught an error : " << boost::diagnostic_information(e);
-    throw;
+// Replaces the file via a rename, so that it's never left half written.
+void WriteLayout(const fs::path& layout_path, const std::string& layout) {
+  fs::path temp_path(layout_path.string() + ".tmp");
+  boost::system::error_code error_code;
+  if (WriteFile(temp_path, convert::ToByteVector(layout)))
+    fs::rename(temp_path, layout_path, error_code);
+  else
+    error_code = boost::system::errc::make_error_code(boost::system::errc::io_error);
+  if (error_code) {
+    LOG(kError) << "Failed to write " << layout_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
   }
-  return used_space;
 }
 
-DiskUsage InitialiseDiskRoot(const fs::path& disk_root) {
+// 'capacity' sizes the fan-out of a new file per chunk store.
+std::unique_ptr<ChunkStoreBackend> MakeBackend(const fs::path& disk_root, std::uint64_t capacity,
+                                               ChunkStore::Layout layout) {
+  fs::path layout_path(disk_root / kMetadataDirName / kLayoutFileName);
   boost::system::error_code error_code;
-  DiskUsage disk_usage(0);
-  if (!fs::exists(disk_root, error_code)) {
-    if (!fs::create_directories(disk_root, error_code)) {
-      LOG(kError) << "Can't create disk root at " << disk_root << ": " << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::uninitialised));
+  std::string recorded_layout;
+  if (fs::exists(layout_path, error_code)) {
+    auto contents(ReadFile(layout_path));
+    if (!contents) {
+      LOG(kError) << "Failed to read " << layout_path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
     }
+    recorded_layout = convert::ToString(*contents);
   } else {
-    std::vector<fs::path> dirs_to_do;
-    dirs_to_do.push_back(disk_root);
-    while (!dirs_to_do.empty()) {
-      std::vector<std::future<UsedSpace>> futures;
-      for (std::uint32_t i = 0; i < 16 && !dirs_to_do.empty(); ++i) {
-        auto temp_copy(dirs_to_do.back());
-        auto future = std::async(&GetUsedSpace, temp_copy);
-        dirs_to_do.pop_back();
-        futures.push_back(std::move(future));
-      }
-      try {
-        while (!futures.empty()) {
-          auto future = std::move(futures.back());
-          futures.pop_back();
-          UsedSpace result = future.get();
-          disk_usage.data += result.disk_usage.data;
-          std::move(result.directories.begin(), result.directories.end(),
-                    std::back_inserter(dirs_to_do));
-        }
-      } catch (const std::system_error& exception) {
-        LOG(kError) << boost::diagnostic_information(exception);
-        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
-      } catch (...) {
-        LOG(kError) << "exception during InitialiseDiskRoot";
+    for (fs::directory_iterator itr(disk_root); itr != fs::directory_iterator(); ++itr) {
+      if (itr->path().filename() != kMetadataDirName) {
+        // A store with hashed file names.
+        if (layout == ChunkStore::Layout::kFilePerChunk)
+          return std::unique_ptr<ChunkStoreBackend>(new FilePerChunkBackend(disk_root, true));
+        LOG(kError) << disk_root << " holds a file per chunk store.";
         BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
       }
     }
+    recorded_layout =
+        layout == ChunkStore::Layout::kPackFile
+            ? kPackFileLayout
+            : FilePerChunkLayout(FilePerChunkBackend::DepthFor(capacity / kTypicalChunkSize), 0);
+    fs::create_directories(layout_path.parent_path());
+    WriteLayout(layout_path, recorded_layout);
   }
-  return disk_usage;
+
+  std::istringstream fields(recorded_layout);
+  std::string recorded_kind;
+  fields >> recorded_kind;
+  if (layout == ChunkStore::Layout::kFilePerChunk && recorded_kind == kFilePerChunkLayout) {
+    std::uint32_t depth(0), migrating_from(0);
+    if (!(fields >> depth))
+      depth = FilePerChunkBackend::kDefaultDepth;
+    else if (!(fields >> migrating_from))
+      migrating_from = 0;
+    return std::unique_ptr<ChunkStoreBackend>(new FilePerChunkBackend(
+        disk_root, false, depth, migrating_from,
+        [layout_path](std::uint32_t new_depth, std::uint32_t new_migrating_from) {
+          WriteLayout(layout_path, FilePerChunkLayout(new_depth, new_migrating_from));
+        }));
+  }
+  if (layout == ChunkStore::Layout::kPackFile && recorded_layout == kPackFileLayout)
+    return std::unique_ptr<ChunkStoreBackend>(new PackFileBackend(disk_root));
+  LOG(kError) << disk_root << " holds a store with layout '" << recorded_layout << "'.";
+  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+}
+
+// Counts an operation in progress, for scrubbing to yield to.
+class ForegroundOperation {
+ public:
+  explicit ForegroundOperation(std::atomic<std::uint32_t>& count) : count_(count) { ++count_; }
+  ~ForegroundOperation() { --count_; }
+  ForegroundOperation(const ForegroundOperation&) = delete;
+  ForegroundOperation& operator=(const ForegroundOperation&) = delete;
+
+ private:
+  std::atomic<std::uint32_t>& count_;
+};
+
+// Waits for every task before collecting the results, since the tasks may refer to the caller's
+// locals.  Throws the first error.
+template <typename T>
+std::vector<T> GetAll(std::vector<std::future<T>>& futures) {
+  for (auto& future : futures)
+    future.wait();
+  std::vector<T> results;
+  results.reserve(futures.size());
+  for (auto& future : futures)
+    results.push_back(future.get());
+  return results;
 }
 
 }  // unnamed namespace
 
-ChunkStore::ChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage)
+ChunkStore::ChunkStore(const fs::path& disk_path, DiskUsage max_disk_usage,
+                       MemoryUsage cache_size, Layout layout)
     : kDiskPath_(disk_path),
-      max_disk_usage_(std::move(max_disk_usage)),
-      current_disk_usage_(InitialiseDiskRoot(kDiskPath_)),
-      kDepth_(5),
-      mutex_() {
+      max_disk_usage_(max_disk_usage.data),
+      current_disk_usage_(0),
+      stripe_mutexes_(),
+      usage_journal_(kDiskPath_ / kMetadataDirName),
+      backend_(),
+      striped_backend_(nullptr),
+      tiered_backend_(nullptr),
+      cache_(cache_size.data),
+      name_filter_(),
+      name_filter_ready_(false),
+      stop_name_filter_(false),
+      name_filter_thread_(),
+      io_service_flag_(),
+      io_service_(),
+      crypto_service_flag_(),
+      crypto_service_(),
+      foreground_operations_(0) {
+  InitialiseDiskRoot(kDiskPath_);
+  backend_ = MakeBackend(kDiskPath_, max_disk_usage.data, layout);
+  Initialise();
+}
+
+ChunkStore::ChunkStore(const std::vector<DiskRoot>& disk_roots, MemoryUsage cache_size,
+                       Layout layout)
+    : kDiskPath_(disk_roots.empty() ? fs::path() : disk_roots.front().path),
+      max_disk_usage_(std::accumulate(disk_roots.begin(), disk_roots.end(), std::uint64_t(0),
+                                      [](std::uint64_t total, const DiskRoot& disk_root) {
+                                        return total + disk_root.capacity.data;
+                                      })),
+      current_disk_usage_(0),
+      stripe_mutexes_(),
+      usage_journal_(kDiskPath_ / kMetadataDirName),
+      backend_(),
+      striped_backend_(nullptr),
+      tiered_backend_(nullptr),
+      cache_(cache_size.data),
+      name_filter_(),
+      name_filter_ready_(false),
+      stop_name_filter_(false),
+      name_filter_thread_(),
+      io_service_flag_(),
+      io_service_(),
+      crypto_service_flag_(),
+      crypto_service_(),
+      foreground_operations_(0) {
+  std::set<fs::path> paths;
+  for (const auto& disk_root : disk_roots) {
+    if (!paths.insert(disk_root.path).second) {
+      LOG(kError) << "Disk root " << disk_root.path << " is given more than once.";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+    }
+  }
+  if (paths.empty()) {
+    LOG(kError) << "No disk roots given.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+
+  std::vector<StripedBackend::Device> devices;
+  for (const auto& disk_root : disk_roots) {
+    InitialiseDiskRoot(disk_root.path);
+    devices.push_back(StripedBackend::Device{
+        disk_root.path, disk_root.path / kMetadataDirName / kDeviceDirName,
+        disk_root.capacity.data, MakeBackend(disk_root.path, disk_root.capacity.data, layout)});
+  }
+  striped_backend_ = new StripedBackend(std::move(devices));
+  backend_.reset(striped_backend_);
+  Initialise();
+}
+
+ChunkStore::ChunkStore(const DiskRoot& fast_tier, const DiskRoot& slow_tier,
+                       MemoryUsage cache_size, Layout layout)
+    : kDiskPath_(fast_tier.path),
+      max_disk_usage_(fast_tier.capacity.data + slow_tier.capacity.data),
+      current_disk_usage_(0),
+      stripe_mutexes_(),
+      usage_journal_(kDiskPath_ / kMetadataDirName),
+      backend_(),
+      striped_backend_(nullptr),
+      tiered_backend_(nullptr),
+      cache_(cache_size.data),
+      name_filter_(),
+      name_filter_ready_(false),
+      stop_name_filter_(false),
+      name_filter_thread_(),
+      io_service_flag_(),
+      io_service_(),
+      crypto_service_flag_(),
+      crypto_service_(),
+      foreground_operations_(0) {
+  if (fast_tier.path == slow_tier.path) {
+    LOG(kError) << "Both tiers are given the root " << fast_tier.path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  std::vector<TieredBackend::Tier> tiers;
+  for (const auto& disk_root : {fast_tier, slow_tier}) {
+    InitialiseDiskRoot(disk_root.path);
+    tiers.push_back(TieredBackend::Tier{
+        disk_root.path, disk_root.path / kMetadataDirName / kTierDirName, disk_root.capacity.data,
+        MakeBackend(disk_root.path, disk_root.capacity.data, layout)});
+  }
+  tiered_backend_ = new TieredBackend(std::move(tiers[0]), std::move(tiers[1]));
+  backend_.reset(tiered_backend_);
+  Initialise();
+}
+
+ChunkStore::ChunkStore(std::unique_ptr<ChunkStoreBackend> backend, DiskUsage max_disk_usage,
+                       MemoryUsage cache_size, const fs::path& disk_path)
+    : kDiskPath_(disk_path),
+      max_disk_usage_(max_disk_usage.data),
+      current_disk_usage_(0),
+      stripe_mutexes_(),
+      usage_journal_(kDiskPath_ / kMetadataDirName),
+      backend_(std::move(backend)),
+      striped_backend_(nullptr),
+      tiered_backend_(nullptr),
+      cache_(cache_size.data),
+      name_filter_(),
+      name_filter_ready_(false),
+      stop_name_filter_(false),
+      name_filter_thread_(),
+      io_service_flag_(),
+      io_service_(),
+      crypto_service_flag_(),
+      crypto_service_(),
+      foreground_operations_(0) {
+  if (!backend_) {
+    LOG(kError) << "No backend given.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  if (backend_->Persistent() == kDiskPath_.empty()) {
+    LOG(kError) << "A disk path must be given for a persistent backend, and only for one.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  if (backend_->Persistent())
+    InitialiseDiskRoot(kDiskPath_);
+  Initialise();
+}
+
+void ChunkStore::Initialise() {
+  // A store over a backend which isn't persistent starts empty each time.
+  auto recovery(backend_->Persistent() ? usage_journal_.Recover()
+                                       : boost::optional<UsageJournal::Recovery>());
+  current_disk_usage_ = recovery ? RecoverInFlight(recovery->usage, recovery->in_flight)
+                                 : backend_->ScanUsage();
   if (current_disk_usage_ > max_disk_usage_) {
-    LOG(kError) << "current disk usage " << current_disk_usage_
-                << " is greater than max disk usage " << max_disk_usage_;
+    LOG(kError) << "current disk usage " << current_disk_usage_.load()
+                << " is greater than max disk usage " << max_disk_usage_.load();
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
   }
+  if (backend_->ListsNames())
+    InitialiseNameFilter(recovery && recovery->clean, static_cast<bool>(recovery));
+  if (backend_->Persistent())
+    usage_journal_.Open(current_disk_usage_);
 }
 
-ChunkStore::~ChunkStore() {}
+ChunkStore::~ChunkStore() {
+  if (io_service_)
+    io_service_->Stop();
+  if (crypto_service_)
+    crypto_service_->Stop();
+  stop_name_filter_ = true;
+  if (name_filter_thread_.joinable())
+    name_filter_thread_.join();
+  // If this fails, or the filter wasn't ready, the next session rebuilds the filter.
+  if (name_filter_ready_ && backend_->Persistent())
+    name_filter_->Save(kDiskPath_ / kMetadataDirName / kNameFilterFileName);
+  usage_journal_.Close();
+}
 
 void ChunkStore::Put(const NameType& name, const NonEmptyString& value) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (!fs::exists(kDiskPath_)) {
+  ForegroundOperation operation(foreground_operations_);
+  if (backend_->Persistent() && !fs::exists(kDiskPath_)) {
     LOG(kError) << "ChunkStore::Put kDiskPath_ " << kDiskPath_ << " doesn't exists";
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
   }
 
-  const auto& name_str(name.name.string());
-  crypto::AES256KeyAndIV key_and_iv(std::vector<byte>(
-      name_str.begin(), name_str.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
-  auto content(crypto::SymmEncrypt(value, key_and_iv));
-  auto file_path(NameToFilePath(name));
-  std::uint32_t value_size(static_cast<std::uint32_t>(content.data.string().size()));
-  std::uint64_t file_size(0), size(0);
+  // Encryption doesn't touch shared state, so is done before taking the stripe lock.
+  auto content(EncryptChunk(name, value));
+  std::uint32_t value_size(static_cast<std::uint32_t>(content.size()));
+  std::uint64_t size(0);
   bool increment(true);
-  boost::system::error_code error_code;
 
-  if (fs::exists(file_path, error_code)) {
-    if (error_code) {
-      LOG(kError) << "Unable to determine file status for " << file_path << ": "
-                  << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
-    }
-    file_size = fs::file_size(file_path, error_code);
-    if (error_code) {
-      LOG(kError) << "Error getting file size of " << file_path << ": " << error_code.message();
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
-    }
-  }
-  if (file_size != 0) {
-    if (file_size <= value_size) {
-      size = value_size - file_size;
-    } else {
-      size = file_size - value_size;
-      increment = false;
-    }
+  std::lock_guard<std::mutex> lock(StripeMutex(name));
+  std::uint64_t file_size(backend_->Size(name));
+  if (file_size <= value_size) {
+    size = value_size - file_size;
   } else {
-    size = value_size;
+    size = file_size - value_size;
+    increment = false;
   }
 
-  if (increment) {
-    if (!HasDiskSpace(size)) {
-      LOG(kError) << "Cannot store " << name.name << " since the addition of " << size
-                  << " bytes exceeds max of " << max_disk_usage_ << " bytes.";
-      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
-    }
+  if (increment && !ReserveDiskSpace(size)) {
+    LOG(kError) << "Cannot store " << name.name << " since the addition of " << size
+                << " bytes exceeds max of " << max_disk_usage_.load() << " bytes.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
   }
-  if (!WriteFile(file_path, content.data.string())) {
-    LOG(kError) << "Failed to write " << name.name << " to disk.";
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  cache_.Invalidate(name);
+  usage_journal_.Begin(name, file_size);
+  try {
+    backend_->Write(name, content);
+  } catch (const std::exception&) {
+    // The write is left in flight in the journal, so the next recovery checks the chunk.
+    if (increment)
+      ReleaseDiskSpace(size);
+    throw;
   }
+  usage_journal_.End(name, static_cast<std::int64_t>(value_size) -
+                              static_cast<std::int64_t>(file_size));
+
+  if (!increment)
+    ReleaseDiskSpace(size);
+  // While the filter is being rebuilt, the scan may have passed this name already.
+  if (name_filter_ && (file_size == 0 || !name_filter_ready_))
+    name_filter_->Add(name);
+}
 
-  if (increment) {
-    current_disk_usage_.data += size;
-  } else {
-    current_disk_usage_.data -= size;
+void ChunkStore::Delete(const NameType& name) {
+  ForegroundOperation operation(foreground_operations_);
+  std::lock_guard<std::mutex> lock(StripeMutex(name));
+  DeleteLocked(name);
+}
+
+void ChunkStore::DeleteLocked(const NameType& name) {
+  cache_.Invalidate(name);
+  std::uint64_t size(backend_->Size(name));
+  if (size != 0)
+    usage_journal_.Begin(name, size);
+  std::uint64_t removed(backend_->Remove(name));
+  usage_journal_.End(name, -static_cast<std::int64_t>(removed));
+  ReleaseDiskSpace(removed);
+  if (name_filter_ready_)
+    name_filter_->Remove(name);
+}
+
+NonEmptyString ChunkStore::Get(const NameType& name) const {
+  ForegroundOperation operation(foreground_operations_);
+  auto cached(CachedValue(name));
+  if (cached)
+    return *cached;
+  ChunkCache::Ticket ticket(0);
+  NonEmptyString value(DecryptChunk(name, ReadContent(name, ticket)));
+  if (cache_.Enabled())
+    cache_.Insert(name, std::make_shared<const NonEmptyString>(value), ticket);
+  return value;
+}
+
+ChunkStore::SharedValue ChunkStore::GetShared(const NameType& name) const {
+  ForegroundOperation operation(foreground_operations_);
+  auto cached(CachedValue(name));
+  if (cached)
+    return cached;
+  ChunkCache::Ticket ticket(0);
+  SharedValue value(
+      std::make_shared<const NonEmptyString>(DecryptChunk(name, ReadContent(name, ticket))));
+  cache_.Insert(name, value, ticket);
+  return value;
+}
+
+NonEmptyString ChunkStore::GetRange(const NameType& name, std::uint64_t offset,
+                                    std::uint64_t length) const {
+  ForegroundOperation operation(foreground_operations_);
+  if (length == 0)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  // Cuts the range out of 'value', which holds the value's bytes from 'value_offset'.
+  auto slice([offset, length](const std::vector<byte>& value, std::uint64_t value_offset) {
+    if (offset < value_offset || offset - value_offset >= value.size())
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+    auto begin(value.begin() + (offset - value_offset));
+    return NonEmptyString(std::vector<byte>(
+        begin, begin + std::min<std::uint64_t>(length, value.end() - begin)));
+  });
+
+  auto cached(CachedValue(name));
+  if (cached)
+    return slice(cached->string(), 0);
+  const ChunkBlockSpan kSpan(ChunkBlockSpanFor(offset, length));
+  // Reading one byte past the span shows whether it holds the value's last block, which is
+  // sealed differently to the rest.
+  std::unique_lock<std::mutex> lock(StripeMutex(name));
+  auto content(backend_->ReadRange(name, kSpan.content_offset, kSpan.content_length + 1));
+  lock.unlock();
+  if (!content)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  const bool kEndsValue(content->size() <= kSpan.content_length);
+  content->resize(std::min<std::uint64_t>(content->size(), kSpan.content_length));
+  std::vector<byte> value;
+  try {
+    value = DecryptChunkBlocks(name, kSpan.first_block, *content, kEndsValue);
+  } catch (const maidsafe_error&) {
+    // Written as a single block by an earlier version, so it can only be decrypted whole.
+    return slice(Get(name).string(), 0);
   }
+  return slice(value, kSpan.first_block * kChunkBlockSize);
 }
 
-void ChunkStore::Delete(const NameType& name) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto path(NameToFilePath(name));
-  boost::system::error_code error_code;
-  std::uint64_t file_size(fs::file_size(path, error_code));
-  if (error_code) {
-    LOG(kError) << "Error getting file size of " << path << ": " << error_code.message();
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+std::unique_ptr<ChunkStore::Writer> ChunkStore::OpenWriter(const NameType& name) {
+  return std::unique_ptr<Writer>(new Writer(*this, name));
+}
+
+ChunkStore::Writer::Writer(ChunkStore& chunk_store, const NameType& name)
+    : chunk_store_(chunk_store),
+      kName_(name),
+      content_writer_(chunk_store.backend_->OpenWriter(name)),
+      block_(),
+      block_index_(0),
+      reserved_(0),
+      committed_(false) {}
+
+ChunkStore::Writer::~Writer() {
+  if (!committed_)
+    chunk_store_.ReleaseDiskSpace(reserved_);
+}
+
+void ChunkStore::Writer::Append(const std::vector<byte>& piece) {
+  ForegroundOperation operation(chunk_store_.foreground_operations_);
+  if (committed_)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  auto itr(piece.begin());
+  while (itr != piece.end()) {
+    // A full block is only sealed once more of the value follows it, since the last block is
+    // sealed differently.
+    if (block_.size() == kChunkBlockSize)
+      SealBlock(false);
+    auto end(itr + std::min<std::uint64_t>(kChunkBlockSize - block_.size(), piece.end() - itr));
+    block_.insert(block_.end(), itr, end);
+    itr = end;
   }
-  if (!fs::remove(path, error_code) || error_code) {
-    LOG(kError) << "Error removing " << path << ": " << error_code.message();
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+void ChunkStore::Writer::Commit() {
+  ForegroundOperation operation(chunk_store_.foreground_operations_);
+  if (committed_ || block_.empty())
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  SealBlock(true);
+
+  std::lock_guard<std::mutex> lock(chunk_store_.StripeMutex(kName_));
+  std::uint64_t old_size(chunk_store_.backend_->Size(kName_));
+  chunk_store_.cache_.Invalidate(kName_);
+  // If the commit fails, the write is left in flight in the journal, and the reserved space is
+  // released by the destructor.
+  chunk_store_.usage_journal_.Begin(kName_, old_size);
+  content_writer_->Commit();
+  chunk_store_.usage_journal_.End(
+      kName_, static_cast<std::int64_t>(reserved_) - static_cast<std::int64_t>(old_size));
+  committed_ = true;
+  chunk_store_.ReleaseDiskSpace(old_size);
+  if (chunk_store_.name_filter_ && (old_size == 0 || !chunk_store_.name_filter_ready_))
+    chunk_store_.name_filter_->Add(kName_);
+}
+
+void ChunkStore::Writer::SealBlock(bool last_block) {
+  auto sealed(EncryptChunkBlock(kName_, block_index_, block_, last_block));
+  if (!chunk_store_.ReserveDiskSpace(sealed.size())) {
+    LOG(kError) << "Cannot store " << kName_.name << " since the addition of " << sealed.size()
+                << " bytes exceeds max of " << chunk_store_.max_disk_usage_.load() << " bytes.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
   }
-  current_disk_usage_.data -= file_size;
+  reserved_ += sealed.size();
+  content_writer_->Append(sealed);
+  ++block_index_;
+  block_.clear();
 }
 
-NonEmptyString ChunkStore::Get(const NameType& name) const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto content(ReadFile(NameToFilePath(name)));
+ChunkStore::SharedValue ChunkStore::CachedValue(const NameType& name) const {
+  if (name_filter_ready_ && !name_filter_->MayContain(name))
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  return cache_.Get(name);
+}
+
+std::vector<byte> ChunkStore::ReadContent(const NameType& name, ChunkCache::Ticket& ticket) const {
+  std::unique_lock<std::mutex> lock(StripeMutex(name));
+  ticket = cache_.GetTicket(name);
+  auto content(backend_->Read(name));
+  lock.unlock();
   if (!content)
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  return std::move(*content);
+}
+
+void ChunkStore::PutBatch(const NameValuePairs& name_value_pairs) {
+  ForegroundOperation operation(foreground_operations_);
+  if (backend_->Persistent() && !fs::exists(kDiskPath_)) {
+    LOG(kError) << "ChunkStore::PutBatch kDiskPath_ " << kDiskPath_ << " doesn't exists";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+
+  // Where a name appears more than once, only its last value is stored.
+  std::map<NameType, std::size_t> last_occurrence;
+  for (std::size_t i(0); i != name_value_pairs.size(); ++i)
+    last_occurrence[name_value_pairs[i].first] = i;
+  std::vector<NameType> names;
+  std::vector<std::future<std::vector<byte>>> encryptions;
+  for (const auto& occurrence : last_occurrence) {
+    const NameType& name(occurrence.first);
+    const NonEmptyString& value(name_value_pairs[occurrence.second].second);
+    names.push_back(name);
+    encryptions.push_back(PostCrypto([&name, &value] { return EncryptChunk(name, value); }));
+  }
+  // The whole batch is encrypted before any stripe is locked.
+  auto contents(GetAll(encryptions));
+
+  auto locks(LockStripes(names));
+  auto order(backend_->LocalityOrder(names));
+  std::vector<std::uint64_t> old_sizes(names.size());
+  std::uint64_t growth(0), shrinkage(0);
+  for (std::size_t i(0); i != names.size(); ++i) {
+    old_sizes[i] = backend_->Size(names[i]);
+    if (contents[i].size() > old_sizes[i])
+      growth += contents[i].size() - old_sizes[i];
+    else
+      shrinkage += old_sizes[i] - contents[i].size();
+  }
+  if (!ReserveDiskSpace(growth)) {
+    LOG(kError) << "Cannot store batch of " << names.size() << " since the addition of " << growth
+                << " bytes exceeds max of " << max_disk_usage_.load() << " bytes.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+
+  std::size_t written(0);
   try {
-    const auto& name_str(name.name.string());
-    crypto::AES256KeyAndIV key_and_iv(std::vector<byte>(
-        name_str.begin(), name_str.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
-    return crypto::SymmDecrypt(crypto::CipherText(NonEmptyString(*content)), key_and_iv);
+    for (; written != order.size(); ++written) {
+      std::size_t i(order[written]);
+      cache_.Invalidate(names[i]);
+      usage_journal_.Begin(names[i], old_sizes[i]);
+      backend_->WriteUnsynced(names[i], contents[i]);
+      if (name_filter_ && (old_sizes[i] == 0 || !name_filter_ready_))
+        name_filter_->Add(names[i]);
+    }
+    backend_->Sync();
   } catch (const std::exception&) {
-    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    // Give back the space reserved for entries which weren't written, and account for the space
+    // freed by those which were.
+    std::uint64_t unused(0);
+    for (std::size_t j(written); j < order.size(); ++j) {
+      std::size_t i(order[j]);
+      if (contents[i].size() > old_sizes[i])
+        unused += contents[i].size() - old_sizes[i];
+      else
+        shrinkage -= old_sizes[i] - contents[i].size();
+    }
+    ReleaseDiskSpace(unused + shrinkage);
+    throw;
+  }
+  // Writes are only recorded as ended once the sync has made them durable.
+  for (std::size_t i(0); i != names.size(); ++i) {
+    usage_journal_.End(names[i], static_cast<std::int64_t>(contents[i].size()) -
+                                     static_cast<std::int64_t>(old_sizes[i]));
   }
+  ReleaseDiskSpace(shrinkage);
+}
+
+std::vector<ChunkStore::GetResult> ChunkStore::GetBatch(const std::vector<NameType>& names) const {
+  ForegroundOperation operation(foreground_operations_);
+  std::vector<GetResult> results(names.size(),
+                                 boost::make_unexpected(MakeError(CommonErrors::no_such_element)));
+  struct Decryption {
+    std::size_t index;
+    ChunkCache::Ticket ticket;
+    std::future<NonEmptyString> value;
+  };
+  // Each chunk read is handed to the crypto stage, which decrypts it while the next is read.
+  std::vector<Decryption> decryptions;
+  for (auto i : backend_->LocalityOrder(names)) {
+    try {
+      auto cached(CachedValue(names[i]));
+      if (cached) {
+        results[i] = *cached;
+        continue;
+      }
+      Decryption decryption{i, 0, std::future<NonEmptyString>()};
+      // asio handlers must be copyable, hence the shared_ptr.
+      auto content(std::make_shared<std::vector<byte>>(ReadContent(names[i], decryption.ticket)));
+      NameType name(names[i]);
+      decryption.value =
+          PostCrypto([name, content] { return DecryptChunk(name, std::move(*content)); });
+      decryptions.push_back(std::move(decryption));
+    } catch (const maidsafe_error& error) {
+      results[i] = boost::make_unexpected(error);
+    }
+  }
+
+  for (auto& decryption : decryptions) {
+    try {
+      NonEmptyString value(decryption.value.get());
+      if (cache_.Enabled()) {
+        cache_.Insert(names[decryption.index], std::make_shared<const NonEmptyString>(value),
+                      decryption.ticket);
+      }
+      results[decryption.index] = std::move(value);
+    } catch (const maidsafe_error& error) {
+      results[decryption.index] = boost::make_unexpected(error);
+    }
+  }
+  return results;
+}
+
+void ChunkStore::DeleteBatch(const std::vector<NameType>& names) {
+  ForegroundOperation operation(foreground_operations_);
+  auto locks(LockStripes(names));
+  std::uint64_t freed(0);
+  std::vector<std::pair<NameType, std::uint64_t>> removals;
+  std::exception_ptr first_error;
+  for (auto i : backend_->LocalityOrder(names)) {
+    try {
+      cache_.Invalidate(names[i]);
+      std::uint64_t size(backend_->Size(names[i]));
+      if (size != 0)
+        usage_journal_.Begin(names[i], size);
+      std::uint64_t removed(backend_->Remove(names[i]));
+      removals.emplace_back(names[i], removed);
+      freed += removed;
+      if (name_filter_ready_)
+        name_filter_->Remove(names[i]);
+    } catch (...) {
+      // Whatever the failure, the removals which did happen are still accounted for below.
+      if (!first_error)
+        first_error = std::current_exception();
+    }
+  }
+  ReleaseDiskSpace(freed);
+  // If the sync fails, the removals are left in flight in the journal, to be checked at startup.
+  backend_->Sync();
+  for (const auto& removal : removals)
+    usage_journal_.End(removal.first, -static_cast<std::int64_t>(removal.second));
+  if (first_error)
+    std::rethrow_exception(first_error);
+}
+
+bool ChunkStore::Has(const NameType& name) const {
+  ForegroundOperation operation(foreground_operations_);
+  if (name_filter_ready_ && !name_filter_->MayContain(name))
+    return false;
+  std::lock_guard<std::mutex> lock(StripeMutex(name));
+  return backend_->Size(name) != 0;
+}
+
+template <typename Functor>
+std::future<typename std::result_of<Functor()>::type> ChunkStore::Post(
+    std::once_flag& flag, std::unique_ptr<AsioService>& service, std::uint32_t thread_count,
+    Functor functor) {
+  std::call_once(flag, [&service, thread_count] { service.reset(new AsioService(thread_count)); });
+  // asio handlers must be copyable, hence the shared_ptr.
+  auto task(std::make_shared<std::packaged_task<typename std::result_of<Functor()>::type()>>(
+      std::move(functor)));
+  auto result(task->get_future());
+  service->service().post([task] { (*task)(); });
+  return result;
+}
+
+template <typename Functor>
+std::future<typename std::result_of<Functor()>::type> ChunkStore::PostIo(Functor functor) const {
+  return Post(io_service_flag_, io_service_, kIoThreadCount, std::move(functor));
+}
+
+template <typename Functor>
+std::future<typename std::result_of<Functor()>::type> ChunkStore::PostCrypto(
+    Functor functor) const {
+  return Post(crypto_service_flag_, crypto_service_, Concurrency(), std::move(functor));
+}
+
+std::future<void> ChunkStore::AsyncPut(const NameType& name, const NonEmptyString& value) {
+  return PostIo([=] { Put(name, value); });
+}
+
+std::future<NonEmptyString> ChunkStore::AsyncGet(const NameType& name) const {
+  return PostIo([=] { return Get(name); });
 }
 
 void ChunkStore::SetMaxDiskUsage(DiskUsage max_disk_usage) {
-  if (current_disk_usage_ > max_disk_usage) {
-    LOG(kError) << "current_disk_usage_ " << current_disk_usage_.data
+  if (current_disk_usage_ > max_disk_usage.data) {
+    LOG(kError) << "current_disk_usage_ " << current_disk_usage_.load()
                 << " exceeds target max_disk_usage " << max_disk_usage.data;
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
-  max_disk_usage_ = max_disk_usage;
+  max_disk_usage_ = max_disk_usage.data;
 }
 
-std::vector<ChunkStore::NameType> ChunkStore::Names() const {
-  std::vector<NameType> names;
-  fs::directory_iterator end_iter;
+std::vector<StripedBackend::DeviceStatistics> ChunkStore::Devices() const {
+  return striped_backend_ ? striped_backend_->Statistics()
+                          : std::vector<StripedBackend::DeviceStatistics>();
+}
 
-  if (fs::exists(kDiskPath_) && fs::is_directory(kDiskPath_)) {
-    for (fs::directory_iterator dir_iter(kDiskPath_); dir_iter != end_iter; ++dir_iter) {
-      if (fs::is_regular_file(dir_iter->status()))
-        names.push_back(detail::GetDataNameAndTypeId(*dir_iter));
-      else
-        GetNames(dir_iter->path(), dir_iter->path().filename().string(), names);
-    }
+std::vector<ChunkStore::ScrubResult> ChunkStore::ScrubBatch(const std::vector<NameType>& names) {
+  std::vector<ScrubResult> results(names.size(), ScrubResult{false, 0, false});
+  std::vector<std::shared_ptr<std::vector<byte>>> contents(names.size());
+  std::vector<std::future<bool>> verifications(names.size());
+  for (std::size_t i(0); i != names.size(); ++i) {
+    if (foreground_operations_ != 0)
+      break;
+    results[i].checked = true;
+    std::unique_lock<std::mutex> lock(StripeMutex(names[i]));
+    auto content(backend_->ReadUntracked(names[i]));
+    lock.unlock();
+    if (!content)
+      continue;
+    results[i].size = content->size();
+    // asio handlers must be copyable, hence the shared_ptr.
+    contents[i] = std::make_shared<std::vector<byte>>(std::move(*content));
+    NameType name(names[i]);
+    auto shared_content(contents[i]);
+    verifications[i] = PostCrypto([name, shared_content] {
+      return VerifyChunk(name, *shared_content);
+    });
+  }
+
+  for (std::size_t i(0); i != names.size(); ++i) {
+    if (!verifications[i].valid() || verifications[i].get())
+      continue;
+    LOG(kError) << "Chunk " << HexSubstr(names[i].name) << " is corrupt.";
+    results[i].corrupt = Quarantine(names[i], *contents[i]);
   }
-  return names;
+  return results;
 }
 
-void ChunkStore::GetNames(const boost::filesystem::path& path, std::string prefix,
-                          std::vector<NameType>& names) const {
-  fs::directory_iterator end_iter;
-  for (fs::directory_iterator dir_iter(path); dir_iter != end_iter; ++dir_iter) {
-    if (fs::is_regular_file(dir_iter->status()))
-      names.push_back(ComposeName(prefix + dir_iter->path().filename().string()));
-    else
-      GetNames(dir_iter->path(), prefix + dir_iter->path().filename().string(), names);
+boost::filesystem::path ChunkStore::QuarantinePath() const {
+  if (!backend_->Persistent())
+    return fs::path();
+  return kDiskPath_ / kMetadataDirName / kQuarantineDirName;
+}
+
+std::vector<TieredBackend::TierStatistics> ChunkStore::Tiers() const {
+  return tiered_backend_ ? tiered_backend_->Statistics()
+                         : std::vector<TieredBackend::TierStatistics>();
+}
+
+std::unique_ptr<ChunkStore::NameCursor> ChunkStore::Names(const NameRange& range) const {
+  return std::move(backend_->Names(range, 1).front());
+}
+
+std::vector<std::unique_ptr<ChunkStore::NameCursor>> ChunkStore::Names(
+    const NameRange& range, std::uint32_t count) const {
+  if (count == 0)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  return backend_->Names(range, count);
+}
+
+std::unique_ptr<ChunkStore::NameCursor> ChunkStore::NamesPart(const NameRange& range,
+                                                              std::uint32_t part,
+                                                              std::uint32_t count) const {
+  if (part >= count)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  return backend_->NamesPart(range, part, count);
+}
+
+bool ChunkStore::Quarantine(const NameType& name, const std::vector<byte>& content) {
+  std::lock_guard<std::mutex> lock(StripeMutex(name));
+  // It may have been overwritten or deleted since it was read.
+  auto current(backend_->ReadUntracked(name));
+  if (!current || *current != content)
+    return false;
+  // The chunk is removed even if its content can't be kept, since it's of no use in the store.
+  if (backend_->Persistent()) {
+    boost::system::error_code error_code;
+    fs::create_directories(QuarantinePath(), error_code);
+    if (!WriteFile(QuarantinePath() / detail::GetFileName(name), content))
+      LOG(kError) << "Failed to keep the content of corrupt chunk " << HexSubstr(name.name);
   }
+  DeleteLocked(name);
+  return true;
 }
 
-ChunkStore::NameType ChunkStore::ComposeName(std::string file_name_str) const {
-  size_t index(file_name_str.rfind('_'));
-  auto type(static_cast<DataTypeId>(std::stoul(file_name_str.substr(index + 1))));
-  Identity id(hex::DecodeToBytes(file_name_str.substr(0, index)));
-  return NameType(id, type);
+bool ChunkStore::ReserveDiskSpace(std::uint64_t required_space) {
+  std::uint64_t current(current_disk_usage_.load());
+  do {
+    if (current + required_space > max_disk_usage_)
+      return false;
+  } while (!current_disk_usage_.compare_exchange_weak(current, current + required_space));
+  return true;
 }
 
-bool ChunkStore::HasDiskSpace(std::uint64_t required_space) const {
-  return current_disk_usage_ + required_space <= max_disk_usage_;
+void ChunkStore::ReleaseDiskSpace(std::uint64_t freed_space) { current_disk_usage_ -= freed_space; }
+
+std::mutex& ChunkStore::StripeMutex(const NameType& name) const {
+  return stripe_mutexes_[StripeIndex(name)];
 }
 
-fs::path ChunkStore::NameToFilePath(NameType name) const {
-  name.name = crypto::Hash<crypto::SHA512>(name.name);
-  std::string file_name(detail::GetFileName(name).string());
+std::size_t ChunkStore::StripeIndex(const NameType& name) const {
+  const auto& name_bytes(name.name.string());
+  std::size_t index((name_bytes[0] << 8 | name_bytes[1]) + name.type_id.data);
+  return index % stripe_mutexes_.size();
+}
 
-  std::uint32_t directory_depth = kDepth_;
-  if (file_name.size() < directory_depth)
-    directory_depth = static_cast<std::uint32_t>(file_name.size() - 1);
+std::vector<std::unique_lock<std::mutex>> ChunkStore::LockStripes(
+    const std::vector<NameType>& names) const {
+  std::set<std::size_t> indices;
+  for (const auto& name : names)
+    indices.insert(StripeIndex(name));
+  std::vector<std::unique_lock<std::mutex>> locks;
+  for (auto index : indices)
+    locks.emplace_back(stripe_mutexes_[index]);
+  return locks;
+}
 
-  fs::path disk_path(kDiskPath_);
-  for (std::uint32_t i = 0; i < directory_depth; ++i)
-    disk_path /= file_name.substr(i, 1);
+std::uint64_t ChunkStore::RecoverInFlight(std::uint64_t usage,
+                                           const std::vector<UsageJournal::Intent>& in_flight) {
+  if (in_flight.empty())
+    return usage;
+  std::vector<NameType> names;
+  for (const auto& intent : in_flight)
+    names.push_back(intent.name);
+  backend_->DiscardIncompleteWrites(names);
+  std::int64_t corrected_usage(static_cast<std::int64_t>(usage));
+  for (const auto& intent : in_flight) {
+    auto content(backend_->Read(intent.name));
+    if (content) {
+      try {
+        DecryptChunk(intent.name, std::move(*content));
+      } catch (const maidsafe_error&) {
+        LOG(kWarning) << "Removing " << intent.name.name << ", left incomplete by a crash.";
+        backend_->Remove(intent.name);
+      }
+    }
+    corrected_usage += static_cast<std::int64_t>(backend_->Size(intent.name)) -
+                       static_cast<std::int64_t>(intent.old_size);
+  }
+  return static_cast<std::uint64_t>(std::max(corrected_usage, std::int64_t(0)));
+}
 
-  boost::system::error_code ec;
-  fs::create_directories(disk_path, ec);
+void ChunkStore::InitialiseNameFilter(bool clean_start, bool background) {
+  // Loading also removes the saved filter, so it can't be mistaken for current by a later session.
+  auto saved_filter(backend_->Persistent()
+                        ? NameFilter::Load(kDiskPath_ / kMetadataDirName / kNameFilterFileName)
+                        : std::unique_ptr<NameFilter>());
+  if (clean_start && saved_filter && !saved_filter->NeedsResize()) {
+    name_filter_ = std::move(saved_filter);
+    name_filter_ready_ = true;
+    return;
+  }
+  std::uint64_t expected_count(max_disk_usage_ / kTypicalChunkSize);
+  if (saved_filter)
+    expected_count = std::max(expected_count, saved_filter->Count());
+  saved_filter.reset();
+  if (background) {
+    // Scanning every name here would make recovery cost time proportional to the size of the
+    // store.  If the rebuilt filter turns out to be too small, it's resized at the next start.
+    name_filter_.reset(new NameFilter(expected_count));
+    name_filter_thread_ = std::thread([this] {
+      // On failure the filter is never used, and lookups keep going to the backend.
+      try {
+        FillNameFilter();
+        name_filter_ready_ = !stop_name_filter_;
+      } catch (const std::exception& e) {
+        LOG(kError) << "Failed to rebuild the name filter: " << boost::diagnostic_information(e);
+      }
+    });
+    return;
+  }
+  for (;;) {
+    name_filter_.reset(new NameFilter(expected_count));
+    FillNameFilter();
+    if (!name_filter_->NeedsResize())
+      break;
+    expected_count = name_filter_->Count();
+  }
+  name_filter_ready_ = true;
+}
 
-  return fs::path(disk_path / file_name.substr(directory_depth));
+void ChunkStore::FillNameFilter() {
+  std::vector<std::future<void>> scans;
+  for (auto& cursor : backend_->Names(NameRange(), Concurrency())) {
+    std::shared_ptr<ChunkStoreBackend::NameCursor> shared_cursor(std::move(cursor));
+    scans.push_back(std::async(std::launch::async, [this, shared_cursor] {
+      while (!stop_name_filter_) {
+        auto name(shared_cursor->Next());
+        if (!name)
+          return;
+        name_filter_->Add(*name);
+      }
+    }));
+  }
+  for (auto& scan : scans)
+    scan.get();
 }
 
 }  // namespace vault
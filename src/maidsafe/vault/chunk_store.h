@@ -19,14 +19,24 @@
 #ifndef MAIDSAFE_VAULT_CHUNK_STORE_H_
 #define MAIDSAFE_VAULT_CHUNK_STORE_H_
 
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "boost/expected/expected.hpp"
 #include "boost/filesystem/path.hpp"
 
+#include "maidsafe/common/asio_service.h"
+#include "maidsafe/common/error.h"
 #include "maidsafe/common/tagged_value.h"
 #include "maidsafe/common/types.h"
 #include "maidsafe/common/data_types/data.h"
@@ -34,6 +44,14 @@
 #include "maidsafe/common/data_types/mutable_data.h"
 #include "maidsafe/passport/types.h"
 
+#include "maidsafe/vault/chunk_store/backend.h"
+#include "maidsafe/vault/chunk_store/chunk_cache.h"
+#include "maidsafe/vault/chunk_store/memory_backend.h"
+#include "maidsafe/vault/chunk_store/name_filter.h"
+#include "maidsafe/vault/chunk_store/striped_backend.h"
+#include "maidsafe/vault/chunk_store/tiered_backend.h"
+#include "maidsafe/vault/chunk_store/usage_journal.h"
+
 namespace maidsafe {
 
 namespace vault {
@@ -41,8 +59,85 @@ namespace vault {
 class ChunkStore {
  public:
   using NameType = Data::NameAndTypeId;
+  using NameValuePairs = std::vector<std::pair<NameType, NonEmptyString>>;
+  using GetResult = boost::expected<NonEmptyString, maidsafe_error>;
+  using NameCursor = ChunkStoreBackend::NameCursor;
+  using SharedValue = ChunkCache::Value;
+
+  // Streams a value into the store a piece at a time (see OpenWriter), holding no more than one
+  // block of it (see kChunkBlockSize in chunk_crypto.h) in memory.  The encrypted blocks go
+  // straight to the backend's writer: the file-per-chunk layout streams them to disk, as do
+  // striped and tiered backends to their chosen child, but the pack-file layout and the memory
+  // backend still gather the whole content in memory until Commit.  Destroying a writer which
+  // hasn't been committed stores nothing.
+  class Writer {
+   public:
+    ~Writer();
+    Writer(const Writer&) = delete;
+    Writer(Writer&&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    Writer& operator=(Writer&&) = delete;
+
+    // Space is reserved for the value as it's appended, on top of any value it will replace.
+    // Throws cannot_exceed_limit if the value so far doesn't fit.
+    void Append(const std::vector<byte>& piece);
+    // Stores the value, replacing any existing one as Put would.  Throws invalid_argument if
+    // nothing was appended.
+    void Commit();
+
+   private:
+    friend class ChunkStore;
+    Writer(ChunkStore& chunk_store, const NameType& name);
+    // Encrypts the buffered block and passes it to the backend.
+    void SealBlock(bool last_block);
+
+    ChunkStore& chunk_store_;
+    const NameType kName_;
+    std::unique_ptr<ChunkStoreBackend::ContentWriter> content_writer_;
+    std::vector<byte> block_;
+    std::uint64_t block_index_, reserved_;
+    bool committed_;
+  };
+
+  // The outcome of scrubbing one chunk (see ScrubBatch).
+  struct ScrubResult {
+    // False if the chunk wasn't checked because the store was busy.
+    bool checked;
+    // The size of the encrypted content read, or 0 if the name isn't held.
+    std::uint64_t size;
+    bool corrupt;
+  };
+
+  // How chunks are laid out under the disk path.  kFilePerChunk stores each chunk as its own
+  // file, kPackFile appends them to large segment files (see PackFileBackend).  A store must be
+  // reopened with the layout it was created with.
+  enum class Layout { kFilePerChunk, kPackFile };
 
-  ChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage);
+  struct DiskRoot {
+    boost::filesystem::path path;
+    DiskUsage capacity;
+  };
+
+  // 'cache_size' bounds the memory used to cache decrypted contents for Get (see ChunkCache).
+  ChunkStore(const boost::filesystem::path& disk_path, DiskUsage max_disk_usage,
+             MemoryUsage cache_size = MemoryUsage(0), Layout layout = Layout::kFilePerChunk);
+  // Stripes the chunks over several disk roots, normally one per device (see StripedBackend).
+  // Each root holds its own store with the given layout.  The max disk usage starts as the sum of
+  // the capacities, and the store's own metadata is kept under the first root.
+  ChunkStore(const std::vector<DiskRoot>& disk_roots, MemoryUsage cache_size = MemoryUsage(0),
+             Layout layout = Layout::kFilePerChunk);
+  // Keeps new and frequently read chunks on the fast tier, and moves cold ones to the slow tier in
+  // the background (see TieredBackend).  Each tier holds its own store with the given layout.  The
+  // max disk usage starts as the sum of the capacities, and the store's own metadata is kept
+  // under the fast tier's root.
+  ChunkStore(const DiskRoot& fast_tier, const DiskRoot& slow_tier,
+             MemoryUsage cache_size = MemoryUsage(0), Layout layout = Layout::kFilePerChunk);
+  // Holds the chunks in 'backend', e.g. a MemoryBackend.  A persistent backend needs 'disk_path'
+  // for the store's own metadata, while a store over one that isn't keeps nothing on disk and
+  // leaves 'disk_path' empty.  The max disk usage is enforced whatever the backend.
+  ChunkStore(std::unique_ptr<ChunkStoreBackend> backend, DiskUsage max_disk_usage,
+             MemoryUsage cache_size = MemoryUsage(0),
+             const boost::filesystem::path& disk_path = boost::filesystem::path());
   ~ChunkStore();
   ChunkStore(const ChunkStore&) = delete;
   ChunkStore(ChunkStore&&) = delete;
@@ -52,25 +147,134 @@ class ChunkStore {
   void Put(const NameType& name, const NonEmptyString& value);
   void Delete(const NameType& name);
   NonEmptyString Get(const NameType& name) const;
+  // As Get, but the value is shared with the cache rather than copied out of it, so a cache hit
+  // copies nothing and a miss copies nothing beyond reading and decrypting the chunk.
+  SharedValue GetShared(const NameType& name) const;
+  // Most names which aren't held are rejected by an in-memory filter, without touching the disk.
+  // After an unclean shutdown the filter is rebuilt in the background, and isn't used until ready.
+  bool Has(const NameType& name) const;
+
+  // Returns the value's bytes from 'offset' for 'length', or as far as the value goes.  Only the
+  // blocks holding the range are read and decrypted.  Throws invalid_argument if 'length' is 0 or
+  // 'offset' isn't within the value.
+  NonEmptyString GetRange(const NameType& name, std::uint64_t offset, std::uint64_t length) const;
+  std::unique_ptr<Writer> OpenWriter(const NameType& name);
+
+  // Batch versions of Put, Get and Delete.  Each visits the names in the order the backend finds
+  // cheapest, and PutBatch and DeleteBatch end with a single Sync of the backend making the whole
+  // batch durable, rather than syncing each write (see ChunkStoreBackend::WriteUnsynced).
+  // PutBatch encrypts the whole batch in parallel on a pool of crypto threads before writing any
+  // of it, and GetBatch has the pool decrypt each chunk while it reads the next.
+  //
+  // PutBatch reserves the space for the whole batch up front, and throws without storing anything
+  // if it doesn't fit.  If a write fails, the error is thrown and only some of the batch may have
+  // been stored.  DeleteBatch deletes everything it can before throwing the first error (e.g. for
+  // a name which isn't held).  Stripe locks for the whole batch are held while it is written.
+  void PutBatch(const NameValuePairs& name_value_pairs);
+  std::vector<GetResult> GetBatch(const std::vector<NameType>& names) const;
+  void DeleteBatch(const std::vector<NameType>& names);
+
+  // Asynchronous versions of Put and Get.  Each operation runs on a pool of I/O threads owned by
+  // the store (started on first use), so up to kIoThreadCount operations can be in flight at once.
+  // Errors are reported by the returned future.  Operations still queued when the store is
+  // destroyed are completed first.
+  std::future<void> AsyncPut(const NameType& name, const NonEmptyString& value);
+  std::future<NonEmptyString> AsyncGet(const NameType& name) const;
 
   void SetMaxDiskUsage(DiskUsage max_disk_usage);
 
-  DiskUsage MaxDiskUsage() const { return max_disk_usage_; }
-  DiskUsage CurrentDiskUsage() const { return current_disk_usage_; }
+  DiskUsage MaxDiskUsage() const { return DiskUsage(max_disk_usage_.load()); }
+  DiskUsage CurrentDiskUsage() const { return DiskUsage(current_disk_usage_.load()); }
   boost::filesystem::path DiskPath() const { return kDiskPath_; }
-  std::vector<NameType> Names() const;
+  // Streams the names held (see ChunkStoreBackend::NameCursor).  Cursors mustn't outlive the store.
+  std::unique_ptr<NameCursor> Names(const NameRange& range = NameRange()) const;
+  // Splits the names in 'range' between 'count' cursors, which can be used concurrently.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const;
+  // The cursor Names(range, count) returns at 'part', without opening the others.
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const;
+
+  std::uint64_t CacheHits() const { return cache_.Hits(); }
+  std::uint64_t CacheMisses() const { return cache_.Misses(); }
+  // Usage and throughput for each disk root, or nothing if the store has a single disk path.
+  std::vector<StripedBackend::DeviceStatistics> Devices() const;
+
+  // Checks the chunks held for 'names' (see ChunkStoreScrubber).  Each must decrypt, and immutable
+  // data must hash to its name; the checks run in parallel on the crypto threads.  Corrupt chunks
+  // are moved to QuarantinePath() and removed from the store.  Chunks are read without being cached
+  // or counted as accesses, and only while no other operation is in progress: the batch stops at
+  // the first chunk it would have to read while the store is busy, leaving the rest unchecked.
+  std::vector<ScrubResult> ScrubBatch(const std::vector<NameType>& names);
+  // Empty if the backend isn't persistent, in which case corrupt chunks are just removed.
+  boost::filesystem::path QuarantinePath() const;
+  // Occupancy and counts of chunks moved for the fast and slow tiers, or nothing if the store
+  // isn't tiered.
+  std::vector<TieredBackend::TierStatistics> Tiers() const;
 
  private:
-  bool HasDiskSpace(std::uint64_t required_space) const;
-  boost::filesystem::path NameToFilePath(NameType name) const;
-  void GetNames(const boost::filesystem::path& path, std::string prefix,
-                std::vector<NameType>& names) const;
-  NameType ComposeName(std::string file_name_str) const;
+  // Throws if the name filter rules 'name' out, otherwise returns its cached value, if any.
+  SharedValue CachedValue(const NameType& name) const;
+  // Reads the encrypted content held for 'name', having taken 'ticket' for caching its value.
+  std::vector<byte> ReadContent(const NameType& name, ChunkCache::Ticket& ticket) const;
+  // Removes 'name', whose stripe must be locked.
+  void DeleteLocked(const NameType& name);
+  // Moves the chunk's content to the quarantine directory and deletes it, unless the content is no
+  // longer 'content'.  Returns true if the chunk was quarantined.
+  bool Quarantine(const NameType& name, const std::vector<byte>& content);
+  // Atomically adds 'required_space' to the current usage if doing so doesn't exceed the max.
+  bool ReserveDiskSpace(std::uint64_t required_space);
+  void ReleaseDiskSpace(std::uint64_t freed_space);
+  // Operations on different names are serialised only if the names map to the same stripe.
+  std::mutex& StripeMutex(const NameType& name) const;
+  std::size_t StripeIndex(const NameType& name) const;
+  // Locks the stripes for all of 'names', in index order.
+  std::vector<std::unique_lock<std::mutex>> LockStripes(const std::vector<NameType>& names) const;
+  // Recovers the usage and the name filter once the backend is in place.
+  void Initialise();
+  // Checks the chunks which the journal shows were being written or removed when the previous
+  // session ended, removing any which can't be decrypted, and returns the resulting usage.
+  std::uint64_t RecoverInFlight(std::uint64_t usage,
+                                const std::vector<UsageJournal::Intent>& in_flight);
+  // Loads the name filter saved by a cleanly closed previous session, or else rebuilds it, on a
+  // background thread if 'background' is set.
+  void InitialiseNameFilter(bool clean_start, bool background);
+  // Adds every name held to name_filter_, stopping early if stop_name_filter_ is set.
+  void FillNameFilter();
+  // Runs 'functor' on 'service', starting it with 'thread_count' threads if it isn't running.
+  template <typename Functor>
+  static std::future<typename std::result_of<Functor()>::type> Post(
+      std::once_flag& flag, std::unique_ptr<AsioService>& service, std::uint32_t thread_count,
+      Functor functor);
+  template <typename Functor>
+  std::future<typename std::result_of<Functor()>::type> PostIo(Functor functor) const;
+  // The crypto stage: a pool of one thread per core, used to encrypt and decrypt batches.
+  template <typename Functor>
+  std::future<typename std::result_of<Functor()>::type> PostCrypto(Functor functor) const;
+
+  static const std::uint32_t kIoThreadCount = 32;
 
   const boost::filesystem::path kDiskPath_;
-  DiskUsage max_disk_usage_, current_disk_usage_;
-  const std::uint32_t kDepth_;
-  mutable std::mutex mutex_;
+  std::atomic<std::uint64_t> max_disk_usage_, current_disk_usage_;
+  mutable std::array<std::mutex, 64> stripe_mutexes_;
+  UsageJournal usage_journal_;
+  std::unique_ptr<ChunkStoreBackend> backend_;
+  // Points to backend_ if it's striped, otherwise null.
+  StripedBackend* striped_backend_;
+  // Points to backend_ if it's tiered, otherwise null.
+  TieredBackend* tiered_backend_;
+  mutable ChunkCache cache_;
+  // Null if the backend can't list the names it holds.  Names are added while the filter is being
+  // rebuilt, but it's only consulted, and names removed from it, once it's ready.
+  std::unique_ptr<NameFilter> name_filter_;
+  std::atomic<bool> name_filter_ready_, stop_name_filter_;
+  std::thread name_filter_thread_;
+  mutable std::once_flag io_service_flag_;
+  mutable std::unique_ptr<AsioService> io_service_;
+  mutable std::once_flag crypto_service_flag_;
+  mutable std::unique_ptr<AsioService> crypto_service_;
+  // Operations other than scrubbing in progress.
+  mutable std::atomic<std::uint32_t> foreground_operations_;
 };
 
 }  // namespace vault
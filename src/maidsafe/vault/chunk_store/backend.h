@@ -0,0 +1,155 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_BACKEND_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "boost/optional/optional.hpp"
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+#include "maidsafe/vault/chunk_store/name_range.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Holds the already-encrypted contents for a ChunkStore.  ChunkStore serialises all operations on
+// any one name, so implementations only need to cope with concurrent operations on different
+// names.  Failures other than a missing name are reported by throwing.
+class ChunkStoreBackend {
+ public:
+  using NameType = Data::NameAndTypeId;
+
+  // Streams the names held, reading them in as they're needed.  Names written or removed while a
+  // cursor is in use may or may not be returned.
+  class NameCursor {
+   public:
+    virtual ~NameCursor() {}
+    // Returns nothing once every name has been returned.
+    virtual boost::optional<NameType> Next() = 0;
+  };
+
+  // Receives the content for a name a piece at a time (see OpenWriter).
+  class ContentWriter {
+   public:
+    virtual ~ContentWriter() {}
+    virtual void Append(const std::vector<byte>& piece) = 0;
+    // Replaces any existing content with everything appended, as Write would.
+    virtual void Commit() = 0;
+  };
+
+  virtual ~ChunkStoreBackend() {}
+
+  // Total size of all stored contents, worked out from what is actually held.
+  virtual std::uint64_t ScanUsage() const = 0;
+  // Size of the content held for 'name', or 0 if there is none.
+  virtual std::uint64_t Size(const NameType& name) const = 0;
+  // Replaces any existing content such that a crash part way through leaves either the old
+  // content or the new (or, for content which isn't synced, possibly a torn copy of the new).
+  virtual void Write(const NameType& name, const std::vector<byte>& content) = 0;
+  // As Write, but leaves making the content durable to the next Sync, so that a batch of writes
+  // pays for syncing once.  By default the same as Write.
+  virtual void WriteUnsynced(const NameType& name, const std::vector<byte>& content) {
+    Write(name, content);
+  }
+  virtual boost::optional<std::vector<byte>> Read(const NameType& name) const = 0;
+  // As Read, but not counted as an access by backends which track them, so that e.g. scrubbing
+  // doesn't make every chunk look recently used.
+  virtual boost::optional<std::vector<byte>> ReadUntracked(const NameType& name) const {
+    return Read(name);
+  }
+  // Reads up to 'length' bytes of the content from 'offset'; fewer if the content ends first.
+  virtual boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                                       std::uint64_t length) const {
+    auto content(Read(name));
+    if (content) {
+      content->erase(content->begin(),
+                     content->begin() + std::min<std::uint64_t>(offset, content->size()));
+      if (content->size() > length)
+        content->resize(length);
+    }
+    return content;
+  }
+  // Nothing appended is visible until Commit, and a writer destroyed without committing leaves
+  // the existing content alone.  ChunkStore serialises the Commit with other operations on the
+  // name, but not the appends.  By default the pieces are gathered in memory and passed to Write.
+  virtual std::unique_ptr<ContentWriter> OpenWriter(const NameType& name);
+  // Returns the size of the removed content.  Throws if there is none.
+  virtual std::uint64_t Remove(const NameType& name) = 0;
+  // Returns 'count' cursors which between them return every name in 'range' exactly once.  Each
+  // covers a separate part of the store, so they can be used concurrently.
+  virtual std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                         std::uint32_t count) const = 0;
+  // The cursor Names(range, count) returns at 'part', without opening the others.
+  virtual std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                                std::uint32_t count) const = 0;
+  // False if Names() can't return the names as they were passed to Write.
+  virtual bool ListsNames() const { return true; }
+  // False if the contents don't outlive the backend, in which case ChunkStore keeps no metadata on
+  // disk for it.
+  virtual bool Persistent() const { return true; }
+  // Makes every completed Write and Remove durable.
+  virtual void Sync() = 0;
+  // Called at startup with the names which were being written or removed when the previous session
+  // stopped, to clean up anything those operations left behind (e.g. temporary files).
+  virtual void DiscardIncompleteWrites(const std::vector<NameType>& /*names*/) {}
+  // Returns the order, as indices into 'names', in which to visit them to keep disk access local
+  // (for example, grouping names which share a directory).
+  virtual std::vector<std::size_t> LocalityOrder(const std::vector<NameType>& names) const {
+    std::vector<std::size_t> order(names.size());
+    std::iota(order.begin(), order.end(), 0);
+    return order;
+  }
+
+ private:
+  class BufferedWriter;
+};
+
+class ChunkStoreBackend::BufferedWriter : public ChunkStoreBackend::ContentWriter {
+ public:
+  BufferedWriter(ChunkStoreBackend& backend, const NameType& name)
+      : backend_(backend), kName_(name), content_() {}
+  void Append(const std::vector<byte>& piece) override {
+    content_.insert(content_.end(), piece.begin(), piece.end());
+  }
+  void Commit() override { backend_.Write(kName_, content_); }
+
+ private:
+  ChunkStoreBackend& backend_;
+  const NameType kName_;
+  std::vector<byte> content_;
+};
+
+inline std::unique_ptr<ChunkStoreBackend::ContentWriter> ChunkStoreBackend::OpenWriter(
+    const NameType& name) {
+  return std::unique_ptr<ContentWriter>(new BufferedWriter(*this, name));
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_BACKEND_H_
@@ -0,0 +1,177 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/chunk_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+const std::size_t kSketchDepth(4);
+const std::size_t kSketchWidth(1024);
+// Once this many requests have been counted, all counters are halved.
+const std::uint32_t kSketchSampleSize(10 * kSketchWidth);
+const std::uint8_t kMaxFrequency(15);
+const std::uint64_t kSketchSeeds[kSketchDepth] = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+                                                  0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL};
+
+}  // unnamed namespace
+
+ChunkCache::FrequencySketch::FrequencySketch()
+    : counters_(kSketchDepth * kSketchWidth, 0), additions_(0) {}
+
+void ChunkCache::FrequencySketch::Increment(std::size_t hash) {
+  for (std::size_t row(0); row != kSketchDepth; ++row) {
+    auto& counter(counters_[Index(hash, row)]);
+    if (counter < kMaxFrequency)
+      ++counter;
+  }
+  if (++additions_ == kSketchSampleSize) {
+    for (auto& counter : counters_)
+      counter /= 2;
+    additions_ /= 2;
+  }
+}
+
+std::uint32_t ChunkCache::FrequencySketch::Frequency(std::size_t hash) const {
+  std::uint8_t frequency(kMaxFrequency);
+  for (std::size_t row(0); row != kSketchDepth; ++row)
+    frequency = std::min(frequency, counters_[Index(hash, row)]);
+  return frequency;
+}
+
+std::size_t ChunkCache::FrequencySketch::Index(std::size_t hash, std::size_t row) const {
+  std::uint64_t mixed(static_cast<std::uint64_t>(hash) * kSketchSeeds[row]);
+  mixed ^= mixed >> 32;
+  return row * kSketchWidth + static_cast<std::size_t>(mixed % kSketchWidth);
+}
+
+ChunkCache::ChunkCache(std::uint64_t max_bytes)
+    : kMaxShardBytes_(max_bytes / std::tuple_size<decltype(shards_)>::value),
+      shards_(),
+      hits_(0),
+      misses_(0) {}
+
+ChunkCache::Value ChunkCache::Get(const NameType& name) {
+  if (kMaxShardBytes_ == 0)
+    return nullptr;
+  std::string key(Key(name));
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.sketch.Increment(std::hash<std::string>()(key));
+  auto itr(shard.index.find(key));
+  if (itr == shard.index.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  shard.entries.splice(shard.entries.begin(), shard.entries, itr->second);
+  return itr->second->second;
+}
+
+ChunkCache::Ticket ChunkCache::GetTicket(const NameType& name) {
+  if (kMaxShardBytes_ == 0)
+    return 0;
+  Shard& shard(GetShard(Key(name)));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.generation;
+}
+
+void ChunkCache::Insert(const NameType& name, Value value, Ticket ticket) {
+  if (kMaxShardBytes_ == 0)
+    return;
+  Shard::Entry entry(Key(name), std::move(value));
+  std::uint64_t cost(Cost(entry));
+  if (cost > kMaxShardBytes_)
+    return;
+  Shard& shard(GetShard(entry.first));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (ticket != shard.generation || shard.index.count(entry.first) != 0)
+    return;
+
+  // Work out which entries would need to be evicted, and only go ahead if the new one is more
+  // popular than each of them.
+  std::uint32_t frequency(shard.sketch.Frequency(std::hash<std::string>()(entry.first)));
+  std::uint64_t available(kMaxShardBytes_ - shard.size);
+  auto victim(shard.entries.end());
+  while (available < cost) {
+    --victim;
+    if (shard.sketch.Frequency(std::hash<std::string>()(victim->first)) >= frequency)
+      return;
+    available += Cost(*victim);
+  }
+  while (victim != shard.entries.end()) {
+    shard.size -= Cost(*victim);
+    shard.index.erase(victim->first);
+    victim = shard.entries.erase(victim);
+  }
+
+  shard.entries.push_front(std::move(entry));
+  shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+  shard.size += cost;
+}
+
+void ChunkCache::Invalidate(const NameType& name) {
+  if (kMaxShardBytes_ == 0)
+    return;
+  std::string key(Key(name));
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  ++shard.generation;
+  auto itr(shard.index.find(key));
+  if (itr == shard.index.end())
+    return;
+  shard.size -= Cost(*itr->second);
+  shard.entries.erase(itr->second);
+  shard.index.erase(itr);
+}
+
+std::uint64_t ChunkCache::Size() const {
+  std::uint64_t size(0);
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.size;
+  }
+  return size;
+}
+
+std::string ChunkCache::Key(const NameType& name) {
+  const auto& name_bytes(name.name.string());
+  std::string key(name_bytes.begin(), name_bytes.end());
+  key.append(reinterpret_cast<const char*>(&name.type_id.data), sizeof(name.type_id.data));
+  return key;
+}
+
+ChunkCache::Shard& ChunkCache::GetShard(const std::string& key) {
+  // Names are hashes, so their first byte is already evenly distributed.
+  return shards_[static_cast<unsigned char>(key[0]) % shards_.size()];
+}
+
+std::uint64_t ChunkCache::Cost(const Shard::Entry& entry) {
+  return entry.first.size() + entry.second->string().size();
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,116 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CACHE_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// A byte-bounded cache of decrypted chunk contents, split into independently locked shards.
+//
+// Each shard is an LRU list guarded by a TinyLFU admission filter: a count-min sketch of how often
+// each name has recently been requested.  When a new entry would evict others, it is only admitted
+// if it has been requested more often than the entries it would replace.  So a one-off scan over
+// many names can't flush out the popular ones.  The sketch's counters are halved periodically, so
+// that the popularity it records decays.
+//
+// To stop a reader caching content which has been replaced while it was decrypting, readers take a
+// Ticket before reading from disk and Insert only succeeds if no Invalidate on the same shard has
+// happened since.
+//
+// Values are held by shared pointer, so a hit hands out the cached value without copying it.
+class ChunkCache {
+ public:
+  using NameType = Data::NameAndTypeId;
+  using Ticket = std::uint64_t;
+  using Value = std::shared_ptr<const NonEmptyString>;
+
+  // A 'max_bytes' of 0 disables the cache.
+  explicit ChunkCache(std::uint64_t max_bytes);
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache(ChunkCache&&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+  ChunkCache& operator=(ChunkCache&&) = delete;
+
+  // Counts as a hit or miss, and as a request for the admission filter.  Returns null on a miss.
+  Value Get(const NameType& name);
+  Ticket GetTicket(const NameType& name);
+  void Insert(const NameType& name, Value value, Ticket ticket);
+  void Invalidate(const NameType& name);
+
+  bool Enabled() const { return kMaxShardBytes_ != 0; }
+  std::uint64_t Hits() const { return hits_; }
+  std::uint64_t Misses() const { return misses_; }
+  std::uint64_t Size() const;
+
+ private:
+  class FrequencySketch {
+   public:
+    FrequencySketch();
+    void Increment(std::size_t hash);
+    std::uint32_t Frequency(std::size_t hash) const;
+
+   private:
+    std::size_t Index(std::size_t hash, std::size_t row) const;
+
+    std::vector<std::uint8_t> counters_;
+    std::uint32_t additions_;
+  };
+
+  struct Shard {
+    using Entry = std::pair<std::string, Value>;
+    Shard() : mutex(), entries(), index(), size(0), generation(0), sketch() {}
+    mutable std::mutex mutex;
+    // Most recently used at the front.
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::uint64_t size;
+    Ticket generation;
+    FrequencySketch sketch;
+  };
+
+  static std::string Key(const NameType& name);
+  Shard& GetShard(const std::string& key);
+  static std::uint64_t Cost(const Shard::Entry& entry);
+
+  const std::uint64_t kMaxShardBytes_;
+  std::array<Shard, 16> shards_;
+  std::atomic<std::uint64_t> hits_, misses_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CACHE_H_
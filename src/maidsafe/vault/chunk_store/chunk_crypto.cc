@@ -0,0 +1,148 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/chunk_crypto.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/data_types/immutable_data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+crypto::AES256KeyAndIV BlockKeyAndIv(const Data::NameAndTypeId& name, std::uint64_t index,
+                                     bool last_block) {
+  if (index == 0 && last_block)
+    return ChunkKeyAndIv(name);
+  const auto& name_str(name.name.string());
+  std::vector<byte> seed(name_str.begin(), name_str.end());
+  for (std::size_t i(0); i != sizeof(index); ++i)
+    seed.push_back(static_cast<byte>(index >> (8 * i)));
+  seed.push_back(last_block ? 1 : 0);
+  std::vector<byte> key_and_iv(name_str.begin(), name_str.begin() + crypto::AES256_KeySize);
+  const crypto::SHA512Hash kIvHash(crypto::Hash<crypto::SHA512>(seed));
+  key_and_iv.insert(key_and_iv.end(), kIvHash.string().begin(),
+                    kIvHash.string().begin() + crypto::AES256_IVSize);
+  return crypto::AES256KeyAndIV(key_and_iv);
+}
+
+std::uint64_t SealedBlockSize() { return kChunkBlockSize + ChunkBlockOverhead(); }
+
+}  // unnamed namespace
+
+crypto::AES256KeyAndIV ChunkKeyAndIv(const Data::NameAndTypeId& name) {
+  const auto& name_str(name.name.string());
+  return crypto::AES256KeyAndIV(std::vector<byte>(
+      name_str.begin(), name_str.begin() + crypto::AES256_KeySize + crypto::AES256_IVSize));
+}
+
+std::uint64_t ChunkBlockOverhead() {
+  static const std::uint64_t kOverhead(
+      crypto::SymmEncrypt(NonEmptyString(std::vector<byte>(1, 0)),
+                          crypto::AES256KeyAndIV(std::vector<byte>(
+                              crypto::AES256_KeySize + crypto::AES256_IVSize, 0)))
+          .data.string()
+          .size() -
+      1);
+  return kOverhead;
+}
+
+std::vector<byte> EncryptChunk(const Data::NameAndTypeId& name, const NonEmptyString& value) {
+  const auto& plain(value.string());
+  if (plain.size() <= kChunkBlockSize)
+    return crypto::SymmEncrypt(value, ChunkKeyAndIv(name)).data.string();
+  std::vector<byte> content;
+  content.reserve(plain.size() + (plain.size() / kChunkBlockSize + 1) * ChunkBlockOverhead());
+  for (std::uint64_t offset(0), index(0); offset < plain.size(); offset += kChunkBlockSize) {
+    std::vector<byte> block(plain.begin() + offset,
+                            plain.begin() + std::min<std::uint64_t>(offset + kChunkBlockSize,
+                                                                    plain.size()));
+    auto sealed(EncryptChunkBlock(name, index++, block, offset + kChunkBlockSize >= plain.size()));
+    content.insert(content.end(), sealed.begin(), sealed.end());
+  }
+  return content;
+}
+
+NonEmptyString DecryptChunk(const Data::NameAndTypeId& name, std::vector<byte>&& content) {
+  if (content.size() > SealedBlockSize()) {
+    try {
+      return NonEmptyString(DecryptChunkBlocks(name, 0, content, true));
+    } catch (const maidsafe_error&) {
+      // Written as a single block by an earlier version.
+    }
+  }
+  try {
+    return crypto::SymmDecrypt(crypto::CipherText(NonEmptyString(std::move(content))),
+                               ChunkKeyAndIv(name));
+  } catch (const std::exception&) {
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+}
+
+std::vector<byte> EncryptChunkBlock(const Data::NameAndTypeId& name, std::uint64_t index,
+                                    const std::vector<byte>& block, bool last_block) {
+  return crypto::SymmEncrypt(NonEmptyString(block), BlockKeyAndIv(name, index, last_block))
+      .data.string();
+}
+
+ChunkBlockSpan ChunkBlockSpanFor(std::uint64_t offset, std::uint64_t length) {
+  const std::uint64_t kFirst(offset / kChunkBlockSize),
+      kLast((offset + std::max<std::uint64_t>(length, 1) - 1) / kChunkBlockSize);
+  return ChunkBlockSpan{kFirst, kFirst * SealedBlockSize(),
+                        (kLast - kFirst + 1) * SealedBlockSize()};
+}
+
+std::vector<byte> DecryptChunkBlocks(const Data::NameAndTypeId& name, std::uint64_t first_block,
+                                     const std::vector<byte>& content, bool ends_value) {
+  std::vector<byte> value;
+  value.reserve(content.size());
+  std::uint64_t index(first_block);
+  for (std::uint64_t offset(0); offset < content.size(); offset += SealedBlockSize(), ++index) {
+    std::vector<byte> sealed(content.begin() + offset,
+                             content.begin() + std::min<std::uint64_t>(
+                                                   offset + SealedBlockSize(), content.size()));
+    const bool kLastBlock(ends_value && offset + SealedBlockSize() >= content.size());
+    try {
+      auto block(crypto::SymmDecrypt(crypto::CipherText(NonEmptyString(std::move(sealed))),
+                                     BlockKeyAndIv(name, index, kLastBlock)));
+      value.insert(value.end(), block.string().begin(), block.string().end());
+    } catch (const std::exception&) {
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    }
+  }
+  return value;
+}
+
+bool VerifyChunk(const Data::NameAndTypeId& name, std::vector<byte> content) {
+  try {
+    NonEmptyString value(DecryptChunk(name, std::move(content)));
+    return name.type_id != detail::TypeId<ImmutableData>::value ||
+           crypto::Hash<crypto::SHA512>(value).string() == name.name.string();
+  } catch (const maidsafe_error&) {
+    return false;
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,79 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CRYPTO_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CRYPTO_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// ChunkStore encrypts each chunk with an AES-256 key and IV taken from the chunk's name.  These
+// touch no shared state, so can be run on any thread.
+//
+// Values are split into blocks of kChunkBlockSize, each encrypted separately, so that any range
+// of a value can be decrypted without the rest of it.  Each block's IV is hashed from the name,
+// the block's index and whether it's the value's last block, so content cut short at a block
+// boundary doesn't decrypt.  The one exception is a value which fits in one block: it uses the key
+// and IV taken from the name, so is encrypted exactly as in the whole-value format of earlier
+// versions.  DecryptChunk still reads larger chunks written in that format.
+
+const std::uint64_t kChunkBlockSize = 64 * 1024;
+
+crypto::AES256KeyAndIV ChunkKeyAndIv(const Data::NameAndTypeId& name);
+
+// The bytes added by encrypting each block.
+std::uint64_t ChunkBlockOverhead();
+
+std::vector<byte> EncryptChunk(const Data::NameAndTypeId& name, const NonEmptyString& value);
+
+// Takes the content by rvalue so that it's moved, not copied, into the cipher text.  Throws
+// no_such_element if the content doesn't decrypt.
+NonEmptyString DecryptChunk(const Data::NameAndTypeId& name, std::vector<byte>&& content);
+
+// Encrypts block 'index' of a value, which must be kChunkBlockSize long unless it's the last.
+std::vector<byte> EncryptChunkBlock(const Data::NameAndTypeId& name, std::uint64_t index,
+                                    const std::vector<byte>& block, bool last_block);
+
+// The part of a chunk's content to read for the value's bytes from 'offset' for 'length'.
+struct ChunkBlockSpan {
+  std::uint64_t first_block, content_offset, content_length;
+};
+ChunkBlockSpan ChunkBlockSpanFor(std::uint64_t offset, std::uint64_t length);
+
+// Decrypts consecutive blocks read from a chunk's content, starting with block 'first_block'.
+// 'ends_value' says whether they run to the end of the content.  Throws no_such_element if they
+// don't decrypt.
+std::vector<byte> DecryptChunkBlocks(const Data::NameAndTypeId& name, std::uint64_t first_block,
+                                     const std::vector<byte>& content, bool ends_value);
+
+// True if the content decrypts and, for immutable data, the value's SHA-512 hash is its name.
+bool VerifyChunk(const Data::NameAndTypeId& name, std::vector<byte> content);
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_CHUNK_CRYPTO_H_
@@ -0,0 +1,1003 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/file_per_chunk_backend.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <future>
+#include <limits>
+#include <utility>
+
+#include "boost/filesystem/convenience.hpp"
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Entries starting with '.' hold ChunkStore's own bookkeeping, never chunks.
+bool IsMetadata(const fs::path& path) { return path.filename().string()[0] == '.'; }
+
+// Chunks are written to a hidden file alongside, then renamed into place.  ChunkStore never writes
+// the same name concurrently, so one temporary file per chunk is enough.
+fs::path TempPath(const fs::path& file) {
+  return file.parent_path() / ('.' + file.filename().string() + ".tmp");
+}
+
+struct UsedSpace {
+  UsedSpace() : directories(), disk_usage(0) {}
+  UsedSpace(UsedSpace&& other)
+      : directories(std::move(other.directories)), disk_usage(std::move(other.disk_usage)) {}
+
+  std::vector<fs::path> directories;
+  DiskUsage disk_usage;
+};
+
+UsedSpace GetUsedSpace(fs::path directory) {
+  UsedSpace used_space;
+  try {
+    for (fs::directory_iterator it(directory); it != fs::directory_iterator(); ++it) {
+      if (IsMetadata(it->path()))
+        continue;
+      if (fs::is_directory(*it))
+        used_space.directories.push_back(it->path());
+      else
+        used_space.disk_usage.data += fs::file_size(*it);
+    }
+  } catch (const std::exception& e) {
+    LOG(kError) << "GetUsedSpace when handling " << directory
+                << " caught an error : " << boost::diagnostic_information(e);
+    throw;
+  }
+  return used_space;
+}
+
+// One bit per directory at the deepest level of a fan-out of 'depth' levels.
+std::unique_ptr<std::atomic<std::uint64_t>[]> NewDirectoryBits(std::uint32_t depth) {
+  if (depth == 0 || depth > FilePerChunkBackend::kMaxDepth) {
+    LOG(kError) << "Invalid fan-out depth " << depth;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  const std::uint32_t kWords(std::max((std::uint32_t(1) << (4 * depth)) / 64, std::uint32_t(1)));
+  std::unique_ptr<std::atomic<std::uint64_t>[]> bits(new std::atomic<std::uint64_t>[kWords]);
+  for (std::uint32_t i(0); i != kWords; ++i)
+    bits[i] = 0;
+  return bits;
+}
+
+// Under the disk path, holds the files being streamed to by OpenWriter's writers.
+const char kStreamDirName[] = ".streams";
+
+std::atomic<std::uint64_t> next_instance_id(1);
+
+// Sync syncs this many files or directories at once, so that the filesystem can commit them
+// together.
+const std::size_t kSyncThreadCount(16);
+
+// Runs 'sync' on each of 'paths', kSyncThreadCount at a time, and returns those it failed on.
+template <typename SyncFunctor>
+std::set<fs::path> SyncAll(const std::set<fs::path>& paths, SyncFunctor sync) {
+  const std::vector<fs::path> kPaths(paths.begin(), paths.end());
+  const std::size_t kThreadCount(std::min(kSyncThreadCount, kPaths.size()));
+  std::vector<std::future<std::set<fs::path>>> threads;
+  for (std::size_t thread(0); thread != kThreadCount; ++thread) {
+    threads.push_back(std::async(std::launch::async, [&, thread] {
+      std::set<fs::path> failed;
+      for (std::size_t i(thread); i < kPaths.size(); i += kThreadCount) {
+        if (!sync(kPaths[i])) {
+          LOG(kError) << "Failed to sync " << kPaths[i];
+          failed.insert(kPaths[i]);
+        }
+      }
+      return failed;
+    }));
+  }
+  std::set<fs::path> failed;
+  for (auto& thread : threads) {
+    auto thread_failed(thread.get());
+    failed.insert(thread_failed.begin(), thread_failed.end());
+  }
+  return failed;
+}
+
+}  // unnamed namespace
+
+// Makes every call on chunk files and their directories, so that IoCounts counts the system calls
+// actually made rather than the operations making them.  Failures are reported as error codes,
+// as boost::filesystem's non-throwing calls do.
+class FilePerChunkBackend::Filesystem {
+ public:
+  Filesystem()
+      : opens_(0), stats_(0), removes_(0), renames_(0), links_(0), directory_creations_(0),
+        syncs_(0) {}
+
+  IoCounts Counts() const {
+    IoCounts io_counts = {opens_, stats_, removes_, renames_, links_, directory_creations_, syncs_};
+    return io_counts;
+  }
+
+  // Returns boost::none if the file doesn't exist.
+  boost::optional<std::uint64_t> FileSize(const fs::path& path) {
+    ++stats_;
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0)
+      return static_cast<std::uint64_t>(status.st_size);
+    auto error_code(LastError());
+    if (error_code == boost::system::errc::no_such_file_or_directory)
+      return boost::none;
+    LOG(kError) << "Error getting file size of " << path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+
+  bool Exists(const fs::path& path) {
+    ++stats_;
+    struct stat status;
+    return stat(path.c_str(), &status) == 0;
+  }
+
+  // Reads up to 'length' bytes from 'offset'; fewer if the file ends first.  Returns boost::none
+  // if the file can't be opened or read.
+  boost::optional<std::vector<byte>> ReadFile(const fs::path& path, std::uint64_t offset,
+                                              std::uint64_t length) {
+    int fd(Open(path, O_RDONLY));
+    if (fd < 0)
+      return boost::none;
+    // Read until the end rather than sized with fstat first, to keep to one call per read.
+    const std::size_t kReadSize(64 * 1024);
+    std::vector<byte> content;
+    bool failed(false);
+    while (content.size() < length) {
+      const std::size_t kSize(content.size());
+      content.resize(kSize + static_cast<std::size_t>(std::min<std::uint64_t>(kReadSize,
+                                                                              length - kSize)));
+      auto result(pread(fd, content.data() + kSize, content.size() - kSize,
+                        static_cast<off_t>(offset + kSize)));
+      if (result <= 0) {
+        failed = (result < 0);
+        content.resize(kSize);
+        break;
+      }
+      content.resize(kSize + static_cast<std::size_t>(result));
+    }
+    close(fd);
+    if (failed) {
+      LOG(kError) << "Failed to read " << path;
+      return boost::none;
+    }
+    return content;
+  }
+
+  // Writes 'content' to 'path', syncing it before returning if 'synced' is set, so that once the
+  // file is renamed over a chunk, a power loss can't leave the chunk empty or torn.
+  bool WriteFile(const fs::path& path, const std::vector<byte>& content, bool synced) {
+    int fd(Open(path, O_WRONLY | O_CREAT | O_TRUNC));
+    if (fd < 0)
+      return false;
+    bool written(Write(fd, content) && (!synced || Sync(fd)));
+    return close(fd) == 0 && written;
+  }
+
+  // Syncs a file written earlier.  A file which has since been removed needs nothing.
+  bool SyncFile(const fs::path& path) {
+    int fd(Open(path, O_RDONLY));
+    if (fd < 0)
+      return errno == ENOENT;
+    bool synced(Sync(fd));
+    close(fd);
+    return synced;
+  }
+
+  int Open(const fs::path& path, int flags) {
+    ++opens_;
+    return open(path.c_str(), flags, 0666);
+  }
+
+  bool Write(int fd, const std::vector<byte>& content) {
+    const byte* data(content.data());
+    std::size_t remaining(content.size());
+    while (remaining != 0) {
+      auto written(write(fd, data, remaining));
+      if (written <= 0)
+        return false;
+      data += written;
+      remaining -= static_cast<std::size_t>(written);
+    }
+    return true;
+  }
+
+  bool Sync(int fd) {
+    ++syncs_;
+#ifdef __APPLE__
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+  }
+
+  // Syncs a directory, so that renames into it are durable.
+  bool SyncDirectory(const fs::path& directory) {
+    int fd(Open(directory, O_RDONLY | O_DIRECTORY));
+    if (fd < 0)
+      return false;
+    ++syncs_;
+    bool synced(fsync(fd) == 0);
+    close(fd);
+    return synced;
+  }
+
+  // Returns whether there was a file to remove.
+  bool Remove(const fs::path& path, boost::system::error_code& error_code) {
+    ++removes_;
+    error_code = unlink(path.c_str()) == 0 ? boost::system::error_code() : LastError();
+    if (error_code == boost::system::errc::no_such_file_or_directory) {
+      error_code.clear();
+      return false;
+    }
+    return !error_code;
+  }
+
+  void Rename(const fs::path& from, const fs::path& to, boost::system::error_code& error_code) {
+    ++renames_;
+    error_code = rename(from.c_str(), to.c_str()) == 0 ? boost::system::error_code() : LastError();
+  }
+
+  void CreateHardLink(const fs::path& from, const fs::path& to,
+                      boost::system::error_code& error_code) {
+    ++links_;
+    error_code = link(from.c_str(), to.c_str()) == 0 ? boost::system::error_code() : LastError();
+  }
+
+  // Creates 'directory' and any parents missing, trying the deepest first.
+  void CreateDirectories(const fs::path& directory, boost::system::error_code& error_code) {
+    if (MakeDirectory(directory, error_code) ||
+        error_code != boost::system::errc::no_such_file_or_directory ||
+        !directory.has_parent_path()) {
+      return;
+    }
+    CreateDirectories(directory.parent_path(), error_code);
+    if (!error_code)
+      MakeDirectory(directory, error_code);
+  }
+
+ private:
+  static boost::system::error_code LastError() {
+    return boost::system::error_code(errno, boost::system::system_category());
+  }
+
+  // Returns whether the directory now exists.
+  bool MakeDirectory(const fs::path& directory, boost::system::error_code& error_code) {
+    ++directory_creations_;
+    error_code = mkdir(directory.c_str(), 0777) == 0 ? boost::system::error_code() : LastError();
+    if (error_code == boost::system::errc::file_exists)
+      error_code.clear();
+    return !error_code;
+  }
+
+  std::atomic<std::uint64_t> opens_, stats_, removes_, renames_, links_, directory_creations_,
+      syncs_;
+};
+
+const std::uint32_t FilePerChunkBackend::kDefaultDepth;
+const std::uint32_t FilePerChunkBackend::kMaxDepth;
+const std::uint32_t FilePerChunkBackend::kChunksPerDirectory;
+const std::uint32_t FilePerChunkBackend::kSampleInterval;
+const std::uint32_t FilePerChunkBackend::kMigrationThreshold;
+
+// Counts an operation in progress on the chunk files, so that the layout can't change under it.
+// Operations never hold more than one at a time.
+class FilePerChunkBackend::LayoutGuard {
+ public:
+  explicit LayoutGuard(const FilePerChunkBackend& backend) : backend_(backend) {
+    for (;;) {
+      ++backend_.operations_in_flight_;
+      if (!backend_.switching_layout_)
+        return;
+      --backend_.operations_in_flight_;
+      while (backend_.switching_layout_)
+        std::this_thread::yield();
+    }
+  }
+  ~LayoutGuard() { --backend_.operations_in_flight_; }
+  LayoutGuard(const LayoutGuard&) = delete;
+  LayoutGuard& operator=(const LayoutGuard&) = delete;
+
+ private:
+  const FilePerChunkBackend& backend_;
+};
+
+std::uint32_t FilePerChunkBackend::DepthFor(std::uint64_t expected_chunk_count) {
+  std::uint32_t depth(1);
+  while (depth < kMaxDepth &&
+         (std::uint64_t(kChunksPerDirectory) << (4 * depth)) < expected_chunk_count) {
+    ++depth;
+  }
+  return depth;
+}
+
+FilePerChunkBackend::FilePerChunkBackend(fs::path disk_path, bool hashed_file_names,
+                                         std::uint32_t depth, std::uint32_t migrating_from,
+                                         LayoutRecorder record_layout)
+    : kDiskPath_(std::move(disk_path)),
+      kHashedFileNames_(hashed_file_names),
+      kInstanceId_(next_instance_id++),
+      kRecordLayout_(std::move(record_layout)),
+      depth_(depth),
+      migrating_from_(migrating_from),
+      existing_directories_(NewDirectoryBits(depth)),
+      filesystem_(new Filesystem),
+      next_stream_id_(0),
+      writes_(0),
+      sync_mutex_(),
+      unsynced_mutex_(),
+      unsynced_files_(),
+      unsynced_directories_(),
+      operations_in_flight_(0),
+      switching_layout_(false),
+      migration_mutex_(),
+      migration_condition_(),
+      open_cursors_(0),
+      migration_running_(false),
+      stop_migration_(false),
+      migration_thread_() {
+  if (migrating_from >= depth) {
+    LOG(kError) << "Can't migrate from a fan-out depth of " << migrating_from << " to " << depth;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  boost::system::error_code error_code;
+  fs::remove_all(kDiskPath_ / kStreamDirName, error_code);
+  if (migrating_from != 0) {
+    migration_running_ = true;
+    migration_thread_ = std::thread([this] { RunMigration(0); });
+  }
+}
+
+FilePerChunkBackend::~FilePerChunkBackend() {
+  {
+    std::lock_guard<std::mutex> lock(migration_mutex_);
+    stop_migration_ = true;
+  }
+  migration_condition_.notify_all();
+  if (migration_thread_.joinable())
+    migration_thread_.join();
+}
+
+std::uint64_t FilePerChunkBackend::ScanUsage() const {
+  DiskUsage disk_usage(0);
+  std::vector<fs::path> dirs_to_do;
+  dirs_to_do.push_back(kDiskPath_);
+  while (!dirs_to_do.empty()) {
+    std::vector<std::future<UsedSpace>> futures;
+    for (std::uint32_t i = 0; i < 16 && !dirs_to_do.empty(); ++i) {
+      auto temp_copy(dirs_to_do.back());
+      auto future = std::async(&GetUsedSpace, temp_copy);
+      dirs_to_do.pop_back();
+      futures.push_back(std::move(future));
+    }
+    try {
+      while (!futures.empty()) {
+        auto future = std::move(futures.back());
+        futures.pop_back();
+        UsedSpace result = future.get();
+        disk_usage.data += result.disk_usage.data;
+        std::move(result.directories.begin(), result.directories.end(),
+                  std::back_inserter(dirs_to_do));
+      }
+    } catch (const std::system_error& exception) {
+      LOG(kError) << boost::diagnostic_information(exception);
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    } catch (...) {
+      LOG(kError) << "exception during ScanUsage";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+    }
+  }
+  return disk_usage.data;
+}
+
+template <typename Attempt>
+auto FilePerChunkBackend::FindFile(const NameType& name, Attempt attempt) const
+    -> decltype(attempt(ChunkPath())) {
+  auto result(attempt(Locate(name)));
+  const std::uint32_t kMigratingFrom(migrating_from_);
+  if (result || kMigratingFrom == 0)
+    return result;
+  result = attempt(LocateAt(name, kMigratingFrom));
+  if (result)
+    return result;
+  return attempt(Locate(name));
+}
+
+std::uint64_t FilePerChunkBackend::Size(const NameType& name) const {
+  LayoutGuard guard(*this);
+  auto file_size(FindFile(name, [this](const ChunkPath& chunk_path) {
+    return filesystem_->FileSize(chunk_path.file);
+  }));
+  return file_size ? *file_size : 0;
+}
+
+void FilePerChunkBackend::Write(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, true);
+}
+
+void FilePerChunkBackend::WriteUnsynced(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, false);
+}
+
+void FilePerChunkBackend::Write(const NameType& name, const std::vector<byte>& content,
+                                bool synced) {
+  LayoutGuard guard(*this);
+  const auto& chunk_path(Locate(name));
+  fs::path temp_path(TempPath(chunk_path.file));
+  EnsureDirectory(chunk_path, false);
+  if (!filesystem_->WriteFile(temp_path, content, synced)) {
+    // The directory may have been removed since it was recorded as existing.
+    EnsureDirectory(chunk_path, true);
+    if (!filesystem_->WriteFile(temp_path, content, synced)) {
+      LOG(kError) << "Failed to write " << name.name << " to disk.";
+      boost::system::error_code error_code;
+      filesystem_->Remove(temp_path, error_code);
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+  boost::system::error_code error_code;
+  filesystem_->Rename(temp_path, chunk_path.file, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    filesystem_->Remove(temp_path, error_code);
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  // Until then, a power loss could undo the rename even though the caller has logged it as done.
+  if (!synced) {
+    AddUnsynced(chunk_path.file, chunk_path.directory);
+  } else if (!filesystem_->SyncDirectory(chunk_path.directory)) {
+    LOG(kError) << "Failed to sync " << chunk_path.file.parent_path();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  RemoveMigratedFrom(name);
+  SampleDirectory(chunk_path);
+}
+
+boost::optional<std::vector<byte>> FilePerChunkBackend::Read(const NameType& name) const {
+  LayoutGuard guard(*this);
+  return FindFile(name, [this](const ChunkPath& chunk_path) {
+    return filesystem_->ReadFile(chunk_path.file, 0, std::numeric_limits<std::uint64_t>::max());
+  });
+}
+
+boost::optional<std::vector<byte>> FilePerChunkBackend::ReadRange(const NameType& name,
+                                                                  std::uint64_t offset,
+                                                                  std::uint64_t length) const {
+  LayoutGuard guard(*this);
+  return FindFile(name, [&](const ChunkPath& chunk_path) {
+    return filesystem_->ReadFile(chunk_path.file, offset, length);
+  });
+}
+
+class FilePerChunkBackend::StreamWriter : public ChunkStoreBackend::ContentWriter {
+ public:
+  StreamWriter(FilePerChunkBackend& backend, const NameType& name, fs::path temp_path)
+      : backend_(backend),
+        kName_(name),
+        kTempPath_(std::move(temp_path)),
+        fd_(-1),
+        committed_(false) {
+    boost::system::error_code error_code;
+    backend_.filesystem_->CreateDirectories(kTempPath_.parent_path(), error_code);
+    fd_ = backend_.filesystem_->Open(kTempPath_, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd_ < 0) {
+      LOG(kError) << "Failed to open " << kTempPath_;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+
+  ~StreamWriter() override {
+    if (fd_ >= 0)
+      close(fd_);
+    if (committed_)
+      return;
+    boost::system::error_code error_code;
+    backend_.filesystem_->Remove(kTempPath_, error_code);
+  }
+
+  void Append(const std::vector<byte>& piece) override {
+    if (!backend_.filesystem_->Write(fd_, piece)) {
+      LOG(kError) << "Failed writing " << kTempPath_;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+
+  void Commit() override {
+    bool synced(backend_.filesystem_->Sync(fd_));
+    bool closed(close(fd_) == 0);
+    fd_ = -1;
+    if (!synced || !closed) {
+      LOG(kError) << "Failed writing " << kTempPath_;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    LayoutGuard guard(backend_);
+    const auto& chunk_path(backend_.Locate(kName_));
+    backend_.EnsureDirectory(chunk_path, false);
+    boost::system::error_code error_code;
+    backend_.filesystem_->Rename(kTempPath_, chunk_path.file, error_code);
+    if (error_code) {
+      // The directory may have been removed since it was recorded as existing.
+      backend_.EnsureDirectory(chunk_path, true);
+      backend_.filesystem_->Rename(kTempPath_, chunk_path.file, error_code);
+    }
+    if (error_code) {
+      LOG(kError) << "Failed to rename " << kTempPath_ << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    committed_ = true;
+    if (!backend_.filesystem_->SyncDirectory(chunk_path.directory)) {
+      LOG(kError) << "Failed to sync " << chunk_path.file.parent_path();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    backend_.RemoveMigratedFrom(kName_);
+    backend_.SampleDirectory(chunk_path);
+  }
+
+ private:
+  FilePerChunkBackend& backend_;
+  const NameType kName_;
+  const fs::path kTempPath_;
+  int fd_;
+  bool committed_;
+};
+
+std::unique_ptr<ChunkStoreBackend::ContentWriter> FilePerChunkBackend::OpenWriter(
+    const NameType& name) {
+  return std::unique_ptr<ContentWriter>(new StreamWriter(
+      *this, name, kDiskPath_ / kStreamDirName / std::to_string(next_stream_id_++)));
+}
+
+std::uint64_t FilePerChunkBackend::Remove(const NameType& name) {
+  LayoutGuard guard(*this);
+  auto file_size(FindFile(name, [this](const ChunkPath& chunk_path) {
+    return filesystem_->FileSize(chunk_path.file);
+  }));
+  const auto& chunk_path(Locate(name));
+  const auto& path(chunk_path.file);
+  if (!file_size) {
+    LOG(kError) << "Error getting file size of " << path << ": no such file";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  // The old layout's file goes first, so that a migration can't move it back in afterwards.
+  const bool kMigrating(migrating_from_ != 0);
+  RemoveMigratedFrom(name);
+  boost::system::error_code error_code;
+  bool removed(filesystem_->Remove(path, error_code));
+  if (error_code || (!removed && !kMigrating)) {
+    LOG(kError) << "Error removing " << path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  AddUnsynced(fs::path(), chunk_path.directory);
+  return *file_size;
+}
+
+// Walks the fan-out depth first, skipping any directories outside the cursor's share of the
+// deepest level.  During a migration, the new layout is walked and then the old one.
+class FilePerChunkBackend::Cursor : public ChunkStoreBackend::NameCursor {
+ public:
+  Cursor(const FilePerChunkBackend& backend, NameRange range, std::uint32_t depth,
+         std::uint32_t migrating_from, std::uint32_t part, std::uint32_t part_count)
+      : backend_(backend),
+        kRange_(std::move(range)),
+        kDepth_(depth),
+        kPart_(part),
+        kPartCount_(part_count),
+        depths_(),
+        walk_depth_(0),
+        first_index_(0),
+        end_index_(0),
+        directories_() {
+    if (migrating_from != 0)
+      depths_.push_back(migrating_from);
+    depths_.push_back(depth);
+  }
+
+  ~Cursor() override { backend_.CursorClosed(); }
+
+  boost::optional<NameType> Next() override {
+    while (!directories_.empty() || StartWalk()) {
+      Directory& current(directories_.back());
+      if (current.itr == fs::directory_iterator()) {
+        directories_.pop_back();
+        continue;
+      }
+      fs::path path(current.itr->path());
+      ++current.itr;
+      std::string file_name(path.filename().string());
+      if (directories_.size() <= walk_depth_) {
+        if (file_name.size() != 1 || !std::isxdigit(static_cast<unsigned char>(file_name[0])) ||
+            !fs::is_directory(path)) {
+          continue;
+        }
+        std::uint32_t index(current.index << 4 |
+                            static_cast<std::uint32_t>(std::stoul(file_name, nullptr, 16)));
+        const std::uint32_t kShift(4 * (walk_depth_ - static_cast<std::uint32_t>(
+                                                          directories_.size())));
+        if ((index + 1) << kShift <= first_index_ || index << kShift >= end_index_)
+          continue;
+        directories_.push_back(Directory(path, current.prefix + file_name, index));
+        continue;
+      }
+      // Single characters are the new layout's directories, below the old layout's.
+      if (file_name.size() == 1 || IsMetadata(path))
+        continue;
+      NameType name(backend_.kHashedFileNames_
+                        ? backend_.ComposeName(current.prefix + file_name)
+                        : detail::GetDataNameAndTypeId(path));
+      if (!kRange_.Contains(name.name))
+        continue;
+      if (walk_depth_ != kDepth_) {
+        // Skips a file linked into the new layout by a move which was interrupted by a restart.
+        auto chunk_path(backend_.kHashedFileNames_
+                            ? backend_.PathAt(current.prefix + file_name, std::string(), kDepth_)
+                            : backend_.LocateAt(name, kDepth_));
+        if (backend_.filesystem_->Exists(chunk_path.file))
+          continue;
+      }
+      return name;
+    }
+    return boost::none;
+  }
+
+ private:
+  struct Directory {
+    Directory(const fs::path& path, std::string prefix_in, std::uint32_t index_in)
+        : itr(path), prefix(std::move(prefix_in)), index(index_in) {}
+    fs::directory_iterator itr;
+    // The hex characters of the directories above, and their value.
+    std::string prefix;
+    std::uint32_t index;
+  };
+
+  // Starts walking the next layout, returning false once there are none left.
+  bool StartWalk() {
+    while (!depths_.empty()) {
+      walk_depth_ = depths_.back();
+      depths_.pop_back();
+      const std::uint64_t kDirectoryCount(std::uint64_t(1) << (4 * walk_depth_));
+      first_index_ = static_cast<std::uint32_t>(kPart_ * kDirectoryCount / kPartCount_);
+      end_index_ = static_cast<std::uint32_t>((kPart_ + 1) * kDirectoryCount / kPartCount_);
+      boost::system::error_code error_code;
+      if (first_index_ != end_index_ && fs::is_directory(backend_.kDiskPath_, error_code)) {
+        directories_.push_back(Directory(backend_.kDiskPath_, std::string(), 0));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const FilePerChunkBackend& backend_;
+  const NameRange kRange_;
+  const std::uint32_t kDepth_;
+  const std::uint64_t kPart_, kPartCount_;
+  // The depths still to walk, last first.
+  std::vector<std::uint32_t> depths_;
+  std::uint32_t walk_depth_, first_index_, end_index_;
+  std::vector<Directory> directories_;
+};
+
+std::vector<std::unique_ptr<ChunkStoreBackend::NameCursor>> FilePerChunkBackend::Names(
+    const NameRange& range, std::uint32_t count) const {
+  LayoutGuard guard(*this);
+  std::lock_guard<std::mutex> lock(migration_mutex_);
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (std::uint32_t i(0); i != count; ++i) {
+    cursors.emplace_back(new Cursor(*this, range, depth_, migrating_from_, i, count));
+    ++open_cursors_;
+  }
+  return cursors;
+}
+
+std::unique_ptr<ChunkStoreBackend::NameCursor> FilePerChunkBackend::NamesPart(
+    const NameRange& range, std::uint32_t part, std::uint32_t count) const {
+  LayoutGuard guard(*this);
+  std::lock_guard<std::mutex> lock(migration_mutex_);
+  std::unique_ptr<NameCursor> cursor(
+      new Cursor(*this, range, depth_, migrating_from_, part, count));
+  ++open_cursors_;
+  return cursor;
+}
+
+FilePerChunkBackend::NameType FilePerChunkBackend::ComposeName(std::string file_name_str) const {
+  size_t index(file_name_str.rfind('_'));
+  auto type(static_cast<DataTypeId>(std::stoul(file_name_str.substr(index + 1))));
+  Identity id(hex::DecodeToBytes(file_name_str.substr(0, index)));
+  return NameType(id, type);
+}
+
+void FilePerChunkBackend::Sync() {
+  std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+  std::set<fs::path> files, directories;
+  {
+    std::lock_guard<std::mutex> lock(unsynced_mutex_);
+    files.swap(unsynced_files_);
+    directories.swap(unsynced_directories_);
+  }
+  // Anything which fails to sync is kept for the next Sync.
+  auto failed_files(SyncAll(files, [this](const fs::path& file) {
+    return filesystem_->SyncFile(file);
+  }));
+  // Then each directory once, making the renames into it and removals from it durable.
+  auto failed_directories(SyncAll(directories, [this](const fs::path& directory) {
+    return filesystem_->SyncDirectory(directory);
+  }));
+  if (failed_files.empty() && failed_directories.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(unsynced_mutex_);
+    unsynced_files_.insert(failed_files.begin(), failed_files.end());
+    unsynced_directories_.insert(failed_directories.begin(), failed_directories.end());
+  }
+  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+void FilePerChunkBackend::AddUnsynced(const fs::path& file, const fs::path& directory) {
+  std::lock_guard<std::mutex> lock(unsynced_mutex_);
+  if (!file.empty())
+    unsynced_files_.insert(file);
+  unsynced_directories_.insert(directory);
+}
+
+void FilePerChunkBackend::DiscardIncompleteWrites(const std::vector<NameType>& names) {
+  LayoutGuard guard(*this);
+  const std::uint32_t kMigratingFrom(migrating_from_);
+  for (const auto& name : names) {
+    boost::system::error_code error_code;
+    filesystem_->Remove(TempPath(Locate(name).file), error_code);
+    if (kMigratingFrom != 0)
+      filesystem_->Remove(TempPath(LocateAt(name, kMigratingFrom).file), error_code);
+  }
+}
+
+std::vector<std::size_t> FilePerChunkBackend::LocalityOrder(
+    const std::vector<NameType>& names) const {
+  LayoutGuard guard(*this);
+  std::vector<std::pair<std::uint32_t, std::size_t>> directory_indices;
+  directory_indices.reserve(names.size());
+  for (std::size_t i(0); i != names.size(); ++i)
+    directory_indices.emplace_back(Locate(names[i]).directory_index, i);
+  std::sort(directory_indices.begin(), directory_indices.end());
+  std::vector<std::size_t> order;
+  order.reserve(names.size());
+  for (const auto& directory_index : directory_indices)
+    order.push_back(directory_index.second);
+  return order;
+}
+
+FilePerChunkBackend::IoCounts FilePerChunkBackend::GetIoCounts() const {
+  return filesystem_->Counts();
+}
+
+bool FilePerChunkBackend::Migrate(std::uint32_t depth) {
+  std::lock_guard<std::mutex> lock(migration_mutex_);
+  if (migration_running_ || stop_migration_ || depth <= depth_ || depth > kMaxDepth)
+    return false;
+  if (migration_thread_.joinable())
+    migration_thread_.join();
+  migration_running_ = true;
+  migration_thread_ = std::thread([this, depth] { RunMigration(depth); });
+  return true;
+}
+
+void FilePerChunkBackend::WaitForMigration() {
+  std::unique_lock<std::mutex> lock(migration_mutex_);
+  migration_condition_.wait(lock, [this] { return !migration_running_; });
+}
+
+const FilePerChunkBackend::ChunkPath& FilePerChunkBackend::Locate(const NameType& name) const {
+  struct Located {
+    std::uint64_t instance_id;
+    std::uint32_t depth;
+    boost::optional<NameType> name;
+    ChunkPath chunk_path;
+  };
+  static thread_local Located last_located = {0, 0, boost::none, ChunkPath()};
+  const std::uint32_t kDepth(depth_);
+  if (last_located.instance_id == kInstanceId_ && last_located.depth == kDepth &&
+      last_located.name && *last_located.name == name) {
+    return last_located.chunk_path;
+  }
+  last_located.instance_id = kInstanceId_;
+  last_located.depth = kDepth;
+  last_located.name = name;
+  last_located.chunk_path = LocateAt(name, kDepth);
+  return last_located.chunk_path;
+}
+
+FilePerChunkBackend::ChunkPath FilePerChunkBackend::LocateAt(const NameType& name,
+                                                             std::uint32_t depth) const {
+  NameType hashed_name(crypto::Hash<crypto::SHA512>(name.name), name.type_id);
+  return PathAt(detail::GetFileName(hashed_name).string(),
+                kHashedFileNames_ ? std::string() : detail::GetFileName(name).string(), depth);
+}
+
+FilePerChunkBackend::ChunkPath FilePerChunkBackend::PathAt(const std::string& hashed_file_name,
+                                                           const std::string& file_name,
+                                                           std::uint32_t depth) const {
+  ChunkPath chunk_path;
+  chunk_path.directory = kDiskPath_;
+  chunk_path.directory_index = 0;
+  for (std::uint32_t i = 0; i < depth; ++i) {
+    chunk_path.directory /= hashed_file_name.substr(i, 1);
+    chunk_path.directory_index =
+        chunk_path.directory_index << 4 | std::stoul(hashed_file_name.substr(i, 1), nullptr, 16);
+  }
+  chunk_path.file =
+      chunk_path.directory / (kHashedFileNames_ ? hashed_file_name.substr(depth) : file_name);
+  return chunk_path;
+}
+
+void FilePerChunkBackend::RemoveMigratedFrom(const NameType& name) {
+  const std::uint32_t kMigratingFrom(migrating_from_);
+  if (kMigratingFrom == 0)
+    return;
+  boost::system::error_code error_code;
+  filesystem_->Remove(LocateAt(name, kMigratingFrom).file, error_code);
+}
+
+void FilePerChunkBackend::EnsureDirectory(const ChunkPath& chunk_path, bool force) {
+  auto& bits(existing_directories_[chunk_path.directory_index / 64]);
+  const std::uint64_t kBit(std::uint64_t(1) << (chunk_path.directory_index % 64));
+  if (!force && (bits & kBit))
+    return;
+  boost::system::error_code error_code;
+  filesystem_->CreateDirectories(chunk_path.directory, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to create " << chunk_path.directory << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  bits |= kBit;
+}
+
+void FilePerChunkBackend::SampleDirectory(const ChunkPath& chunk_path) {
+  if (!kRecordLayout_ || ++writes_ % kSampleInterval != 0 || migrating_from_ != 0 ||
+      depth_ == kMaxDepth) {
+    return;
+  }
+  std::uint32_t entry_count(0);
+  boost::system::error_code error_code;
+  for (fs::directory_iterator itr(chunk_path.directory, error_code);
+       !error_code && itr != fs::directory_iterator(); itr.increment(error_code)) {
+    ++entry_count;
+  }
+  if (entry_count >= kMigrationThreshold && Migrate(depth_ + 1)) {
+    LOG(kInfo) << kDiskPath_ << " has outgrown a fan-out depth of " << depth_
+               << "; migrating to " << depth_ + 1;
+  }
+}
+
+void FilePerChunkBackend::SwitchLayout(std::uint32_t depth, std::uint32_t migrating_from) {
+  if (kRecordLayout_)
+    kRecordLayout_(depth, migrating_from);
+  std::unique_ptr<std::atomic<std::uint64_t>[]> directory_bits;
+  if (depth != depth_)
+    directory_bits = NewDirectoryBits(depth);
+  switching_layout_ = true;
+  while (operations_in_flight_ != 0)
+    std::this_thread::yield();
+  depth_ = depth;
+  migrating_from_ = migrating_from;
+  if (directory_bits)
+    existing_directories_ = std::move(directory_bits);
+  switching_layout_ = false;
+}
+
+void FilePerChunkBackend::RunMigration(std::uint32_t depth) {
+  try {
+    if (depth != 0)
+      SwitchLayout(depth, depth_);
+    MigrateDirectory(kDiskPath_, std::string(), 0);
+    bool stopped(false);
+    {
+      std::lock_guard<std::mutex> lock(migration_mutex_);
+      stopped = stop_migration_;
+    }
+    // If stopped, the migration is left recorded as running, to be resumed by the next session.
+    if (!stopped)
+      SwitchLayout(depth_, 0);
+  } catch (const std::exception& error) {
+    LOG(kError) << "Failed migrating " << kDiskPath_ << ": "
+                << boost::diagnostic_information(error);
+  }
+  {
+    std::lock_guard<std::mutex> lock(migration_mutex_);
+    migration_running_ = false;
+  }
+  migration_condition_.notify_all();
+}
+
+void FilePerChunkBackend::MigrateDirectory(const fs::path& directory, const std::string& prefix,
+                                           std::uint32_t level) {
+  const std::uint32_t kMigratingFrom(migrating_from_);
+  // Collected first, since moving them adds the new layout's directories alongside.
+  std::vector<std::pair<fs::path, std::string>> files;
+  for (fs::directory_iterator itr(directory); itr != fs::directory_iterator(); ++itr) {
+    fs::path path(itr->path());
+    std::string file_name(path.filename().string());
+    if (level < kMigratingFrom) {
+      if (file_name.size() == 1 && std::isxdigit(static_cast<unsigned char>(file_name[0])) &&
+          fs::is_directory(path)) {
+        MigrateDirectory(path, prefix + file_name, level + 1);
+      }
+    } else if (file_name.size() != 1 && !IsMetadata(path)) {
+      files.emplace_back(path, prefix + file_name);
+    }
+  }
+  for (const auto& file : files) {
+    if (!MigrateFile(file.first, file.second))
+      return;
+  }
+}
+
+bool FilePerChunkBackend::MigrateFile(const fs::path& path, const std::string& hashed_file_name) {
+  std::unique_lock<std::mutex> lock(migration_mutex_);
+  migration_condition_.wait(lock, [this] { return stop_migration_ || open_cursors_ == 0; });
+  if (stop_migration_)
+    return false;
+  ChunkPath chunk_path(kHashedFileNames_
+                           ? PathAt(hashed_file_name, std::string(), depth_)
+                           : LocateAt(detail::GetDataNameAndTypeId(path), depth_));
+  EnsureDirectory(chunk_path, false);
+  // A file already in the new layout was written since the migration started, so is the newer.
+  boost::system::error_code error_code;
+  filesystem_->CreateHardLink(path, chunk_path.file, error_code);
+  if (error_code == boost::system::errc::no_such_file_or_directory) {
+    if (!filesystem_->Exists(path))
+      return true;  // Removed or rewritten in the meantime.
+    // The directory may have been removed since it was recorded as existing.
+    EnsureDirectory(chunk_path, true);
+    filesystem_->CreateHardLink(path, chunk_path.file, error_code);
+  }
+  if (error_code && error_code != boost::system::errc::file_exists) {
+    LOG(kError) << "Failed to link " << path << " to " << chunk_path.file << ": "
+                << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  filesystem_->Remove(path, error_code);
+  return true;
+}
+
+void FilePerChunkBackend::CursorClosed() const {
+  {
+    std::lock_guard<std::mutex> lock(migration_mutex_);
+    --open_cursors_;
+  }
+  migration_condition_.notify_all();
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
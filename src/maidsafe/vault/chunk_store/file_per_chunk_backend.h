@@ -0,0 +1,213 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_FILE_PER_CHUNK_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_FILE_PER_CHUNK_BACKEND_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store/backend.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Stores each chunk as its own file, spread over a tree of single hex character directories
+// taken from the hash of the chunk's name.  Files are named after the chunk's name, except in
+// stores created before that was the case ('hashed_file_names'), where they are named after the
+// rest of the hash and Names() can only return the hashes.
+//
+// Directories are only created by Write, the first time each is needed, so lookups cost a single
+// filesystem call.  Write goes to a temporary file which is then renamed over the chunk's file.
+// The temporary file is synced before the rename and the directory after it, so that once Write
+// returns, the new content survives a power loss whole.  WriteUnsynced and Remove leave the
+// syncing to Sync, which syncs each file written and each directory changed since the last one,
+// so a batch pays for each directory once.  Until then, a power loss can leave a chunk written by
+// WriteUnsynced torn.
+// Writers returned by OpenWriter stream to a file in a hidden directory under the disk path
+// instead, since they aren't serialised with other writes to the name; anything left there by a
+// previous session is removed at construction.
+//
+// The depth of the fan-out is fixed when the store is created, from the number of chunks it is
+// expected to hold.  If the store outgrows it, the backend migrates to a fan-out one level deeper
+// in the background: the chunk's directory at the old depth becomes the parent of its directory
+// at the new one, so each file is hard linked into place and the old link removed.  While that
+// runs, writes go to the new layout and lookups fall back to the old one, and the migration
+// pauses while any name cursors are open.  Each change of layout is passed to 'record_layout'
+// before the backend acts on it, so that a migration interrupted by a restart can be resumed by
+// constructing the backend with the depths last recorded.  Uses POSIX file I/O.
+class FilePerChunkBackend : public ChunkStoreBackend {
+ public:
+  // The system calls made on chunk files and their directories, so that tests can check what each
+  // operation costs.  Walks of the directory tree (ScanUsage, name cursors and migration) aren't
+  // included.  'directory_creations' counts every mkdir tried, and 'syncs' both files and
+  // directories.
+  struct IoCounts {
+    std::uint64_t opens, stats, removes, renames, links, directory_creations, syncs;
+  };
+  // Called with the depth and, during a migration, the depth being migrated from (else 0).
+  using LayoutRecorder = std::function<void(std::uint32_t depth, std::uint32_t migrating_from)>;
+
+  // Stores which predate the choice of depth use this.
+  static const std::uint32_t kDefaultDepth = 5;
+  static const std::uint32_t kMaxDepth = 6;
+  // The depth is chosen so that directories hold around this many chunks.
+  static const std::uint32_t kChunksPerDirectory = 256;
+
+  // The smallest depth which keeps 'expected_chunk_count' chunks to around kChunksPerDirectory
+  // per directory.
+  static std::uint32_t DepthFor(std::uint64_t expected_chunk_count);
+
+  // Without 'record_layout', the store is never migrated automatically.
+  FilePerChunkBackend(boost::filesystem::path disk_path, bool hashed_file_names,
+                      std::uint32_t depth = kDefaultDepth, std::uint32_t migrating_from = 0,
+                      LayoutRecorder record_layout = LayoutRecorder());
+  ~FilePerChunkBackend() override;
+  FilePerChunkBackend(const FilePerChunkBackend&) = delete;
+  FilePerChunkBackend(FilePerChunkBackend&&) = delete;
+  FilePerChunkBackend& operator=(const FilePerChunkBackend&) = delete;
+  FilePerChunkBackend& operator=(FilePerChunkBackend&&) = delete;
+
+  std::uint64_t ScanUsage() const override;
+  std::uint64_t Size(const NameType& name) const override;
+  void Write(const NameType& name, const std::vector<byte>& content) override;
+  void WriteUnsynced(const NameType& name, const std::vector<byte>& content) override;
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override;
+  boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                               std::uint64_t length) const override;
+  std::unique_ptr<ContentWriter> OpenWriter(const NameType& name) override;
+  std::uint64_t Remove(const NameType& name) override;
+  // Partitions the fan-out directories between the cursors.  The directories are taken from the
+  // hash of each name, so all of them are walked whatever the range.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const override;
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const override;
+  bool ListsNames() const override { return !kHashedFileNames_; }
+  // fdatasyncs the files written by WriteUnsynced since the last Sync, then fsyncs each directory
+  // they were renamed into or removed from once.
+  void Sync() override;
+  // Removes any temporary files left by Write.
+  void DiscardIncompleteWrites(const std::vector<NameType>& names) override;
+  std::vector<std::size_t> LocalityOrder(const std::vector<NameType>& names) const override;
+
+  IoCounts GetIoCounts() const;
+
+  std::uint32_t Depth() const { return depth_; }
+  bool Migrating() const { return migrating_from_ != 0; }
+  // Starts migrating to 'depth' in the background, unless a migration is already running or
+  // 'depth' isn't deeper than the current one (up to kMaxDepth).  Returns whether it started.
+  bool Migrate(std::uint32_t depth);
+  // Blocks until any migration has finished.
+  void WaitForMigration();
+
+ private:
+  struct ChunkPath {
+    boost::filesystem::path directory, file;
+    // Identifies the directory within the fan-out.
+    std::uint32_t directory_index;
+  };
+  // The size of the directory written to is checked once every this many writes, and a migration
+  // is started once it holds this many entries.
+  static const std::uint32_t kSampleInterval = 1024;
+  static const std::uint32_t kMigrationThreshold = 16 * kChunksPerDirectory;
+
+  // The location is remembered for the last name looked up on each thread, so the Size and Write
+  // making up a single Put only hash the name once.  The result is valid until the next call on
+  // the same thread, or until the layout changes.
+  const ChunkPath& Locate(const NameType& name) const;
+  ChunkPath LocateAt(const NameType& name, std::uint32_t depth) const;
+  // 'hashed_file_name' is the file name of the hashed chunk name; 'file_name' is used as the file
+  // name unless file names are hashed.
+  ChunkPath PathAt(const std::string& hashed_file_name, const std::string& file_name,
+                   std::uint32_t depth) const;
+  // Write, leaving the file and its directory to the next Sync unless 'synced' is set.
+  void Write(const NameType& name, const std::vector<byte>& content, bool synced);
+  // Records a file (if not empty) and directory for the next Sync.
+  void AddUnsynced(const boost::filesystem::path& file, const boost::filesystem::path& directory);
+  // Tries 'attempt' on the chunk's file, falling back to its file in the old layout during a
+  // migration, and retrying the new layout in case the file was moved in between.
+  template <typename Attempt>
+  auto FindFile(const NameType& name, Attempt attempt) const -> decltype(attempt(ChunkPath()));
+  // Removes any copy of a chunk just written which was left in the old layout.
+  void RemoveMigratedFrom(const NameType& name);
+  // Creates the chunk's directory unless it's already known to exist (or 'force' is set).
+  void EnsureDirectory(const ChunkPath& chunk_path, bool force);
+  void SampleDirectory(const ChunkPath& chunk_path);
+  class Cursor;
+  class StreamWriter;
+  class LayoutGuard;
+  class Filesystem;
+
+  NameType ComposeName(std::string file_name_str) const;
+
+  // Records the layout, then waits for operations in progress to finish and switches to it.
+  void SwitchLayout(std::uint32_t depth, std::uint32_t migrating_from);
+  // Moves every chunk from the old layout to the new, first switching to 'depth' unless it is 0
+  // (when resuming a migration).
+  void RunMigration(std::uint32_t depth);
+  void MigrateDirectory(const boost::filesystem::path& directory, const std::string& prefix,
+                        std::uint32_t level);
+  bool MigrateFile(const boost::filesystem::path& path, const std::string& hashed_file_name);
+  void CursorClosed() const;
+
+  const boost::filesystem::path kDiskPath_;
+  const bool kHashedFileNames_;
+  const std::uint64_t kInstanceId_;
+  const LayoutRecorder kRecordLayout_;
+  // Only changed by SwitchLayout, while no operations are in progress.
+  std::atomic<std::uint32_t> depth_, migrating_from_;
+  // One bit per directory in the fan-out, set once the directory is known to exist.
+  std::unique_ptr<std::atomic<std::uint64_t>[]> existing_directories_;
+  // Every call on a chunk's file or directory goes through this, which counts them.
+  const std::unique_ptr<Filesystem> filesystem_;
+  std::atomic<std::uint64_t> next_stream_id_, writes_;
+  // Held for the whole of each Sync, so that a Sync can't return while another is still syncing
+  // what it took from the members below.
+  std::mutex sync_mutex_;
+  // Guards the files and directories left for the next Sync.
+  std::mutex unsynced_mutex_;
+  std::set<boost::filesystem::path> unsynced_files_, unsynced_directories_;
+  // Counts the LayoutGuards alive; SwitchLayout sets switching_layout_ to hold off new ones.
+  mutable std::atomic<std::uint32_t> operations_in_flight_;
+  std::atomic<bool> switching_layout_;
+  // Guards the members below.  The migration only moves a file while holding it, with no open
+  // cursors.
+  mutable std::mutex migration_mutex_;
+  mutable std::condition_variable migration_condition_;
+  mutable std::uint32_t open_cursors_;
+  bool migration_running_, stop_migration_;
+  std::thread migration_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_FILE_PER_CHUNK_BACKEND_H_
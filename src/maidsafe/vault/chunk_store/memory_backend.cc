@@ -0,0 +1,171 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/memory_backend.h"
+
+#include <deque>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+MemoryBackend::MemoryBackend() : shards_() {}
+
+std::uint64_t MemoryBackend::ScanUsage() const {
+  std::uint64_t usage(0);
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (const auto& chunk : shard.chunks)
+      usage += chunk.second.size();
+  }
+  return usage;
+}
+
+std::uint64_t MemoryBackend::Size(const NameType& name) const {
+  const Shard& shard(GetShard(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto itr(shard.chunks.find(name));
+  return itr == shard.chunks.end() ? 0 : itr->second.size();
+}
+
+void MemoryBackend::Write(const NameType& name, const std::vector<byte>& content) {
+  Shard& shard(GetShard(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.chunks[name] = content;
+}
+
+boost::optional<std::vector<byte>> MemoryBackend::Read(const NameType& name) const {
+  const Shard& shard(GetShard(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto itr(shard.chunks.find(name));
+  if (itr == shard.chunks.end())
+    return boost::none;
+  return itr->second;
+}
+
+boost::optional<std::vector<byte>> MemoryBackend::ReadRange(const NameType& name,
+                                                            std::uint64_t offset,
+                                                            std::uint64_t length) const {
+  const Shard& shard(GetShard(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto itr(shard.chunks.find(name));
+  if (itr == shard.chunks.end())
+    return boost::none;
+  const auto& content(itr->second);
+  if (offset >= content.size())
+    return std::vector<byte>();
+  return std::vector<byte>(content.begin() + offset,
+                           content.begin() + offset + std::min(length, content.size() - offset));
+}
+
+std::uint64_t MemoryBackend::Remove(const NameType& name) {
+  Shard& shard(GetShard(name));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto itr(shard.chunks.find(name));
+  if (itr == shard.chunks.end()) {
+    LOG(kError) << "Can't remove " << name.name << ": not held.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+  std::uint64_t size(itr->second.size());
+  shard.chunks.erase(itr);
+  return size;
+}
+
+// Visits the shards in turn, copying names out of each a batch at a time so that no shard is
+// locked for long.
+class MemoryBackend::Cursor : public ChunkStoreBackend::NameCursor {
+ public:
+  Cursor(const MemoryBackend& backend, NameRange range, std::uint32_t partition,
+         std::uint32_t count)
+      : backend_(backend),
+        kRange_(std::move(range)),
+        kPartition_(partition),
+        kCount_(count),
+        shard_index_(0),
+        last_name_(),
+        started_(false),
+        names_() {}
+
+  boost::optional<NameType> Next() override {
+    while (names_.empty() && shard_index_ != backend_.shards_.size())
+      Refill();
+    if (names_.empty())
+      return boost::none;
+    NameType name(names_.front());
+    names_.pop_front();
+    return name;
+  }
+
+ private:
+  void Refill() {
+    const std::size_t kBatchSize(256), kMaxEntriesScanned(4096);
+    const Shard& shard(backend_.shards_[shard_index_]);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto itr(started_ ? shard.chunks.upper_bound(last_name_) : shard.chunks.begin());
+    started_ = true;
+    for (std::size_t scanned(1); itr != shard.chunks.end(); ++itr, ++scanned) {
+      last_name_ = itr->first;
+      if (itr->first.name.string().back() % kCount_ == kPartition_ &&
+          kRange_.Contains(itr->first.name)) {
+        names_.push_back(itr->first);
+      }
+      if (names_.size() == kBatchSize || scanned == kMaxEntriesScanned)
+        return;
+    }
+    ++shard_index_;
+    started_ = false;
+  }
+
+  const MemoryBackend& backend_;
+  const NameRange kRange_;
+  const std::uint32_t kPartition_, kCount_;
+  std::size_t shard_index_;
+  NameType last_name_;
+  bool started_;
+  std::deque<NameType> names_;
+};
+
+std::vector<std::unique_ptr<ChunkStoreBackend::NameCursor>> MemoryBackend::Names(
+    const NameRange& range, std::uint32_t count) const {
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (std::uint32_t i(0); i != count; ++i)
+    cursors.push_back(NamesPart(range, i, count));
+  return cursors;
+}
+
+std::unique_ptr<ChunkStoreBackend::NameCursor> MemoryBackend::NamesPart(const NameRange& range,
+                                                               std::uint32_t part,
+                                                               std::uint32_t count) const {
+  return std::unique_ptr<NameCursor>(new Cursor(*this, range, part, count));
+}
+
+MemoryBackend::Shard& MemoryBackend::GetShard(const NameType& name) {
+  return shards_[name.name.string().back() % shards_.size()];
+}
+
+const MemoryBackend::Shard& MemoryBackend::GetShard(const NameType& name) const {
+  return shards_[name.name.string().back() % shards_.size()];
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,80 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_MEMORY_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_MEMORY_BACKEND_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "maidsafe/vault/chunk_store/backend.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Holds every chunk in memory, for stores which needn't survive a restart (e.g. cache-only vaults,
+// or benchmarks which shouldn't measure the disk).  The chunks are sharded by the last byte of
+// their name, each shard with its own lock.  ChunkStore keeps no metadata on disk for a backend
+// like this, but still enforces its max disk usage, which here bounds the memory used.
+class MemoryBackend : public ChunkStoreBackend {
+ public:
+  MemoryBackend();
+  MemoryBackend(const MemoryBackend&) = delete;
+  MemoryBackend(MemoryBackend&&) = delete;
+  MemoryBackend& operator=(const MemoryBackend&) = delete;
+  MemoryBackend& operator=(MemoryBackend&&) = delete;
+
+  std::uint64_t ScanUsage() const override;
+  std::uint64_t Size(const NameType& name) const override;
+  void Write(const NameType& name, const std::vector<byte>& content) override;
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override;
+  boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                               std::uint64_t length) const override;
+  std::uint64_t Remove(const NameType& name) override;
+  // Splits the names between the cursors by their last byte.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const override;
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const override;
+  void Sync() override {}
+  bool Persistent() const override { return false; }
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    // Ordered, so that name cursors can resume from the last name returned.
+    std::map<NameType, std::vector<byte>> chunks;
+  };
+  class Cursor;
+
+  Shard& GetShard(const NameType& name);
+  const Shard& GetShard(const NameType& name) const;
+
+  std::array<Shard, 64> shards_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_MEMORY_BACKEND_H_
@@ -0,0 +1,178 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/name_filter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/log.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+const std::uint64_t kCountersPerName(16);
+const std::uint64_t kMinCounterCount(1 << 16);
+const std::uint64_t kMaxCounterCount(1 << 26);
+const std::uint8_t kMaxCount(255);
+const std::uint32_t kFileMagic(0x464e534d);  // "MSNF"
+
+std::uint64_t CounterCount(std::uint64_t expected_count) {
+  std::uint64_t wanted(std::min(expected_count, kMaxCounterCount / kCountersPerName) *
+                       kCountersPerName);
+  std::uint64_t counter_count(kMinCounterCount);
+  while (counter_count < wanted)
+    counter_count <<= 1;
+  return counter_count;
+}
+
+std::uint64_t Mix(std::uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  return value ^ (value >> 33);
+}
+
+}  // unnamed namespace
+
+NameFilter::NameFilter(std::uint64_t expected_count)
+    : kCounterCount_(CounterCount(expected_count)),
+      counters_(new std::atomic<std::uint8_t>[kCounterCount_]),
+      count_(0) {
+  for (std::uint64_t i(0); i != kCounterCount_; ++i)
+    counters_[i] = 0;
+}
+
+std::unique_ptr<NameFilter> NameFilter::Load(const fs::path& path) {
+  std::unique_ptr<NameFilter> filter;
+  boost::system::error_code error_code;
+  if (!fs::exists(path, error_code))
+    return filter;
+  {
+    std::ifstream file(path.string(), std::ios::binary);
+    std::uint32_t magic(0);
+    std::uint64_t counter_count(0), count(0);
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&counter_count), sizeof(counter_count));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    bool valid_header(file && magic == kFileMagic &&
+                      counter_count == CounterCount(counter_count / kCountersPerName));
+    if (valid_header) {
+      std::vector<char> counters(static_cast<std::size_t>(counter_count));
+      if (file.read(counters.data(), counters.size())) {
+        filter.reset(new NameFilter(counter_count / kCountersPerName));
+        for (std::uint64_t i(0); i != counter_count; ++i)
+          filter->counters_[i] = static_cast<std::uint8_t>(counters[i]);
+        filter->count_ = count;
+      }
+    }
+  }
+  if (!filter)
+    LOG(kWarning) << "Ignoring invalid name filter " << path;
+  if (!fs::remove(path, error_code) || error_code) {
+    LOG(kError) << "Failed to remove " << path << ": " << error_code.message();
+    filter.reset();
+  }
+  return filter;
+}
+
+bool NameFilter::Save(const fs::path& path) const {
+  fs::path temp_path(path.string() + ".tmp");
+  {
+    std::ofstream file(temp_path.string(), std::ios::binary | std::ios::trunc);
+    std::uint64_t count(count_);
+    file.write(reinterpret_cast<const char*>(&kFileMagic), sizeof(kFileMagic));
+    file.write(reinterpret_cast<const char*>(&kCounterCount_), sizeof(kCounterCount_));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    std::vector<char> counters(static_cast<std::size_t>(kCounterCount_));
+    for (std::uint64_t i(0); i != kCounterCount_; ++i)
+      counters[i] = static_cast<char>(counters_[i].load());
+    file.write(counters.data(), counters.size());
+    file.close();
+    if (!file) {
+      LOG(kError) << "Failed to write " << temp_path;
+      return false;
+    }
+  }
+  boost::system::error_code error_code;
+  fs::rename(temp_path, path, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    return false;
+  }
+  return true;
+}
+
+void NameFilter::Add(const NameType& name) {
+  ForEachCounter(name, [](std::atomic<std::uint8_t>& counter) {
+    std::uint8_t value(counter.load());
+    while (value != kMaxCount && !counter.compare_exchange_weak(value, value + 1)) {
+    }
+  });
+  ++count_;
+}
+
+void NameFilter::Remove(const NameType& name) {
+  ForEachCounter(name, [](std::atomic<std::uint8_t>& counter) {
+    std::uint8_t value(counter.load());
+    while (value != kMaxCount && value != 0 &&
+           !counter.compare_exchange_weak(value, value - 1)) {
+    }
+  });
+  --count_;
+}
+
+bool NameFilter::MayContain(const NameType& name) const {
+  bool may_contain(true);
+  ForEachCounter(name, [&](std::atomic<std::uint8_t>& counter) {
+    if (counter.load(std::memory_order_relaxed) == 0)
+      may_contain = false;
+  });
+  return may_contain;
+}
+
+bool NameFilter::NeedsResize() const {
+  return count_ * kCountersPerName > 2 * kCounterCount_ && kCounterCount_ < kMaxCounterCount;
+}
+
+template <typename Functor>
+void NameFilter::ForEachCounter(const NameType& name, Functor functor) const {
+  // Double hashing: the i'th counter is at h1 + i * h2.
+  const auto& name_bytes(name.name.string());
+  std::uint64_t words[2] = {0, 0};
+  for (std::size_t i(0); i != name_bytes.size(); ++i) {
+    auto& word(words[(i / 8) % 2]);
+    word = (word << 8 | word >> 56) ^ name_bytes[i];
+  }
+  std::uint64_t h1(Mix(words[0] ^ name.type_id.data)), h2(Mix(words[1]) | 1);
+  for (std::size_t i(0); i != kHashCount; ++i)
+    functor(counters_[(h1 + i * h2) & (kCounterCount_ - 1)]);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
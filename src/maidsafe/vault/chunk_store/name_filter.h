@@ -0,0 +1,81 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_NAME_FILTER_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_NAME_FILTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// A counting Bloom filter over the names held by a ChunkStore.  MayContain never returns false for
+// a name which has been added and not since removed, so a false result lets a lookup be answered
+// without touching the disk.  Counters which saturate are never decremented again, which can only
+// cost false positives.
+//
+// The filter doesn't grow; once it holds more names than it was sized for, its false positive rate
+// rises until it is rebuilt with a larger size (see NeedsResize).  Add, Remove and MayContain may
+// be called concurrently.
+class NameFilter {
+ public:
+  using NameType = Data::NameAndTypeId;
+
+  explicit NameFilter(std::uint64_t expected_count);
+  NameFilter(const NameFilter&) = delete;
+  NameFilter(NameFilter&&) = delete;
+  NameFilter& operator=(const NameFilter&) = delete;
+  NameFilter& operator=(NameFilter&&) = delete;
+
+  // Reads a filter written by Save and removes the file, so it can't be loaded again after it has
+  // gone stale.  Returns nullptr if there is no valid filter at 'path'.
+  static std::unique_ptr<NameFilter> Load(const boost::filesystem::path& path);
+  // Must not be called concurrently with Add or Remove.
+  bool Save(const boost::filesystem::path& path) const;
+
+  void Add(const NameType& name);
+  void Remove(const NameType& name);
+  bool MayContain(const NameType& name) const;
+
+  std::uint64_t Count() const { return count_; }
+  // True if the filter holds more than twice the names it was sized for.
+  bool NeedsResize() const;
+
+ private:
+  static const std::size_t kHashCount = 4;
+
+  template <typename Functor>
+  void ForEachCounter(const NameType& name, Functor functor) const;
+
+  const std::uint64_t kCounterCount_;
+  std::unique_ptr<std::atomic<std::uint8_t>[]> counters_;
+  std::atomic<std::uint64_t> count_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_NAME_FILTER_H_
@@ -0,0 +1,76 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/name_range.h"
+
+#include "maidsafe/common/error.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+NameRange::NameRange()
+    : all_names_(true),
+      target_(),
+      max_distance_(),
+      lowest_(identity_size, 0),
+      highest_(identity_size, 0xff) {}
+
+NameRange::NameRange(const Identity& target, const Identity& max_distance)
+    : all_names_(false),
+      target_(target.string()),
+      max_distance_(max_distance.string()),
+      lowest_(target_),
+      highest_(target_) {
+  // Names in range share all the bits of 'target' above the highest set bit of 'max_distance'.
+  bool in_free_bits(false);
+  for (std::size_t i(0); i != max_distance_.size(); ++i) {
+    for (int bit(7); bit >= 0; --bit) {
+      in_free_bits = in_free_bits || ((max_distance_[i] >> bit) & 1) != 0;
+      if (in_free_bits) {
+        lowest_[i] &= static_cast<byte>(~(1 << bit));
+        highest_[i] |= static_cast<byte>(1 << bit);
+      }
+    }
+  }
+}
+
+NameRange NameRange::Prefix(const Identity& target, std::uint32_t bits) {
+  if (bits > identity_size * 8)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  std::vector<byte> max_distance(identity_size, 0);
+  for (std::uint32_t bit(bits); bit != identity_size * 8; ++bit)
+    max_distance[bit / 8] |= static_cast<byte>(0x80 >> (bit % 8));
+  return NameRange(target, Identity(max_distance));
+}
+
+bool NameRange::Contains(const Identity& name) const {
+  if (all_names_)
+    return true;
+  const auto& name_bytes(name.string());
+  for (std::size_t i(0); i != target_.size(); ++i) {
+    byte distance(name_bytes[i] ^ target_[i]);
+    if (distance != max_distance_[i])
+      return distance < max_distance_[i];
+  }
+  return true;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
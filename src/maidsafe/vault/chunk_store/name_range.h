@@ -0,0 +1,56 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_NAME_RANGE_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_NAME_RANGE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Selects names by their XOR distance from a target, e.g. to find the names within a close group's
+// range.  A default-constructed range holds every name.
+class NameRange {
+ public:
+  NameRange();
+  // Names no further than 'max_distance' from 'target'.
+  NameRange(const Identity& target, const Identity& max_distance);
+  // Names whose first 'bits' bits match those of 'target'.
+  static NameRange Prefix(const Identity& target, std::uint32_t bits);
+
+  bool Contains(const Identity& name) const;
+  // The lowest and highest names the range can hold, so that ordered stores can skip straight to
+  // it.  Not every name in between is necessarily in the range.
+  const std::vector<byte>& Lowest() const { return lowest_; }
+  const std::vector<byte>& Highest() const { return highest_; }
+
+ private:
+  bool all_names_;
+  std::vector<byte> target_, max_distance_, lowest_, highest_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_NAME_RANGE_H_
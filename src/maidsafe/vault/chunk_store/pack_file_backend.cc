@@ -0,0 +1,559 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/pack_file_backend.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Record layout: magic (4) | live flag (1) | type id (4) | name (64) | sequence (8) | length (4) |
+// content.  All integers are little-endian.
+const std::uint32_t kRecordMagic(0x4b50534d);
+const std::uint64_t kFlagOffset(4);
+const std::uint64_t kHeaderSize(4 + 1 + 4 + identity_size + 8 + 4);
+const byte kLive(1), kDead(0);
+
+std::uint64_t RecordSize(std::uint32_t length) { return kHeaderSize + length; }
+
+template <typename Integer>
+void AppendInteger(Integer value, std::vector<byte>& buffer) {
+  for (std::size_t i(0); i != sizeof(Integer); ++i)
+    buffer.push_back(static_cast<byte>(value >> (8 * i)));
+}
+
+template <typename Integer>
+Integer ReadInteger(const byte* buffer) {
+  Integer value(0);
+  for (std::size_t i(0); i != sizeof(Integer); ++i)
+    value |= static_cast<Integer>(buffer[i]) << (8 * i);
+  return value;
+}
+
+std::string Key(const ChunkStoreBackend::NameType& name) {
+  const auto& name_bytes(name.name.string());
+  std::string key(name_bytes.begin(), name_bytes.end());
+  for (std::size_t i(0); i != sizeof(std::uint32_t); ++i)
+    key.push_back(static_cast<char>(name.type_id.data >> (8 * i)));
+  return key;
+}
+
+ChunkStoreBackend::NameType KeyToName(const std::string& key) {
+  return ChunkStoreBackend::NameType(
+      Identity(std::vector<byte>(key.begin(), key.begin() + identity_size)),
+      DataTypeId(ReadInteger<std::uint32_t>(
+          reinterpret_cast<const byte*>(key.data()) + identity_size)));
+}
+
+bool WriteAt(int fd, const byte* data, std::size_t size, std::uint64_t offset) {
+  while (size != 0) {
+    auto written(pwrite(fd, data, size, static_cast<off_t>(offset)));
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= static_cast<std::size_t>(written);
+    offset += static_cast<std::uint64_t>(written);
+  }
+  return true;
+}
+
+bool ReadAt(int fd, byte* data, std::size_t size, std::uint64_t offset) {
+  while (size != 0) {
+    auto read(pread(fd, data, size, static_cast<off_t>(offset)));
+    if (read <= 0)
+      return false;
+    data += read;
+    size -= static_cast<std::size_t>(read);
+    offset += static_cast<std::uint64_t>(read);
+  }
+  return true;
+}
+
+fs::path SegmentPath(const fs::path& disk_path, std::uint32_t id) {
+  std::ostringstream file_name;
+  file_name << std::setw(8) << std::setfill('0') << id << ".pack";
+  return disk_path / file_name.str();
+}
+
+// Returns false for anything which isn't named like a segment.
+bool ParseSegmentId(const fs::path& path, std::uint32_t& id) {
+  const std::string stem(path.stem().string());
+  if (path.extension() != ".pack" || stem.empty() || stem.size() > 9 ||
+      !std::all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+    return false;
+  }
+  id = static_cast<std::uint32_t>(std::stoul(stem));
+  return true;
+}
+
+int OpenSegmentFile(const fs::path& path, bool create) {
+  int fd(open(path.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), S_IRUSR | S_IWUSR));
+  if (fd < 0) {
+    LOG(kError) << "Failed to open segment " << path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  return fd;
+}
+
+}  // unnamed namespace
+
+struct PackFileBackend::Segment {
+  Segment(fs::path path_in, std::uint32_t id_in, int fd_in)
+      : path(std::move(path_in)),
+        id(id_in),
+        fd(fd_in),
+        size(0),
+        live_bytes(0),
+        dead_bytes(0),
+        unsynced(false) {}
+  ~Segment() { close(fd); }
+
+  const fs::path path;
+  const std::uint32_t id;
+  const int fd;
+  // 'size' is guarded by append_mutex_, the byte counts by index_mutex_.
+  std::uint64_t size, live_bytes, dead_bytes;
+  // Set by every write to the file, cleared by Sync.
+  std::atomic<bool> unsynced;
+};
+
+PackFileBackend::PackFileBackend(fs::path disk_path, std::uint64_t max_segment_size)
+    : kDiskPath_(std::move(disk_path)),
+      kMaxSegmentSize_(max_segment_size),
+      index_mutex_(),
+      index_(),
+      segments_(),
+      append_mutex_(),
+      active_segment_(),
+      active_segment_id_(0),
+      next_sequence_(0),
+      compaction_condition_(),
+      stop_compaction_(false),
+      compaction_thread_() {
+  std::map<std::uint32_t, fs::path> segment_paths;
+  for (fs::directory_iterator itr(kDiskPath_); itr != fs::directory_iterator(); ++itr) {
+    std::uint32_t id(0);
+    if (ParseSegmentId(itr->path(), id))
+      segment_paths.emplace(id, itr->path());
+    else if (itr->path().extension() == ".pack")
+      LOG(kWarning) << "Ignoring " << itr->path() << ": not a segment.";
+  }
+  // Older segments first, so a later record for a name always supersedes an earlier one.
+  for (const auto& segment_path : segment_paths)
+    LoadSegment(segment_path.second, segment_path.first);
+  active_segment_id_ = segment_paths.empty() ? 1 : segment_paths.rbegin()->first + 1;
+  compaction_thread_ = std::thread([this] { CompactionLoop(); });
+}
+
+PackFileBackend::~PackFileBackend() {
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    stop_compaction_ = true;
+  }
+  compaction_condition_.notify_one();
+  compaction_thread_.join();
+}
+
+void PackFileBackend::LoadSegment(const fs::path& path, std::uint32_t id) {
+  auto segment(std::make_shared<Segment>(path, id, OpenSegmentFile(path, false)));
+  std::uint64_t file_size(fs::file_size(path));
+  std::vector<byte> header(kHeaderSize);
+  while (segment->size + kHeaderSize <= file_size) {
+    if (!ReadAt(segment->fd, header.data(), kHeaderSize, segment->size) ||
+        ReadInteger<std::uint32_t>(header.data()) != kRecordMagic) {
+      break;
+    }
+    Location location;
+    location.segment = segment;
+    location.offset = segment->size;
+    location.sequence = ReadInteger<std::uint64_t>(&header[9 + identity_size]);
+    location.length = ReadInteger<std::uint32_t>(&header[17 + identity_size]);
+    if (location.offset + RecordSize(location.length) > file_size)
+      break;
+    segment->size += RecordSize(location.length);
+    next_sequence_ = std::max(next_sequence_.load(), location.sequence + 1);
+    if (header[kFlagOffset] != kLive) {
+      segment->dead_bytes += RecordSize(location.length);
+      continue;
+    }
+    std::string key(header.begin() + 5, header.begin() + 9 + identity_size);
+    std::rotate(key.begin(), key.begin() + 4, key.end());  // to name followed by type id
+    segment->live_bytes += RecordSize(location.length);
+    Index(key, location);
+  }
+  if (segment->size != file_size) {
+    // A partly written record at the end, left by a crash.
+    LOG(kWarning) << "Truncating " << path << " from " << file_size << " to " << segment->size;
+    if (ftruncate(segment->fd, static_cast<off_t>(segment->size)) != 0)
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  segments_.emplace(id, segment);
+}
+
+void PackFileBackend::Index(const std::string& key, const Location& location) {
+  auto itr(index_.find(key));
+  if (itr == index_.end()) {
+    index_.emplace(key, location);
+  } else if (itr->second.sequence <= location.sequence) {
+    MarkDead(itr->second);
+    itr->second = location;
+  } else {
+    MarkDead(location);
+  }
+}
+
+std::uint64_t PackFileBackend::ScanUsage() const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  std::uint64_t usage(0);
+  for (const auto& entry : index_)
+    usage += entry.second.length;
+  return usage;
+}
+
+std::uint64_t PackFileBackend::Size(const NameType& name) const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto itr(index_.find(Key(name)));
+  return itr == index_.end() ? 0 : itr->second.length;
+}
+
+void PackFileBackend::Write(const NameType& name, const std::vector<byte>& content) {
+  const std::string key(Key(name));
+  Append(name, next_sequence_++, content, [&](const Location& location) { Index(key, location); });
+}
+
+boost::optional<std::vector<byte>> PackFileBackend::Read(const NameType& name) const {
+  Location location;
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto itr(index_.find(Key(name)));
+    if (itr == index_.end())
+      return boost::none;
+    location = itr->second;
+  }
+  // The segment may be compacted away meanwhile, but the shared_ptr keeps its file open.
+  std::vector<byte> content(location.length);
+  if (!ReadAt(location.segment->fd, content.data(), content.size(),
+              location.offset + kHeaderSize)) {
+    LOG(kError) << "Failed to read " << name.name << " from " << location.segment->path;
+    return boost::none;
+  }
+  return content;
+}
+
+boost::optional<std::vector<byte>> PackFileBackend::ReadRange(const NameType& name,
+                                                              std::uint64_t offset,
+                                                              std::uint64_t length) const {
+  Location location;
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto itr(index_.find(Key(name)));
+    if (itr == index_.end())
+      return boost::none;
+    location = itr->second;
+  }
+  std::vector<byte> content(offset < location.length ? std::min(length, location.length - offset)
+                                                     : 0);
+  if (!content.empty() && !ReadAt(location.segment->fd, content.data(), content.size(),
+                                  location.offset + kHeaderSize + offset)) {
+    LOG(kError) << "Failed to read " << name.name << " from " << location.segment->path;
+    return boost::none;
+  }
+  return content;
+}
+
+std::uint64_t PackFileBackend::Remove(const NameType& name) {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto itr(index_.find(Key(name)));
+  if (itr == index_.end()) {
+    LOG(kError) << "Can't remove " << name.name << ": not held.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  std::uint64_t length(itr->second.length);
+  MarkDead(itr->second);
+  index_.erase(itr);
+  return length;
+}
+
+// Copies names out of the index a batch at a time, so the index isn't locked for long.
+class PackFileBackend::Cursor : public ChunkStoreBackend::NameCursor {
+ public:
+  Cursor(const PackFileBackend& backend, NameRange range, std::uint32_t partition,
+         std::uint32_t count)
+      : backend_(backend),
+        kRange_(std::move(range)),
+        kHighest_(kRange_.Highest().begin(), kRange_.Highest().end()),
+        kPartition_(partition),
+        kCount_(count),
+        last_key_(kRange_.Lowest().begin(), kRange_.Lowest().end()),
+        started_(false),
+        finished_(false),
+        names_() {}
+
+  boost::optional<NameType> Next() override {
+    while (names_.empty() && !finished_)
+      Refill();
+    if (names_.empty())
+      return boost::none;
+    NameType name(names_.front());
+    names_.pop_front();
+    return name;
+  }
+
+ private:
+  void Refill() {
+    // Bounds both the names copied and the entries looked at while the index is locked.
+    const std::size_t kBatchSize(256), kMaxEntriesScanned(4096);
+    std::lock_guard<std::mutex> lock(backend_.index_mutex_);
+    auto itr(started_ ? backend_.index_.upper_bound(last_key_)
+                      : backend_.index_.lower_bound(last_key_));
+    started_ = true;
+    for (std::size_t scanned(1); itr != backend_.index_.end(); ++itr, ++scanned) {
+      if (itr->first.compare(0, kHighest_.size(), kHighest_) > 0)
+        break;
+      last_key_ = itr->first;
+      NameType name(KeyToName(itr->first));
+      if (name.name.string().back() % kCount_ == kPartition_ && kRange_.Contains(name.name))
+        names_.push_back(std::move(name));
+      if (names_.size() == kBatchSize || scanned == kMaxEntriesScanned)
+        return;
+    }
+    finished_ = true;
+  }
+
+  const PackFileBackend& backend_;
+  const NameRange kRange_;
+  const std::string kHighest_;
+  const std::uint32_t kPartition_, kCount_;
+  std::string last_key_;
+  bool started_, finished_;
+  std::deque<NameType> names_;
+};
+
+std::vector<std::unique_ptr<ChunkStoreBackend::NameCursor>> PackFileBackend::Names(
+    const NameRange& range, std::uint32_t count) const {
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (std::uint32_t i(0); i != count; ++i)
+    cursors.push_back(NamesPart(range, i, count));
+  return cursors;
+}
+
+std::unique_ptr<ChunkStoreBackend::NameCursor> PackFileBackend::NamesPart(const NameRange& range,
+                                                               std::uint32_t part,
+                                                               std::uint32_t count) const {
+  return std::unique_ptr<NameCursor>(new Cursor(*this, range, part, count));
+}
+
+void PackFileBackend::Sync() {
+  std::vector<std::shared_ptr<Segment>> segments;
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (const auto& segment : segments_)
+      segments.push_back(segment.second);
+  }
+  for (const auto& segment : segments) {
+    if (!segment->unsynced.exchange(false))
+      continue;
+#ifdef __APPLE__
+    int result(fsync(segment->fd));
+#else
+    int result(fdatasync(segment->fd));
+#endif
+    if (result != 0) {
+      segment->unsynced = true;
+      LOG(kError) << "Failed to sync " << segment->path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+}
+
+std::vector<std::size_t> PackFileBackend::LocalityOrder(const std::vector<NameType>& names) const {
+  // Records are visited in file order; names not held go last.
+  std::vector<std::tuple<std::uint32_t, std::uint64_t, std::size_t>> positions;
+  positions.reserve(names.size());
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (std::size_t i(0); i != names.size(); ++i) {
+      auto itr(index_.find(Key(names[i])));
+      if (itr == index_.end())
+        positions.emplace_back(std::numeric_limits<std::uint32_t>::max(), 0, i);
+      else
+        positions.emplace_back(itr->second.segment->id, itr->second.offset, i);
+    }
+  }
+  std::sort(positions.begin(), positions.end());
+  std::vector<std::size_t> order;
+  order.reserve(names.size());
+  for (const auto& position : positions)
+    order.push_back(std::get<2>(position));
+  return order;
+}
+
+std::size_t PackFileBackend::SegmentCount() const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  return segments_.size();
+}
+
+void PackFileBackend::Append(const NameType& name, std::uint64_t sequence,
+                             const std::vector<byte>& content, const IndexFunctor& index) {
+  std::vector<byte> record;
+  record.reserve(RecordSize(static_cast<std::uint32_t>(content.size())));
+  AppendInteger(kRecordMagic, record);
+  record.push_back(kLive);
+  AppendInteger(name.type_id.data, record);
+  record.insert(record.end(), name.name.string().begin(), name.name.string().end());
+  AppendInteger(sequence, record);
+  AppendInteger(static_cast<std::uint32_t>(content.size()), record);
+  record.insert(record.end(), content.begin(), content.end());
+
+  std::lock_guard<std::mutex> lock(append_mutex_);
+  if (!active_segment_ ||
+      (active_segment_->size != 0 && active_segment_->size + record.size() > kMaxSegmentSize_)) {
+    std::uint32_t id(active_segment_ ? active_segment_->id + 1 : active_segment_id_.load());
+    auto path(SegmentPath(kDiskPath_, id));
+    active_segment_ = std::make_shared<Segment>(path, id, OpenSegmentFile(path, true));
+    active_segment_id_ = id;
+    std::lock_guard<std::mutex> index_lock(index_mutex_);
+    segments_.emplace(id, active_segment_);
+  }
+  if (!WriteAt(active_segment_->fd, record.data(), record.size(), active_segment_->size)) {
+    LOG(kError) << "Failed to append " << name.name << " to " << active_segment_->path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  active_segment_->unsynced = true;
+  Location location;
+  location.segment = active_segment_;
+  location.offset = active_segment_->size;
+  location.sequence = sequence;
+  location.length = static_cast<std::uint32_t>(content.size());
+  active_segment_->size += record.size();
+  // Still holding append_mutex_, so that a rollover can't make this segment a compaction candidate
+  // before the record is counted and indexed.
+  std::lock_guard<std::mutex> index_lock(index_mutex_);
+  active_segment_->live_bytes += RecordSize(location.length);
+  index(location);
+}
+
+void PackFileBackend::MarkDead(const Location& location) {
+  if (!WriteAt(location.segment->fd, &kDead, 1, location.offset + kFlagOffset))
+    LOG(kError) << "Failed to mark record dead in " << location.segment->path;
+  location.segment->unsynced = true;
+  location.segment->live_bytes -= RecordSize(location.length);
+  location.segment->dead_bytes += RecordSize(location.length);
+  if (location.segment->dead_bytes >= location.segment->live_bytes &&
+      location.segment->id != active_segment_id_) {
+    compaction_condition_.notify_one();
+  }
+}
+
+std::shared_ptr<PackFileBackend::Segment> PackFileBackend::CompactionCandidate() const {
+  for (const auto& segment : segments_) {
+    if (segment.first != active_segment_id_ && segment.second->dead_bytes != 0 &&
+        segment.second->dead_bytes >= segment.second->live_bytes) {
+      return segment.second;
+    }
+  }
+  return nullptr;
+}
+
+void PackFileBackend::CompactSegment(const std::shared_ptr<Segment>& segment) {
+  std::vector<std::pair<std::string, Location>> live_records;
+  {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (const auto& entry : index_) {
+      if (entry.second.segment == segment)
+        live_records.push_back(entry);
+    }
+  }
+
+  for (const auto& live_record : live_records) {
+    const Location& old_location(live_record.second);
+    std::vector<byte> content(old_location.length);
+    if (!ReadAt(segment->fd, content.data(), content.size(), old_location.offset + kHeaderSize)) {
+      LOG(kError) << "Failed to read record for compaction from " << segment->path;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+    Append(KeyToName(live_record.first), old_location.sequence, content,
+           [&](const Location& new_location) {
+             auto itr(index_.find(live_record.first));
+             if (itr != index_.end() && itr->second.segment == segment &&
+                 itr->second.offset == old_location.offset) {
+               itr->second = new_location;
+             } else {
+               // Deleted or overwritten while being copied.
+               MarkDead(new_location);
+             }
+           });
+  }
+
+  // The copies must be durable before the originals go.
+  Sync();
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  segments_.erase(segment->id);
+  boost::system::error_code error_code;
+  fs::remove(segment->path, error_code);
+  if (error_code)
+    LOG(kError) << "Failed to remove compacted " << segment->path << ": " << error_code.message();
+}
+
+void PackFileBackend::CompactionLoop() {
+  for (;;) {
+    std::shared_ptr<Segment> segment;
+    {
+      std::unique_lock<std::mutex> lock(index_mutex_);
+      compaction_condition_.wait(lock, [&] {
+        return stop_compaction_ || (segment = CompactionCandidate()) != nullptr;
+      });
+      if (stop_compaction_)
+        return;
+    }
+    try {
+      CompactSegment(segment);
+    } catch (const std::exception& e) {
+      // Retrying would just spin on the same segment, so compaction stops for this session.
+      LOG(kError) << "Compacting " << segment->path << " failed: "
+                  << boost::diagnostic_information(e);
+      return;
+    }
+  }
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,116 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_PACK_FILE_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_PACK_FILE_BACKEND_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store/backend.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Appends chunks to large segment files ("<id>.pack") rather than giving each its own file.  Every
+// record carries its name, so the in-memory index of name to (segment, offset, length) is rebuilt
+// by reading the segments back at startup.  Deleting or overwriting a chunk flags its old record
+// as dead in place; a background thread rewrites any segment which is mostly dead space into the
+// current segment and then removes it.  Uses POSIX file I/O.
+class PackFileBackend : public ChunkStoreBackend {
+ public:
+  static const std::uint64_t kDefaultMaxSegmentSize = 64 * 1024 * 1024;
+
+  explicit PackFileBackend(boost::filesystem::path disk_path,
+                           std::uint64_t max_segment_size = kDefaultMaxSegmentSize);
+  ~PackFileBackend() override;
+  PackFileBackend(const PackFileBackend&) = delete;
+  PackFileBackend(PackFileBackend&&) = delete;
+  PackFileBackend& operator=(const PackFileBackend&) = delete;
+  PackFileBackend& operator=(PackFileBackend&&) = delete;
+
+  std::uint64_t ScanUsage() const override;
+  std::uint64_t Size(const NameType& name) const override;
+  void Write(const NameType& name, const std::vector<byte>& content) override;
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override;
+  boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                               std::uint64_t length) const override;
+  std::uint64_t Remove(const NameType& name) override;
+  // Splits the names between the cursors by their last byte.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const override;
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const override;
+  // fdatasyncs each segment written to since the last Sync.
+  void Sync() override;
+  std::vector<std::size_t> LocalityOrder(const std::vector<NameType>& names) const override;
+
+  std::size_t SegmentCount() const;
+
+ private:
+  struct Segment;
+  class Cursor;
+  struct Location {
+    std::shared_ptr<Segment> segment;
+    std::uint64_t offset, sequence;
+    std::uint32_t length;
+  };
+  // Called with index_mutex_ held to index a record which has just been appended.
+  using IndexFunctor = std::function<void(const Location&)>;
+
+  void LoadSegment(const boost::filesystem::path& path, std::uint32_t id);
+  void Index(const std::string& key, const Location& location);
+  void Append(const NameType& name, std::uint64_t sequence, const std::vector<byte>& content,
+              const IndexFunctor& index);
+  void MarkDead(const Location& location);
+  std::shared_ptr<Segment> CompactionCandidate() const;
+  void CompactSegment(const std::shared_ptr<Segment>& segment);
+  void CompactionLoop();
+
+  const boost::filesystem::path kDiskPath_;
+  const std::uint64_t kMaxSegmentSize_;
+  mutable std::mutex index_mutex_;
+  // Ordered, so that name cursors can resume from the last name returned.
+  std::map<std::string, Location> index_;
+  std::map<std::uint32_t, std::shared_ptr<Segment>> segments_;
+  // Lock ordering is append_mutex_ before index_mutex_.
+  std::mutex append_mutex_;
+  std::shared_ptr<Segment> active_segment_;
+  std::atomic<std::uint32_t> active_segment_id_;
+  std::atomic<std::uint64_t> next_sequence_;
+  std::condition_variable compaction_condition_;
+  bool stop_compaction_;
+  std::thread compaction_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_PACK_FILE_BACKEND_H_
@@ -0,0 +1,595 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/striped_backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+std::int64_t Now() { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+// FNV-1a, so that a device's position in the ranking depends only on its root.
+std::uint64_t Salt(const std::string& root) {
+  std::uint64_t hash(14695981039346656037ULL);
+  for (char c : root) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The splitmix64 finaliser.
+std::uint64_t Mix(std::uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+}  // unnamed namespace
+
+const std::chrono::seconds StripedBackend::kRetryInterval(30);
+
+struct StripedBackend::DeviceState {
+  explicit DeviceState(Device device)
+      : root(std::move(device.root)),
+        capacity(device.capacity),
+        backend(std::move(device.backend)),
+        journal(std::move(device.metadata_dir)),
+        salt(Salt(root.string())),
+        usage(0),
+        reads(0),
+        writes(0),
+        bytes_read(0),
+        bytes_written(0),
+        errors(0),
+        failing_until(0),
+        stale_mutex(),
+        stale_names(),
+        has_stale_names(false) {}
+
+  // Atomically adds 'new_size - old_size' to the usage if that doesn't exceed the capacity.
+  bool Reserve(std::uint64_t old_size, std::uint64_t new_size) {
+    if (new_size <= old_size)
+      return true;
+    std::uint64_t required(new_size - old_size), current(usage.load());
+    do {
+      if (current + required > capacity)
+        return false;
+    } while (!usage.compare_exchange_weak(current, current + required));
+    return true;
+  }
+
+  void Release(std::uint64_t freed) { usage -= freed; }
+
+  const boost::filesystem::path root;
+  const std::uint64_t capacity;
+  const std::unique_ptr<ChunkStoreBackend> backend;
+  UsageJournal journal;
+  const std::uint64_t salt;
+  std::atomic<std::uint64_t> usage, reads, writes, bytes_read, bytes_written, errors;
+  // In steady_clock ticks.
+  std::atomic<std::int64_t> failing_until;
+  // Names written or removed elsewhere while the device was failing.
+  std::mutex stale_mutex;
+  std::set<NameType> stale_names;
+  std::atomic<bool> has_stale_names;
+};
+
+class StripedBackend::Cursor : public NameCursor {
+ public:
+  explicit Cursor(std::vector<std::unique_ptr<NameCursor>> device_cursors)
+      : device_cursors_(std::move(device_cursors)), current_(0) {}
+
+  boost::optional<NameType> Next() override {
+    for (; current_ < device_cursors_.size(); ++current_) {
+      if (auto name = device_cursors_[current_]->Next())
+        return name;
+    }
+    return boost::none;
+  }
+
+ private:
+  std::vector<std::unique_ptr<NameCursor>> device_cursors_;
+  std::size_t current_;
+};
+
+class StripedBackend::StreamWriter : public ChunkStoreBackend::ContentWriter {
+ public:
+  StreamWriter(StripedBackend& striped_backend, const NameType& name, std::size_t index)
+      : striped_backend_(striped_backend),
+        kName_(name),
+        kIndex_(index),
+        device_(*striped_backend.devices_[index]),
+        content_writer_(device_.backend->OpenWriter(name)),
+        size_(0),
+        committed_(false) {}
+
+  ~StreamWriter() override {
+    if (!committed_)
+      device_.Release(size_);
+  }
+
+  void Append(const std::vector<byte>& piece) override {
+    if (!device_.Reserve(0, piece.size())) {
+      LOG(kError) << "Device " << device_.root << " has no room for " << size_ + piece.size()
+                  << " bytes.";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+    }
+    size_ += piece.size();
+    try {
+      content_writer_->Append(piece);
+    } catch (const std::exception& error) {
+      striped_backend_.MarkFailing(device_, error);
+      throw;
+    }
+  }
+
+  void Commit() override {
+    // The holder may have changed since the writer was opened.
+    auto failing(striped_backend_.FailingDevices());
+    auto holder(striped_backend_.Find(kName_));
+    std::uint64_t old_size(holder && holder->device == kIndex_ ? holder->size : 0);
+    device_.journal.Begin(kName_, old_size);
+    try {
+      content_writer_->Commit();
+    } catch (const std::exception& error) {
+      striped_backend_.MarkFailing(device_, error);
+      throw;
+    }
+    committed_ = true;
+    // The whole of the new content was reserved, on top of the content it replaced.
+    device_.Release(old_size);
+    striped_backend_.FinishWrite(kName_, kIndex_, old_size, size_, holder, failing);
+  }
+
+ private:
+  StripedBackend& striped_backend_;
+  const NameType kName_;
+  const std::size_t kIndex_;
+  DeviceState& device_;
+  std::unique_ptr<ContentWriter> content_writer_;
+  std::uint64_t size_;
+  bool committed_;
+};
+
+StripedBackend::StripedBackend(std::vector<Device> devices,
+                               std::chrono::steady_clock::duration retry_interval)
+    : kRetryInterval_(retry_interval), devices_() {
+  if (devices.empty())
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  for (auto& device : devices)
+    devices_.emplace_back(new DeviceState(std::move(device)));
+
+  // Devices without a usable journal are scanned, and there's no point doing that one by one.
+  std::vector<std::future<void>> initialisations;
+  for (auto& device : devices_) {
+    DeviceState* state(device.get());
+    initialisations.push_back(std::async(std::launch::async, [state] {
+      auto recovery(state->journal.Recover());
+      if (recovery) {
+        std::int64_t usage(static_cast<std::int64_t>(recovery->usage));
+        for (const auto& intent : recovery->in_flight) {
+          usage += static_cast<std::int64_t>(state->backend->Size(intent.name)) -
+                   static_cast<std::int64_t>(intent.old_size);
+        }
+        state->usage = static_cast<std::uint64_t>(std::max(usage, std::int64_t(0)));
+      } else {
+        state->usage = state->backend->ScanUsage();
+      }
+      if (state->usage > state->capacity) {
+        LOG(kWarning) << "Device " << state->root << " holds " << state->usage.load()
+                      << " bytes, more than its capacity of " << state->capacity;
+      }
+      state->journal.Open(state->usage);
+    }));
+  }
+  for (auto& initialisation : initialisations)
+    initialisation.get();
+}
+
+StripedBackend::~StripedBackend() {}
+
+std::uint64_t StripedBackend::ScanUsage() const {
+  std::uint64_t usage(0);
+  for (const auto& device : devices_)
+    usage += device->usage;
+  return usage;
+}
+
+std::uint64_t StripedBackend::Size(const NameType& name) const {
+  auto holder(Find(name));
+  return holder ? holder->size : 0;
+}
+
+void StripedBackend::Write(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, true);
+}
+
+void StripedBackend::WriteUnsynced(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, false);
+}
+
+void StripedBackend::Write(const NameType& name, const std::vector<byte>& content, bool synced) {
+  // Taken first, so that a device which recovers part way through is still covered.
+  auto failing(FailingDevices());
+  auto holder(Find(name));
+  auto order(Rank(name, true));
+  // Overwrites stay where they are if they can.
+  if (holder) {
+    auto holder_itr(std::find(order.begin(), order.end(), holder->device));
+    std::rotate(order.begin(), holder_itr, holder_itr + 1);
+  }
+
+  bool full(false);
+  for (auto index : order) {
+    auto& device(*devices_[index]);
+    if (!Available(device))
+      continue;
+    std::uint64_t old_size(holder && holder->device == index ? holder->size : 0);
+    if (!device.Reserve(old_size, content.size())) {
+      full = true;
+      continue;
+    }
+    // A write which fails is left in the journal as in flight, so recovery checks it.
+    device.journal.Begin(name, old_size);
+    try {
+      if (synced)
+        device.backend->Write(name, content);
+      else
+        device.backend->WriteUnsynced(name, content);
+    } catch (const std::exception& error) {
+      device.Release(content.size() > old_size ? content.size() - old_size : 0);
+      MarkFailing(device, error);
+      continue;
+    }
+    if (content.size() < old_size)
+      device.Release(old_size - content.size());
+    FinishWrite(name, index, old_size, content.size(), holder, failing);
+    return;
+  }
+
+  if (full) {
+    LOG(kError) << "No device has room for " << content.size() << " bytes.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+  LOG(kError) << "No working device to write to.";
+  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+std::unique_ptr<ChunkStoreBackend::ContentWriter> StripedBackend::OpenWriter(
+    const NameType& name) {
+  auto holder(Find(name));
+  auto order(Rank(name, true));
+  if (holder) {
+    auto holder_itr(std::find(order.begin(), order.end(), holder->device));
+    std::rotate(order.begin(), holder_itr, holder_itr + 1);
+  }
+  for (auto index : order) {
+    auto& device(*devices_[index]);
+    if (!Available(device) || device.usage >= device.capacity)
+      continue;
+    try {
+      return std::unique_ptr<ContentWriter>(new StreamWriter(*this, name, index));
+    } catch (const std::exception& error) {
+      MarkFailing(device, error);
+    }
+  }
+  LOG(kError) << "No working device with room to write to.";
+  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+boost::optional<std::vector<byte>> StripedBackend::Read(const NameType& name) const {
+  for (auto index : Rank(name, false)) {
+    auto& device(*devices_[index]);
+    if (!Available(device))
+      continue;
+    try {
+      auto content(device.backend->Read(name));
+      if (content) {
+        ++device.reads;
+        device.bytes_read += content->size();
+        return content;
+      }
+    } catch (const std::exception& error) {
+      MarkFailing(device, error);
+    }
+  }
+  return boost::none;
+}
+
+boost::optional<std::vector<byte>> StripedBackend::ReadRange(const NameType& name,
+                                                             std::uint64_t offset,
+                                                             std::uint64_t length) const {
+  for (auto index : Rank(name, false)) {
+    auto& device(*devices_[index]);
+    if (!Available(device))
+      continue;
+    try {
+      auto content(device.backend->ReadRange(name, offset, length));
+      if (content) {
+        ++device.reads;
+        device.bytes_read += content->size();
+        return content;
+      }
+    } catch (const std::exception& error) {
+      MarkFailing(device, error);
+    }
+  }
+  return boost::none;
+}
+
+std::uint64_t StripedBackend::Remove(const NameType& name) {
+  auto failing(FailingDevices());
+  auto holder(Find(name));
+  if (!holder) {
+    LOG(kError) << "No working device holds " << name.name;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+  auto& device(*devices_[holder->device]);
+  device.journal.Begin(name, holder->size);
+  std::uint64_t size(0);
+  try {
+    size = device.backend->Remove(name);
+  } catch (const std::exception& error) {
+    MarkFailing(device, error);
+    throw;
+  }
+  device.Release(size);
+  device.journal.End(name, -static_cast<std::int64_t>(size));
+  MarkStale(name, failing, boost::none);
+  return size;
+}
+
+std::vector<std::unique_ptr<ChunkStoreBackend::NameCursor>> StripedBackend::Names(
+    const NameRange& range, std::uint32_t count) const {
+  std::vector<std::vector<std::unique_ptr<NameCursor>>> device_cursors(count);
+  for (const auto& device : devices_) {
+    if (!Available(*device))
+      continue;
+    auto cursors(device->backend->Names(range, count));
+    for (std::uint32_t i(0); i != count; ++i)
+      device_cursors[i].push_back(std::move(cursors[i]));
+  }
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (auto& cursor_set : device_cursors)
+    cursors.emplace_back(new Cursor(std::move(cursor_set)));
+  return cursors;
+}
+
+std::unique_ptr<ChunkStoreBackend::NameCursor> StripedBackend::NamesPart(
+    const NameRange& range, std::uint32_t part, std::uint32_t count) const {
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (const auto& device : devices_) {
+    if (Available(*device))
+      cursors.push_back(device->backend->NamesPart(range, part, count));
+  }
+  return std::unique_ptr<NameCursor>(new Cursor(std::move(cursors)));
+}
+
+void StripedBackend::DiscardIncompleteWrites(const std::vector<NameType>& names) {
+  for (auto& device : devices_)
+    device->backend->DiscardIncompleteWrites(names);
+}
+
+bool StripedBackend::ListsNames() const {
+  return std::all_of(devices_.begin(), devices_.end(),
+                     [](const std::unique_ptr<DeviceState>& device) {
+                       return device->backend->ListsNames();
+                     });
+}
+
+void StripedBackend::Sync() {
+  std::vector<std::pair<DeviceState*, std::future<void>>> syncs;
+  for (auto& device : devices_) {
+    if (!Available(*device))
+      continue;
+    ChunkStoreBackend* backend(device->backend.get());
+    syncs.emplace_back(device.get(), std::async(std::launch::async, [backend] {
+      backend->Sync();
+    }));
+  }
+  boost::optional<maidsafe_error> first_error;
+  for (auto& sync : syncs) {
+    try {
+      sync.second.get();
+    } catch (const std::exception& error) {
+      MarkFailing(*sync.first, error);
+      if (!first_error)
+        first_error = MakeError(CommonErrors::filesystem_io_error);
+    }
+  }
+  if (first_error)
+    BOOST_THROW_EXCEPTION(*first_error);
+}
+
+std::vector<std::size_t> StripedBackend::LocalityOrder(const std::vector<NameType>& names) const {
+  std::vector<std::vector<std::size_t>> by_device(devices_.size());
+  for (std::size_t i(0); i != names.size(); ++i)
+    by_device[Rank(names[i], false).front()].push_back(i);
+  std::vector<std::size_t> order;
+  order.reserve(names.size());
+  for (std::size_t device(0); device != devices_.size(); ++device) {
+    std::vector<NameType> device_names;
+    for (auto i : by_device[device])
+      device_names.push_back(names[i]);
+    for (auto i : devices_[device]->backend->LocalityOrder(device_names))
+      order.push_back(by_device[device][i]);
+  }
+  return order;
+}
+
+std::vector<StripedBackend::DeviceStatistics> StripedBackend::Statistics() const {
+  std::vector<DeviceStatistics> statistics;
+  for (const auto& device : devices_) {
+    statistics.push_back(DeviceStatistics{
+        device->root, device->capacity, device->usage.load(), device->reads.load(),
+        device->writes.load(), device->bytes_read.load(), device->bytes_written.load(),
+        device->errors.load(), Failing(*device)});
+  }
+  return statistics;
+}
+
+std::vector<std::size_t> StripedBackend::Rank(const NameType& name, bool by_free_space) const {
+  const auto& name_bytes(name.name.string());
+  std::uint64_t name_hash(static_cast<std::uint64_t>(name.type_id.data));
+  for (std::size_t i(0); i != sizeof(name_hash); ++i)
+    name_hash = (name_hash << 8) ^ static_cast<byte>(name_bytes[i]);
+
+  std::vector<std::pair<double, std::size_t>> scores;
+  scores.reserve(devices_.size());
+  for (std::size_t i(0); i != devices_.size(); ++i) {
+    const auto& device(*devices_[i]);
+    double weight(static_cast<double>(device.capacity));
+    if (by_free_space) {
+      std::uint64_t usage(device.usage.load());
+      weight = usage < device.capacity ? static_cast<double>(device.capacity - usage) : 0.0;
+    }
+    // A uniform value in (0, 1), from the top 53 bits of the combined hash.
+    double uniform((static_cast<double>(Mix(name_hash ^ device.salt) >> 11) + 0.5) /
+                   9007199254740992.0);
+    scores.emplace_back(-weight / std::log(uniform), i);
+  }
+  std::sort(scores.begin(), scores.end(),
+            [](const std::pair<double, std::size_t>& lhs,
+               const std::pair<double, std::size_t>& rhs) { return lhs.first > rhs.first; });
+  std::vector<std::size_t> order;
+  order.reserve(scores.size());
+  for (const auto& score : scores)
+    order.push_back(score.second);
+  return order;
+}
+
+void StripedBackend::FinishWrite(const NameType& name, std::size_t index, std::uint64_t old_size,
+                                 std::uint64_t size, const boost::optional<Holder>& holder,
+                                 const std::vector<std::size_t>& failing) {
+  auto& device(*devices_[index]);
+  device.journal.End(name, static_cast<std::int64_t>(size) - static_cast<std::int64_t>(old_size));
+  ++device.writes;
+  device.bytes_written += size;
+
+  if (holder && holder->device != index) {
+    auto& old_device(*devices_[holder->device]);
+    old_device.journal.Begin(name, holder->size);
+    try {
+      std::uint64_t removed(old_device.backend->Remove(name));
+      old_device.Release(removed);
+      old_device.journal.End(name, -static_cast<std::int64_t>(removed));
+    } catch (const std::exception& error) {
+      MarkFailing(old_device, error);
+    }
+  }
+  MarkStale(name, failing, index);
+}
+
+boost::optional<StripedBackend::Holder> StripedBackend::Find(const NameType& name) const {
+  for (auto index : Rank(name, false)) {
+    auto& device(*devices_[index]);
+    if (!Available(device))
+      continue;
+    try {
+      std::uint64_t size(device.backend->Size(name));
+      if (size != 0)
+        return Holder{index, size};
+    } catch (const std::exception& error) {
+      MarkFailing(device, error);
+    }
+  }
+  return boost::none;
+}
+
+bool StripedBackend::Failing(const DeviceState& device) const {
+  return device.failing_until.load() > Now();
+}
+
+bool StripedBackend::Available(DeviceState& device) const {
+  if (Failing(device))
+    return false;
+  return !device.has_stale_names || RemoveStaleCopies(device);
+}
+
+void StripedBackend::MarkFailing(DeviceState& device, const std::exception& error) const {
+  ++device.errors;
+  device.failing_until = Now() + kRetryInterval_.count();
+  LOG(kError) << "Device " << device.root << " failed, skipping it for "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(kRetryInterval_).count()
+              << "ms: " << boost::diagnostic_information(error);
+}
+
+std::vector<std::size_t> StripedBackend::FailingDevices() const {
+  std::vector<std::size_t> failing;
+  for (std::size_t i(0); i != devices_.size(); ++i) {
+    if (Failing(*devices_[i]))
+      failing.push_back(i);
+  }
+  return failing;
+}
+
+void StripedBackend::MarkStale(const NameType& name, const std::vector<std::size_t>& devices,
+                               boost::optional<std::size_t> holder) const {
+  for (std::size_t i(0); i != devices_.size(); ++i) {
+    auto& device(*devices_[i]);
+    if ((holder && *holder == i) ||
+        (!Failing(device) && std::find(devices.begin(), devices.end(), i) == devices.end())) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(device.stale_mutex);
+    device.stale_names.insert(name);
+    device.has_stale_names = true;
+  }
+}
+
+bool StripedBackend::RemoveStaleCopies(DeviceState& device) const {
+  // Operations wait here until the device is reconciled, rather than finding a stale copy.
+  std::lock_guard<std::mutex> lock(device.stale_mutex);
+  try {
+    while (!device.stale_names.empty()) {
+      const NameType& name(*device.stale_names.begin());
+      std::uint64_t size(device.backend->Size(name));
+      if (size != 0) {
+        device.journal.Begin(name, size);
+        std::uint64_t removed(device.backend->Remove(name));
+        device.Release(removed);
+        device.journal.End(name, -static_cast<std::int64_t>(removed));
+      }
+      device.stale_names.erase(device.stale_names.begin());
+    }
+  } catch (const std::exception& error) {
+    MarkFailing(device, error);
+    return false;
+  }
+  device.has_stale_names = false;
+  return true;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,147 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_STRIPED_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_STRIPED_BACKEND_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store/backend.h"
+#include "maidsafe/vault/chunk_store/usage_journal.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Spreads chunks over several devices, each with its own backend and capacity.  A chunk is
+// placed by rendezvous hashing its name against every device, with each device weighted by its
+// free space, so devices fill at the same rate in proportion to their capacity.  Lookups probe
+// the devices in the order given by weighting them by capacity instead; while the devices are
+// equally full (as placement keeps them) that is exactly the placement order, so the first probe
+// almost always finds the chunk.
+//
+// There is no lock shared between devices.  A device which runs out of space is skipped for new
+// chunks, and one which throws is treated as failing for the retry interval: it is skipped by all
+// operations, so chunks held by it can't be found until it recovers.  A chunk overwritten in that
+// time is written to another device, and may leave a stale copy on the failing one, as may a
+// chunk removed from another device.  Each name written or removed while a device is failing is
+// recorded against it, and before the device is used again any copies it holds of those names
+// are removed.
+class StripedBackend : public ChunkStoreBackend {
+ public:
+  struct Device {
+    boost::filesystem::path root;
+    // Where the device's usage journal is kept.
+    boost::filesystem::path metadata_dir;
+    std::uint64_t capacity;
+    std::unique_ptr<ChunkStoreBackend> backend;
+  };
+
+  struct DeviceStatistics {
+    boost::filesystem::path root;
+    std::uint64_t capacity, usage, reads, writes, bytes_read, bytes_written, errors;
+    bool failing;
+  };
+
+  static const std::chrono::seconds kRetryInterval;
+
+  explicit StripedBackend(std::vector<Device> devices,
+                          std::chrono::steady_clock::duration retry_interval = kRetryInterval);
+  ~StripedBackend() override;
+  StripedBackend(const StripedBackend&) = delete;
+  StripedBackend(StripedBackend&&) = delete;
+  StripedBackend& operator=(const StripedBackend&) = delete;
+  StripedBackend& operator=(StripedBackend&&) = delete;
+
+  // The sum of the devices' usage, each recovered from its own journal where possible.  Only the
+  // chunks in flight when a device's journal was last written are checked.
+  std::uint64_t ScanUsage() const override;
+  std::uint64_t Size(const NameType& name) const override;
+  // Throws cannot_exceed_limit if no working device has room for the content.
+  void Write(const NameType& name, const std::vector<byte>& content) override;
+  void WriteUnsynced(const NameType& name, const std::vector<byte>& content) override;
+  // Forwards to a writer on the device an overwrite or a small write would go to, since the size
+  // isn't known until Commit.  Space on that device is reserved as the pieces are appended, and
+  // Append throws cannot_exceed_limit once it runs out.
+  std::unique_ptr<ContentWriter> OpenWriter(const NameType& name) override;
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override;
+  boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                               std::uint64_t length) const override;
+  std::uint64_t Remove(const NameType& name) override;
+  // Each cursor walks its share of every device in turn.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const override;
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const override;
+  bool ListsNames() const override;
+  void DiscardIncompleteWrites(const std::vector<NameType>& names) override;
+  // Syncs the devices in parallel, then throws the first failure, if any.
+  void Sync() override;
+  // Groups the names by the device probed first, in that device's own order.
+  std::vector<std::size_t> LocalityOrder(const std::vector<NameType>& names) const override;
+
+  std::vector<DeviceStatistics> Statistics() const;
+
+ private:
+  struct DeviceState;
+  class Cursor;
+  class StreamWriter;
+  struct Holder {
+    std::size_t device;
+    std::uint64_t size;
+  };
+
+  // Device indices in descending order of rendezvous score, with each device weighted by its
+  // capacity ('by_free_space' false) or its remaining space.
+  std::vector<std::size_t> Rank(const NameType& name, bool by_free_space) const;
+  // Write, using the device's WriteUnsynced unless 'synced' is set.
+  void Write(const NameType& name, const std::vector<byte>& content, bool synced);
+  // Records 'size' bytes written over 'old_size' on device 'index', whose usage already accounts
+  // for them, then removes any copy the previous holder has elsewhere.
+  void FinishWrite(const NameType& name, std::size_t index, std::uint64_t old_size,
+                   std::uint64_t size, const boost::optional<Holder>& holder,
+                   const std::vector<std::size_t>& failing);
+  boost::optional<Holder> Find(const NameType& name) const;
+  bool Failing(const DeviceState& device) const;
+  // False while the device is failing.  Otherwise first removes any stale copies recorded against
+  // it, and is false if that fails.
+  bool Available(DeviceState& device) const;
+  void MarkFailing(DeviceState& device, const std::exception& error) const;
+  std::vector<std::size_t> FailingDevices() const;
+  // Records 'name' as stale on each of 'devices' and on any device failing now, except on the
+  // device at 'holder', which holds its current content.
+  void MarkStale(const NameType& name, const std::vector<std::size_t>& devices,
+                 boost::optional<std::size_t> holder) const;
+  // Returns false if the device failed.
+  bool RemoveStaleCopies(DeviceState& device) const;
+
+  const std::chrono::steady_clock::duration kRetryInterval_;
+  std::vector<std::unique_ptr<DeviceState>> devices_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_STRIPED_BACKEND_H_
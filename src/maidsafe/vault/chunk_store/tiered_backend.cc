@@ -0,0 +1,642 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/tiered_backend.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Per stripe, so up to 64 times this many names' slow tier reads are remembered.
+const std::size_t kMaxTrackedReads(1024);
+const std::size_t kMaxPromotionCandidates(4096);
+
+}  // unnamed namespace
+
+const double TieredBackend::kHighWatermark(0.9);
+const double TieredBackend::kLowWatermark(0.75);
+const std::uint32_t TieredBackend::kPromotionReads(2);
+const std::chrono::seconds TieredBackend::kMoveInterval(10);
+
+struct TieredBackend::TierState {
+  explicit TierState(Tier tier)
+      : root(std::move(tier.root)),
+        capacity(tier.capacity),
+        backend(std::move(tier.backend)),
+        journal(std::move(tier.metadata_dir)),
+        usage(0),
+        reads(0),
+        bytes_read(0),
+        moves_in(0),
+        bytes_moved_in(0),
+        moves_out(0),
+        bytes_moved_out(0) {}
+
+  // Atomically adds 'new_size - old_size' to the usage if that doesn't exceed the capacity.
+  bool Reserve(std::uint64_t old_size, std::uint64_t new_size) {
+    if (new_size <= old_size)
+      return true;
+    std::uint64_t required(new_size - old_size), current(usage.load());
+    do {
+      if (current + required > capacity)
+        return false;
+    } while (!usage.compare_exchange_weak(current, current + required));
+    return true;
+  }
+
+  void Release(std::uint64_t freed) { usage -= freed; }
+
+  std::uint64_t Watermark(double fraction) const {
+    return static_cast<std::uint64_t>(static_cast<double>(capacity) * fraction);
+  }
+
+  const boost::filesystem::path root;
+  const std::uint64_t capacity;
+  const std::unique_ptr<ChunkStoreBackend> backend;
+  UsageJournal journal;
+  std::atomic<std::uint64_t> usage, reads, bytes_read, moves_in, bytes_moved_in, moves_out,
+      bytes_moved_out;
+};
+
+class TieredBackend::Cursor : public NameCursor {
+ public:
+  Cursor(const TieredBackend& tiered_backend, std::unique_ptr<NameCursor> fast_cursor,
+         std::unique_ptr<NameCursor> slow_cursor)
+      : tiered_backend_(tiered_backend),
+        fast_cursor_(std::move(fast_cursor)),
+        slow_cursor_(std::move(slow_cursor)) {}
+
+  ~Cursor() override { tiered_backend_.CursorClosed(); }
+
+  boost::optional<NameType> Next() override {
+    if (fast_cursor_) {
+      if (auto name = fast_cursor_->Next())
+        return name;
+      fast_cursor_.reset();
+    }
+    return slow_cursor_->Next();
+  }
+
+ private:
+  const TieredBackend& tiered_backend_;
+  std::unique_ptr<NameCursor> fast_cursor_, slow_cursor_;
+};
+
+class TieredBackend::StreamWriter : public ChunkStoreBackend::ContentWriter {
+ public:
+  StreamWriter(TieredBackend& tiered_backend, const NameType& name, TierState& target)
+      : tiered_backend_(tiered_backend),
+        kName_(name),
+        target_(target),
+        content_writer_(target.backend->OpenWriter(name)),
+        size_(0),
+        committed_(false) {}
+
+  ~StreamWriter() override {
+    if (!committed_)
+      target_.Release(size_);
+  }
+
+  void Append(const std::vector<byte>& piece) override {
+    if (!target_.Reserve(0, piece.size())) {
+      LOG(kError) << "Tier " << target_.root << " has no room for " << size_ + piece.size()
+                  << " bytes.";
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+    }
+    size_ += piece.size();
+    content_writer_->Append(piece);
+  }
+
+  void Commit() override {
+    std::lock_guard<std::mutex> lock(tiered_backend_.GetStripe(kName_).mutex);
+    TierState& other(&target_ == tiered_backend_.fast_.get() ? *tiered_backend_.slow_
+                                                             : *tiered_backend_.fast_);
+    std::uint64_t old_size(target_.backend->Size(kName_)), other_size(other.backend->Size(kName_));
+    // As for Write, both intents are logged before anything changes.
+    target_.journal.Begin(kName_, old_size);
+    if (other_size != 0)
+      other.journal.Begin(kName_, other_size);
+    content_writer_->Commit();
+    committed_ = true;
+    // The whole of the new content was reserved, on top of the content it replaced.
+    target_.Release(old_size);
+    tiered_backend_.FinishWrite(target_, kName_, old_size, size_, other_size);
+  }
+
+ private:
+  TieredBackend& tiered_backend_;
+  const NameType kName_;
+  TierState& target_;
+  std::unique_ptr<ContentWriter> content_writer_;
+  std::uint64_t size_;
+  bool committed_;
+};
+
+TieredBackend::TieredBackend(Tier fast_tier, Tier slow_tier,
+                             std::chrono::steady_clock::duration move_interval)
+    : fast_(new TierState(std::move(fast_tier))),
+      slow_(new TierState(std::move(slow_tier))),
+      kMoveInterval_(move_interval),
+      stripes_(),
+      access_clock_(0),
+      promotion_mutex_(),
+      promotion_candidates_(),
+      move_mutex_(),
+      open_cursors_(0),
+      mover_mutex_(),
+      mover_condition_(),
+      stop_mover_(false),
+      mover_wanted_(false),
+      mover_thread_() {
+  std::set<NameType> in_flight;
+  for (TierState* tier : {fast_.get(), slow_.get()}) {
+    auto recovery(tier->journal.Recover());
+    if (recovery) {
+      std::int64_t usage(static_cast<std::int64_t>(recovery->usage));
+      for (const auto& intent : recovery->in_flight) {
+        usage += static_cast<std::int64_t>(tier->backend->Size(intent.name)) -
+                 static_cast<std::int64_t>(intent.old_size);
+        in_flight.insert(intent.name);
+      }
+      tier->usage = static_cast<std::uint64_t>(std::max(usage, std::int64_t(0)));
+    } else {
+      tier->usage = tier->backend->ScanUsage();
+    }
+    if (tier->usage > tier->capacity) {
+      LOG(kWarning) << "Tier " << tier->root << " holds " << tier->usage.load()
+                    << " bytes, more than its capacity of " << tier->capacity;
+    }
+    tier->journal.Open(tier->usage);
+  }
+
+  // A crash part way through a move, or through an overwrite which changes tier, can leave both
+  // tiers holding the chunk.  The fast tier's copy is kept.
+  for (const auto& name : in_flight) {
+    std::uint64_t slow_size(slow_->backend->Size(name));
+    if (slow_size == 0 || fast_->backend->Size(name) == 0)
+      continue;
+    slow_->journal.Begin(name, slow_size);
+    CompleteRemoval(*slow_, name);
+  }
+
+  if (kMoveInterval_ != std::chrono::steady_clock::duration::zero())
+    mover_thread_ = std::thread([this] { MoverLoop(); });
+}
+
+TieredBackend::~TieredBackend() {
+  {
+    std::lock_guard<std::mutex> lock(mover_mutex_);
+    stop_mover_ = true;
+  }
+  mover_condition_.notify_one();
+  if (mover_thread_.joinable())
+    mover_thread_.join();
+}
+
+std::uint64_t TieredBackend::ScanUsage() const { return fast_->usage + slow_->usage; }
+
+std::uint64_t TieredBackend::Size(const NameType& name) const {
+  std::uint64_t size(fast_->backend->Size(name));
+  if (size == 0)
+    size = slow_->backend->Size(name);
+  // A promotion writes to the fast tier before removing from the slow one, so if the chunk has
+  // just been promoted, it's on the fast tier now.
+  if (size == 0)
+    size = fast_->backend->Size(name);
+  return size;
+}
+
+void TieredBackend::Write(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, true);
+}
+
+void TieredBackend::WriteUnsynced(const NameType& name, const std::vector<byte>& content) {
+  Write(name, content, false);
+}
+
+void TieredBackend::Write(const NameType& name, const std::vector<byte>& content, bool synced) {
+  std::lock_guard<std::mutex> lock(GetStripe(name).mutex);
+  std::uint64_t fast_size(fast_->backend->Size(name)), slow_size(slow_->backend->Size(name));
+  bool to_fast(fast_->Reserve(fast_size, content.size()));
+  if (!to_fast && !slow_->Reserve(slow_size, content.size())) {
+    LOG(kError) << "Neither tier has room for " << content.size() << " bytes.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+  TierState& target(to_fast ? *fast_ : *slow_);
+  TierState& other(to_fast ? *slow_ : *fast_);
+  std::uint64_t old_size(to_fast ? fast_size : slow_size);
+  std::uint64_t other_size(to_fast ? slow_size : fast_size);
+
+  // Both intents are logged before anything changes, so that a crash which leaves the chunk on
+  // both tiers is found at startup.  A write which fails is left in flight.
+  target.journal.Begin(name, old_size);
+  if (other_size != 0)
+    other.journal.Begin(name, other_size);
+  try {
+    if (synced)
+      target.backend->Write(name, content);
+    else
+      target.backend->WriteUnsynced(name, content);
+  } catch (const std::exception&) {
+    target.Release(content.size() > old_size ? content.size() - old_size : 0);
+    throw;
+  }
+  if (content.size() < old_size)
+    target.Release(old_size - content.size());
+  FinishWrite(target, name, old_size, content.size(), other_size);
+}
+
+std::unique_ptr<ChunkStoreBackend::ContentWriter> TieredBackend::OpenWriter(
+    const NameType& name) {
+  return std::unique_ptr<ContentWriter>(
+      new StreamWriter(*this, name, fast_->usage < fast_->capacity ? *fast_ : *slow_));
+}
+
+boost::optional<std::vector<byte>> TieredBackend::Read(const NameType& name) const {
+  auto content(fast_->backend->Read(name));
+  if (!content) {
+    content = slow_->backend->Read(name);
+    if (content) {
+      ++slow_->reads;
+      slow_->bytes_read += content->size();
+      RecordSlowRead(name);
+      return content;
+    }
+    // As for Size, the chunk may have just been promoted.
+    content = fast_->backend->Read(name);
+  }
+  if (content) {
+    ++fast_->reads;
+    fast_->bytes_read += content->size();
+    RecordFastAccess(name);
+  }
+  return content;
+}
+
+boost::optional<std::vector<byte>> TieredBackend::ReadUntracked(const NameType& name) const {
+  auto content(fast_->backend->ReadUntracked(name));
+  if (!content)
+    content = slow_->backend->ReadUntracked(name);
+  if (!content)
+    content = fast_->backend->ReadUntracked(name);
+  return content;
+}
+
+boost::optional<std::vector<byte>> TieredBackend::ReadRange(const NameType& name,
+                                                            std::uint64_t offset,
+                                                            std::uint64_t length) const {
+  auto content(fast_->backend->ReadRange(name, offset, length));
+  if (!content) {
+    content = slow_->backend->ReadRange(name, offset, length);
+    if (content) {
+      ++slow_->reads;
+      slow_->bytes_read += content->size();
+      RecordSlowRead(name);
+      return content;
+    }
+    content = fast_->backend->ReadRange(name, offset, length);
+  }
+  if (content) {
+    ++fast_->reads;
+    fast_->bytes_read += content->size();
+    RecordFastAccess(name);
+  }
+  return content;
+}
+
+std::uint64_t TieredBackend::Remove(const NameType& name) {
+  std::lock_guard<std::mutex> lock(GetStripe(name).mutex);
+  std::uint64_t fast_size(fast_->backend->Size(name)), slow_size(slow_->backend->Size(name));
+  if (fast_size == 0 && slow_size == 0) {
+    LOG(kError) << "Neither tier holds " << name.name;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+  }
+  if (fast_size != 0)
+    fast_->journal.Begin(name, fast_size);
+  if (slow_size != 0)
+    slow_->journal.Begin(name, slow_size);
+  std::uint64_t removed(0);
+  if (fast_size != 0)
+    removed = CompleteRemoval(*fast_, name);
+  if (slow_size != 0) {
+    std::uint64_t slow_removed(CompleteRemoval(*slow_, name));
+    if (fast_size == 0)
+      removed = slow_removed;
+  }
+  ForgetAccess(name);
+  return removed;
+}
+
+std::vector<std::unique_ptr<ChunkStoreBackend::NameCursor>> TieredBackend::Names(
+    const NameRange& range, std::uint32_t count) const {
+  std::lock_guard<std::mutex> lock(move_mutex_);
+  auto fast_cursors(fast_->backend->Names(range, count));
+  auto slow_cursors(slow_->backend->Names(range, count));
+  std::vector<std::unique_ptr<NameCursor>> cursors;
+  for (std::uint32_t i(0); i != count; ++i) {
+    cursors.emplace_back(
+        new Cursor(*this, std::move(fast_cursors[i]), std::move(slow_cursors[i])));
+    ++open_cursors_;
+  }
+  return cursors;
+}
+
+std::unique_ptr<ChunkStoreBackend::NameCursor> TieredBackend::NamesPart(
+    const NameRange& range, std::uint32_t part, std::uint32_t count) const {
+  std::lock_guard<std::mutex> lock(move_mutex_);
+  std::unique_ptr<NameCursor> cursor(new Cursor(*this,
+                                                fast_->backend->NamesPart(range, part, count),
+                                                slow_->backend->NamesPart(range, part, count)));
+  ++open_cursors_;
+  return cursor;
+}
+
+bool TieredBackend::ListsNames() const {
+  return fast_->backend->ListsNames() && slow_->backend->ListsNames();
+}
+
+void TieredBackend::Sync() {
+  fast_->backend->Sync();
+  slow_->backend->Sync();
+}
+
+void TieredBackend::DiscardIncompleteWrites(const std::vector<NameType>& names) {
+  fast_->backend->DiscardIncompleteWrites(names);
+  slow_->backend->DiscardIncompleteWrites(names);
+}
+
+std::vector<std::size_t> TieredBackend::LocalityOrder(const std::vector<NameType>& names) const {
+  return slow_->backend->LocalityOrder(names);
+}
+
+void TieredBackend::MoveChunks() {
+  std::lock_guard<std::mutex> lock(move_mutex_);
+  if (open_cursors_ != 0)
+    return;
+  Demote();
+  Promote();
+}
+
+std::vector<TieredBackend::TierStatistics> TieredBackend::Statistics() const {
+  std::vector<TierStatistics> statistics;
+  for (const TierState* tier : {fast_.get(), slow_.get()}) {
+    statistics.push_back(TierStatistics{
+        tier->root, tier->capacity, tier->usage.load(), tier->reads.load(),
+        tier->bytes_read.load(), tier->moves_in.load(), tier->bytes_moved_in.load(),
+        tier->moves_out.load(), tier->bytes_moved_out.load()});
+  }
+  return statistics;
+}
+
+std::string TieredBackend::Key(const NameType& name) {
+  const auto& name_bytes(name.name.string());
+  std::string key(name_bytes.begin(), name_bytes.end());
+  key.append(reinterpret_cast<const char*>(&name.type_id.data), sizeof(name.type_id.data));
+  return key;
+}
+
+TieredBackend::Stripe& TieredBackend::GetStripe(const NameType& name) const {
+  // Names are hashes, so their first bytes are already evenly distributed.
+  const auto& name_bytes(name.name.string());
+  return stripes_[(name_bytes[0] + name.type_id.data) % stripes_.size()];
+}
+
+std::vector<std::unique_lock<std::mutex>> TieredBackend::LockStripes(
+    const std::vector<NameType>& names) const {
+  std::set<Stripe*> stripes;
+  for (const auto& name : names)
+    stripes.insert(&GetStripe(name));
+  std::vector<std::unique_lock<std::mutex>> locks;
+  for (auto stripe : stripes)
+    locks.emplace_back(stripe->mutex);
+  return locks;
+}
+
+void TieredBackend::RecordFastAccess(const NameType& name) const {
+  Stripe& stripe(GetStripe(name));
+  std::lock_guard<std::mutex> lock(stripe.access_mutex);
+  stripe.last_access[Key(name)] = ++access_clock_;
+}
+
+void TieredBackend::RecordSlowRead(const NameType& name) const {
+  Stripe& stripe(GetStripe(name));
+  {
+    std::string key(Key(name));
+    std::lock_guard<std::mutex> lock(stripe.access_mutex);
+    if (stripe.slow_reads.size() >= kMaxTrackedReads)
+      stripe.slow_reads.clear();
+    if (++stripe.slow_reads[key] < kPromotionReads)
+      return;
+    stripe.slow_reads.erase(key);
+  }
+  std::lock_guard<std::mutex> lock(promotion_mutex_);
+  if (promotion_candidates_.size() < kMaxPromotionCandidates)
+    promotion_candidates_.insert(name);
+}
+
+void TieredBackend::ForgetAccess(const NameType& name) const {
+  Stripe& stripe(GetStripe(name));
+  std::string key(Key(name));
+  std::lock_guard<std::mutex> lock(stripe.access_mutex);
+  stripe.last_access.erase(key);
+  stripe.slow_reads.erase(key);
+}
+
+void TieredBackend::FinishWrite(TierState& target, const NameType& name, std::uint64_t old_size,
+                                std::uint64_t size, std::uint64_t other_size) {
+  target.journal.End(name, static_cast<std::int64_t>(size) - static_cast<std::int64_t>(old_size));
+  if (other_size != 0)
+    CompleteRemoval(&target == fast_.get() ? *slow_ : *fast_, name);
+
+  if (&target == fast_.get()) {
+    RecordFastAccess(name);
+  } else {
+    ForgetAccess(name);
+  }
+  if (fast_->usage > fast_->Watermark(kHighWatermark)) {
+    std::lock_guard<std::mutex> mover_lock(mover_mutex_);
+    mover_wanted_ = true;
+    mover_condition_.notify_one();
+  }
+}
+
+std::uint64_t TieredBackend::CompleteRemoval(TierState& tier, const NameType& name) {
+  std::uint64_t removed(tier.backend->Remove(name));
+  tier.Release(removed);
+  tier.journal.End(name, -static_cast<std::int64_t>(removed));
+  return removed;
+}
+
+std::size_t TieredBackend::Move(TierState& from, TierState& to, const std::vector<NameType>& names,
+                                std::uint64_t limit) {
+  auto locks(LockStripes(names));
+  std::vector<std::pair<NameType, std::uint64_t>> copies;
+  for (const auto& name : names) {
+    // Removed or overwritten since it was chosen.
+    if (to.backend->Size(name) != 0)
+      continue;
+    auto content(from.backend->Read(name));
+    if (!content)
+      continue;
+    std::uint64_t size(content->size());
+    if (to.usage + size > limit || !to.Reserve(0, size))
+      break;
+    from.journal.Begin(name, size);
+    to.journal.Begin(name, 0);
+    try {
+      // Synced below, before the originals are removed.
+      to.backend->WriteUnsynced(name, *content);
+    } catch (const std::exception& error) {
+      LOG(kError) << "Failed to copy " << name.name << " to " << to.root << ": "
+                  << boost::diagnostic_information(error);
+      to.Release(size);
+      from.journal.End(name, 0);
+      break;
+    }
+    to.journal.End(name, static_cast<std::int64_t>(size));
+    copies.emplace_back(name, size);
+  }
+  if (copies.empty())
+    return 0;
+
+  // The copies must be durable before the originals are removed.
+  try {
+    to.backend->Sync();
+  } catch (const std::exception& error) {
+    LOG(kError) << "Failed to sync " << to.root << ": " << boost::diagnostic_information(error);
+    for (const auto& copy : copies) {
+      try {
+        to.journal.Begin(copy.first, copy.second);
+        CompleteRemoval(to, copy.first);
+        from.journal.End(copy.first, 0);
+      } catch (const std::exception& error) {
+        LOG(kError) << "Failed to remove copy of " << copy.first.name << ": "
+                    << boost::diagnostic_information(error);
+      }
+    }
+    return 0;
+  }
+
+  std::size_t moved(0);
+  for (const auto& copy : copies) {
+    try {
+      CompleteRemoval(from, copy.first);
+    } catch (const std::exception& error) {
+      // Left in flight, so that the duplicate is removed at the next startup.
+      LOG(kError) << "Failed to remove " << copy.first.name << " from " << from.root << ": "
+                  << boost::diagnostic_information(error);
+      continue;
+    }
+    ++moved;
+    ++to.moves_in;
+    to.bytes_moved_in += copy.second;
+    ++from.moves_out;
+    from.bytes_moved_out += copy.second;
+    ForgetAccess(copy.first);
+    if (&to == fast_.get())
+      RecordFastAccess(copy.first);
+  }
+  return moved;
+}
+
+void TieredBackend::Demote() {
+  const std::uint64_t kHigh(fast_->Watermark(kHighWatermark));
+  const std::uint64_t kLow(fast_->Watermark(kLowWatermark));
+  if (fast_->usage <= kHigh)
+    return;
+  // Least recently used first; chunks not accessed since startup come before all others.
+  std::vector<std::pair<std::uint64_t, NameType>> candidates;
+  auto cursor(std::move(fast_->backend->Names(NameRange(), 1).front()));
+  while (auto name = cursor->Next()) {
+    Stripe& stripe(GetStripe(*name));
+    std::lock_guard<std::mutex> lock(stripe.access_mutex);
+    auto itr(stripe.last_access.find(Key(*name)));
+    candidates.emplace_back(itr == stripe.last_access.end() ? 0 : itr->second, *name);
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<std::uint64_t, NameType>& lhs,
+               const std::pair<std::uint64_t, NameType>& rhs) { return lhs.first < rhs.first; });
+
+  std::vector<NameType> chosen;
+  std::uint64_t excess(fast_->usage - kLow);
+  for (const auto& candidate : candidates) {
+    if (excess == 0)
+      break;
+    std::uint64_t size(fast_->backend->Size(candidate.second));
+    chosen.push_back(candidate.second);
+    excess -= std::min(excess, size);
+  }
+  for (std::size_t i(0); i < chosen.size(); i += kMoveBatchSize) {
+    std::size_t end(std::min(i + kMoveBatchSize, chosen.size()));
+    std::vector<NameType> batch(chosen.begin() + i, chosen.begin() + end);
+    if (Move(*fast_, *slow_, batch, slow_->capacity) == 0)
+      return;
+  }
+}
+
+void TieredBackend::Promote() {
+  std::vector<NameType> candidates;
+  {
+    std::lock_guard<std::mutex> lock(promotion_mutex_);
+    candidates.assign(promotion_candidates_.begin(), promotion_candidates_.end());
+    promotion_candidates_.clear();
+  }
+  // Promotions stop short of the high watermark, so they don't trigger demotions.
+  const std::uint64_t kLimit(fast_->Watermark(kLowWatermark));
+  for (std::size_t i(0); i < candidates.size() && fast_->usage < kLimit; i += kMoveBatchSize) {
+    std::size_t end(std::min(i + kMoveBatchSize, candidates.size()));
+    std::vector<NameType> batch(candidates.begin() + i, candidates.begin() + end);
+    Move(*slow_, *fast_, batch, kLimit);
+  }
+}
+
+void TieredBackend::MoverLoop() {
+  std::unique_lock<std::mutex> lock(mover_mutex_);
+  while (!stop_mover_) {
+    mover_condition_.wait_for(lock, kMoveInterval_,
+                              [this] { return stop_mover_ || mover_wanted_; });
+    if (stop_mover_)
+      return;
+    mover_wanted_ = false;
+    lock.unlock();
+    try {
+      MoveChunks();
+    } catch (const std::exception& error) {
+      LOG(kError) << "Failed moving chunks between tiers: " << boost::diagnostic_information(error);
+    }
+    lock.lock();
+  }
+}
+
+void TieredBackend::CursorClosed() const {
+  std::lock_guard<std::mutex> lock(move_mutex_);
+  --open_cursors_;
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
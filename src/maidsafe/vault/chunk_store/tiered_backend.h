@@ -0,0 +1,180 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_TIERED_BACKEND_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_TIERED_BACKEND_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/vault/chunk_store/backend.h"
+#include "maidsafe/vault/chunk_store/usage_journal.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Keeps chunks on a small fast tier (e.g. an SSD) and a large slow one (e.g. an HDD).  New chunks
+// are written to the fast tier while it has room.  A background mover demotes the least recently
+// used chunks to the slow tier once the fast tier is over kHighWatermark full, until it is under
+// kLowWatermark, and promotes chunks read kPromotionReads times from the slow tier while the fast
+// tier has room below kLowWatermark.  Reads try the fast tier first, so lookups are transparent.
+//
+// Access recency is only tracked in memory, so chunks not accessed since startup count as coldest.
+// A chunk being moved is briefly held by both tiers; every operation which can leave it like that
+// first logs an intent in both tiers' journals, so that at startup any duplicate left by a crash
+// is found and the slow tier's copy removed.  Moves are paused while a name cursor is open, so
+// cursors return each chunk exactly once.
+class TieredBackend : public ChunkStoreBackend {
+ public:
+  struct Tier {
+    boost::filesystem::path root;
+    // Where the tier's usage journal is kept.
+    boost::filesystem::path metadata_dir;
+    std::uint64_t capacity;
+    std::unique_ptr<ChunkStoreBackend> backend;
+  };
+
+  // Chunks moved in to a tier are promotions for the fast tier and demotions for the slow one.
+  struct TierStatistics {
+    boost::filesystem::path root;
+    std::uint64_t capacity, usage, reads, bytes_read, moves_in, bytes_moved_in, moves_out,
+        bytes_moved_out;
+  };
+
+  static const double kHighWatermark, kLowWatermark;
+  static const std::uint32_t kPromotionReads;
+  static const std::chrono::seconds kMoveInterval;
+
+  // A zero 'move_interval' disables the background mover, leaving moves to MoveChunks.
+  TieredBackend(Tier fast_tier, Tier slow_tier,
+                std::chrono::steady_clock::duration move_interval = kMoveInterval);
+  ~TieredBackend() override;
+  TieredBackend(const TieredBackend&) = delete;
+  TieredBackend(TieredBackend&&) = delete;
+  TieredBackend& operator=(const TieredBackend&) = delete;
+  TieredBackend& operator=(TieredBackend&&) = delete;
+
+  // The sum of the tiers' usage, each recovered from its own journal where possible.
+  std::uint64_t ScanUsage() const override;
+  std::uint64_t Size(const NameType& name) const override;
+  // Writes to the fast tier if it has room, otherwise to the slow tier.  Throws
+  // cannot_exceed_limit if neither has room.
+  void Write(const NameType& name, const std::vector<byte>& content) override;
+  void WriteUnsynced(const NameType& name, const std::vector<byte>& content) override;
+  // Forwards to a writer on the fast tier if it has any room left, otherwise on the slow tier,
+  // since the size isn't known until Commit.  Space on that tier is reserved as the pieces are
+  // appended, and Append throws cannot_exceed_limit once it runs out.
+  std::unique_ptr<ContentWriter> OpenWriter(const NameType& name) override;
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override;
+  // Neither counted in the statistics nor used to choose chunks to move.
+  boost::optional<std::vector<byte>> ReadUntracked(const NameType& name) const override;
+  boost::optional<std::vector<byte>> ReadRange(const NameType& name, std::uint64_t offset,
+                                               std::uint64_t length) const override;
+  std::uint64_t Remove(const NameType& name) override;
+  // Each cursor walks its share of the fast tier, then of the slow tier.
+  std::vector<std::unique_ptr<NameCursor>> Names(const NameRange& range,
+                                                 std::uint32_t count) const override;
+  std::unique_ptr<NameCursor> NamesPart(const NameRange& range, std::uint32_t part,
+                                        std::uint32_t count) const override;
+  bool ListsNames() const override;
+  void Sync() override;
+  void DiscardIncompleteWrites(const std::vector<NameType>& names) override;
+  // In the slow tier's order, since its seeks are the ones which matter.
+  std::vector<std::size_t> LocalityOrder(const std::vector<NameType>& names) const override;
+
+  // Runs one pass of the mover now, rather than waiting for the background one.  Does nothing
+  // while a name cursor is open.
+  void MoveChunks();
+  // The fast tier, then the slow tier.
+  std::vector<TierStatistics> Statistics() const;
+
+ private:
+  struct TierState;
+  class Cursor;
+  class StreamWriter;
+  struct Stripe {
+    Stripe() : mutex(), access_mutex(), last_access(), slow_reads() {}
+    // Serialises writes and removals against moves.
+    std::mutex mutex;
+    std::mutex access_mutex;
+    // For chunks on the fast tier, keyed by Key(name).
+    std::unordered_map<std::string, std::uint64_t> last_access;
+    // For chunks on the slow tier, cleared when it gets too big so that old reads are forgotten.
+    std::unordered_map<std::string, std::uint32_t> slow_reads;
+  };
+
+  static std::string Key(const NameType& name);
+  Stripe& GetStripe(const NameType& name) const;
+  std::vector<std::unique_lock<std::mutex>> LockStripes(const std::vector<NameType>& names) const;
+  // Write, using the tier's WriteUnsynced unless 'synced' is set.
+  void Write(const NameType& name, const std::vector<byte>& content, bool synced);
+  // Records 'size' bytes written over 'old_size' on 'target', whose usage already accounts for
+  // them, then removes the 'other_size' bytes the other tier holds, if any.  The intents must
+  // already be logged.
+  void FinishWrite(TierState& target, const NameType& name, std::uint64_t old_size,
+                   std::uint64_t size, std::uint64_t other_size);
+  void RecordFastAccess(const NameType& name) const;
+  void RecordSlowRead(const NameType& name) const;
+  void ForgetAccess(const NameType& name) const;
+  // Removes the copy of 'name' held by 'tier', whose intent has already been logged, and records
+  // the removal in the tier's usage and journal.
+  std::uint64_t CompleteRemoval(TierState& tier, const NameType& name);
+  // Copies each of 'names' from 'from' to 'to' while 'to' has room below 'limit', syncs 'to', then
+  // removes the originals.  Returns the number moved.
+  std::size_t Move(TierState& from, TierState& to, const std::vector<NameType>& names,
+                   std::uint64_t limit);
+  void Demote();
+  void Promote();
+  void MoverLoop();
+  void CursorClosed() const;
+
+  static const std::size_t kMoveBatchSize = 16;
+
+  std::unique_ptr<TierState> fast_, slow_;
+  const std::chrono::steady_clock::duration kMoveInterval_;
+  mutable std::array<Stripe, 64> stripes_;
+  mutable std::atomic<std::uint64_t> access_clock_;
+  mutable std::mutex promotion_mutex_;
+  mutable std::set<NameType> promotion_candidates_;
+  // Held for the whole of each mover pass.  Lock ordering is move_mutex_ before stripe mutexes.
+  mutable std::mutex move_mutex_;
+  mutable std::uint32_t open_cursors_;
+  std::mutex mover_mutex_;
+  std::condition_variable mover_condition_;
+  bool stop_mover_, mover_wanted_;
+  std::thread mover_thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_TIERED_BACKEND_H_
@@ -0,0 +1,286 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/usage_journal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/convert.h"
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Each log record is a type, a name and a value.  The first record of each log is kGeneration,
+// with the generation id as its value.
+const char kGeneration('S'), kBegin('B'), kEnd('E');
+const std::size_t kNameSize(identity_size), kTypeIdSize(sizeof(std::uint32_t)),
+    kRecordSize(1 + kNameSize + kTypeIdSize + sizeof(std::uint64_t));
+
+boost::optional<std::pair<std::uint64_t, std::uint64_t>> ReadSnapshot(const fs::path& path) {
+  std::ifstream snapshot(path.string());
+  std::uint64_t usage(0), generation_id(0);
+  if (!(snapshot >> usage >> generation_id))
+    return boost::none;
+  return std::make_pair(usage, generation_id);
+}
+
+struct Record {
+  char type;
+  Data::NameAndTypeId name;
+  std::uint64_t value;
+};
+
+boost::optional<Record> ReadRecord(std::ifstream& log) {
+  char buffer[kRecordSize];
+  if (!log.read(buffer, kRecordSize))
+    return boost::none;  // End of the log, or a record torn by a crash.
+  Record record;
+  record.type = buffer[0];
+  std::uint32_t type_id(0);
+  std::memcpy(&type_id, buffer + 1 + kNameSize, kTypeIdSize);
+  std::memcpy(&record.value, buffer + 1 + kNameSize + kTypeIdSize, sizeof(record.value));
+  if (record.type != kGeneration) {
+    record.name = Data::NameAndTypeId(
+        Identity(std::vector<byte>(buffer + 1, buffer + 1 + kNameSize)), DataTypeId(type_id));
+  }
+  return record;
+}
+
+}  // unnamed namespace
+
+const std::uint64_t UsageJournal::kDefaultMaxLogEntries;
+
+UsageJournal::UsageJournal(fs::path metadata_dir, std::uint64_t max_log_entries)
+    : kSnapshotPath_(metadata_dir / "usage"),
+      kLogPath_(metadata_dir / "usage.journal"),
+      kCleanMarkerPath_(metadata_dir / "clean"),
+      kMaxLogEntries_(max_log_entries),
+      usage_(0),
+      generation_id_(0),
+      log_entries_(0),
+      snapshot_written_hook_(),
+      in_flight_(),
+      log_(),
+      mutex_() {}
+
+UsageJournal::~UsageJournal() {
+  try {
+    Close();
+  } catch (const std::exception& e) {
+    LOG(kError) << "Failed to close usage journal: " << boost::diagnostic_information(e);
+  }
+}
+
+boost::optional<UsageJournal::Recovery> UsageJournal::Recover() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  boost::system::error_code error_code;
+  boost::optional<std::uint64_t> marker_generation_id;
+  if (fs::exists(kCleanMarkerPath_, error_code)) {
+    std::uint64_t generation_id(0);
+    std::ifstream marker(kCleanMarkerPath_.string());
+    if (marker >> generation_id)
+      marker_generation_id = generation_id;
+    marker.close();
+    // The marker must not outlive this recovery, otherwise a crash in the next session would look
+    // like a clean shutdown.
+    if (!fs::remove(kCleanMarkerPath_, error_code) || error_code) {
+      LOG(kError) << "Failed to remove " << kCleanMarkerPath_ << ": " << error_code.message();
+      return boost::none;
+    }
+  }
+
+  auto snapshot(ReadSnapshot(kSnapshotPath_));
+  if (!snapshot)
+    return boost::none;
+  std::ifstream log(kLogPath_.string(), std::ios::binary);
+  auto header(ReadRecord(log));
+  // A log from another generation is either older than the snapshot, and so already included in
+  // it, or belongs to a snapshot which was never written.
+  if (!header || header->type != kGeneration || header->value != snapshot->second) {
+    LOG(kWarning) << "Usage journal log doesn't match the snapshot.";
+    return boost::none;
+  }
+
+  std::int64_t usage(static_cast<std::int64_t>(snapshot->first));
+  std::map<NameType, std::uint64_t> in_flight;
+  while (auto record = ReadRecord(log)) {
+    if (record->type == kBegin) {
+      in_flight[record->name] = record->value;
+    } else if (record->type == kEnd) {
+      usage += static_cast<std::int64_t>(record->value);
+      in_flight.erase(record->name);
+    } else {
+      LOG(kWarning) << "Usage journal log is corrupt.";
+      return boost::none;
+    }
+  }
+  if (usage < 0) {
+    LOG(kWarning) << "Usage journal replayed to a negative usage.";
+    return boost::none;
+  }
+
+  Recovery recovery;
+  recovery.usage = static_cast<std::uint64_t>(usage);
+  recovery.clean = marker_generation_id && *marker_generation_id == snapshot->second;
+  for (const auto& intent : in_flight)
+    recovery.in_flight.push_back(Intent{intent.first, intent.second});
+  return recovery;
+}
+
+void UsageJournal::Open(std::uint64_t usage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  boost::system::error_code error_code;
+  fs::create_directories(kSnapshotPath_.parent_path(), error_code);
+  if (error_code) {
+    LOG(kError) << "Can't create " << kSnapshotPath_.parent_path() << ": "
+                << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  // Left by versions which logged bare deltas.
+  fs::remove(kSnapshotPath_.parent_path() / "usage.log", error_code);
+  usage_ = usage;
+  in_flight_.clear();
+  StartGeneration();
+}
+
+void UsageJournal::Begin(const NameType& name, std::uint64_t old_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!log_.is_open())
+    return;
+  in_flight_[name] = old_size;
+  ++log_entries_;
+  Append(kBegin, name, old_size);
+}
+
+void UsageJournal::End(const NameType& name, std::int64_t delta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!log_.is_open())
+    return;
+  in_flight_.erase(name);
+  usage_ += delta;
+  if (++log_entries_ > kMaxLogEntries_) {
+    try {
+      StartGeneration();
+    } catch (const maidsafe_error&) {
+      AbandonLog();
+    }
+  } else {
+    Append(kEnd, name, static_cast<std::uint64_t>(delta));
+  }
+}
+
+void UsageJournal::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!log_.is_open())
+    return;
+  log_.close();
+  if (!log_) {
+    LOG(kError) << "Failed writing " << kLogPath_ << "; next start will rescan.";
+    return;
+  }
+  if (!WriteFile(kCleanMarkerPath_, convert::ToByteVector(std::to_string(generation_id_))))
+    LOG(kError) << "Failed to write " << kCleanMarkerPath_ << "; next start will rescan.";
+}
+
+void UsageJournal::SetSnapshotWrittenHook(std::function<void()> hook) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshot_written_hook_ = std::move(hook);
+}
+
+void UsageJournal::StartGeneration() {
+  generation_id_ = (static_cast<std::uint64_t>(RandomUint32()) << 32) | RandomUint32();
+  WriteSnapshot();
+  if (snapshot_written_hook_)
+    snapshot_written_hook_();
+  OpenLog();
+}
+
+void UsageJournal::WriteSnapshot() {
+  fs::path temp_path(kSnapshotPath_.string() + ".tmp");
+  if (!WriteFile(temp_path, convert::ToByteVector(std::to_string(usage_) + ' ' +
+                                                  std::to_string(generation_id_)))) {
+    LOG(kError) << "Failed to write " << temp_path;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  boost::system::error_code error_code;
+  fs::rename(temp_path, kSnapshotPath_, error_code);
+  if (error_code) {
+    LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+void UsageJournal::OpenLog() {
+  // The old log is unlinked rather than truncated, so a stale handle to it can't corrupt the new
+  // one.
+  if (log_.is_open())
+    log_.close();
+  boost::system::error_code error_code;
+  fs::remove(kLogPath_, error_code);
+  log_.clear();
+  log_.open(kLogPath_.string(), std::ios::binary | std::ios::trunc);
+  if (!log_) {
+    LOG(kError) << "Failed to open " << kLogPath_;
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+  log_entries_ = 0;
+  Append(kGeneration, NameType(), generation_id_);
+  for (const auto& intent : in_flight_)
+    Append(kBegin, intent.first, intent.second);
+  if (!log_.is_open())
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+}
+
+void UsageJournal::Append(char type, const NameType& name, std::uint64_t value) {
+  char buffer[kRecordSize] = {};
+  buffer[0] = type;
+  if (type != kGeneration) {
+    const auto& name_bytes(name.name.string());
+    std::copy(name_bytes.begin(), name_bytes.end(), buffer + 1);
+    std::memcpy(buffer + 1 + kNameSize, &name.type_id.data, kTypeIdSize);
+  }
+  std::memcpy(buffer + 1 + kNameSize + kTypeIdSize, &value, sizeof(value));
+  // Flushed straight away, so that the record survives the process crashing.
+  if (!log_.write(buffer, kRecordSize).flush()) {
+    LOG(kError) << "Failed writing " << kLogPath_ << "; next start will rescan.";
+    AbandonLog();
+  }
+}
+
+void UsageJournal::AbandonLog() {
+  log_.close();
+  boost::system::error_code error_code;
+  fs::remove(kLogPath_, error_code);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,118 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_USAGE_JOURNAL_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_USAGE_JOURNAL_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+#include "boost/optional/optional.hpp"
+
+#include "maidsafe/common/data_types/data.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Keeps a ChunkStore's disk usage on disk as a snapshot plus an append-only log, so that a restart
+// doesn't need to rescan every chunk.  Each operation which changes what's held is logged twice:
+// Begin before it touches the disk, with the size held beforehand, and End once it's finished,
+// with the resulting change in usage.  Every record is flushed to the OS as it's made, so after a
+// crash the log still shows which operations finished and which were in flight, and only the
+// chunks for the latter need checking.  Records aren't synced, so after a power loss an End can
+// only be trusted because the backend made the operation durable before it was logged.
+//
+// Each snapshot and the log started with it are tagged with a fresh random generation id, both when
+// a session starts and whenever the log fills and is folded into a new snapshot.  Recover only
+// replays a log over the snapshot of its own generation, so a crash between writing a new snapshot
+// and starting its log leads to a rescan rather than the old log being counted twice.  Close
+// writes a clean-shutdown marker, which Recover reports and then consumes.
+class UsageJournal {
+ public:
+  using NameType = Data::NameAndTypeId;
+
+  struct Intent {
+    NameType name;
+    std::uint64_t old_size;
+  };
+
+  struct Recovery {
+    // Includes every operation which ended.
+    std::uint64_t usage;
+    bool clean;
+    // Operations which began but didn't end; each may or may not have changed what's held.
+    std::vector<Intent> in_flight;
+  };
+
+  // Once the log holds this many records, it is folded into a new snapshot.
+  static const std::uint64_t kDefaultMaxLogEntries = 1 << 16;
+
+  explicit UsageJournal(boost::filesystem::path metadata_dir,
+                        std::uint64_t max_log_entries = kDefaultMaxLogEntries);
+  ~UsageJournal();
+  UsageJournal(const UsageJournal&) = delete;
+  UsageJournal(UsageJournal&&) = delete;
+  UsageJournal& operator=(const UsageJournal&) = delete;
+  UsageJournal& operator=(UsageJournal&&) = delete;
+
+  // Replays the previous session's snapshot and log, or returns nothing if there's no usable
+  // journal (e.g. there was no previous session).
+  boost::optional<Recovery> Recover();
+  // Starts a new session: writes a snapshot of 'usage' and starts an empty log.
+  void Open(std::uint64_t usage);
+  // Operations on the same name mustn't overlap.
+  void Begin(const NameType& name, std::uint64_t old_size);
+  void End(const NameType& name, std::int64_t delta);
+  // Flushes the log and marks the session as cleanly closed.  Safe to call more than once.
+  void Close();
+  // Called after each snapshot is written and before its log is started, so that tests can see
+  // what a crash there would leave on disk.
+  void SetSnapshotWrittenHook(std::function<void()> hook);
+
+ private:
+  void WriteSnapshot();
+  // Starts a log holding the generation id and a Begin record for each operation in flight.
+  void OpenLog();
+  void Append(char type, const NameType& name, std::uint64_t value);
+  // Removes the log after a failure, so that the next Recover falls back to a rescan rather than
+  // trusting an incomplete log.
+  void AbandonLog();
+
+  // Picks a generation id for a new snapshot, then writes it and starts its log.
+  void StartGeneration();
+
+  const boost::filesystem::path kSnapshotPath_, kLogPath_, kCleanMarkerPath_;
+  const std::uint64_t kMaxLogEntries_;
+  std::uint64_t usage_, generation_id_, log_entries_;
+  std::function<void()> snapshot_written_hook_;
+  std::map<NameType, std::uint64_t> in_flight_;
+  std::ofstream log_;
+  std::mutex mutex_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_USAGE_JOURNAL_H_
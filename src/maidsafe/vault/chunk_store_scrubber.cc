@@ -0,0 +1,169 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store_scrubber.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "boost/exception/diagnostic_information.hpp"
+
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace {
+
+// Each pass lists the names one part of the store at a time, so that no cursor is held open for
+// long (an open cursor stops a tiered store from moving chunks between its tiers).
+const std::uint32_t kSegmentCount(256);
+
+}  // unnamed namespace
+
+const std::chrono::steady_clock::duration ChunkStoreScrubber::kPassInterval(
+    std::chrono::minutes(10));
+const std::chrono::steady_clock::duration ChunkStoreScrubber::kYieldInterval(
+    std::chrono::milliseconds(5));
+
+ChunkStoreScrubber::ChunkStoreScrubber(ChunkStore& chunk_store, std::uint64_t bytes_per_second,
+                                       std::function<void(const NameType&)> on_corruption)
+    : chunk_store_(chunk_store),
+      kOnCorruption_(std::move(on_corruption)),
+      mutex_(),
+      condition_(),
+      stop_(false),
+      bytes_per_second_(bytes_per_second),
+      budget_time_(std::chrono::steady_clock::now()),
+      statistics_(Statistics{0, 0, 0, 0}),
+      thread_() {
+  if (bytes_per_second == 0)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  thread_ = std::thread([this] { ScrubLoop(); });
+}
+
+ChunkStoreScrubber::~ChunkStoreScrubber() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+void ChunkStoreScrubber::SetBytesPerSecond(std::uint64_t bytes_per_second) {
+  if (bytes_per_second == 0)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_per_second_ = bytes_per_second;
+    // Any debt built up at the old rate is forgiven.
+    budget_time_ = std::min(budget_time_, std::chrono::steady_clock::now());
+  }
+  condition_.notify_all();
+}
+
+ChunkStoreScrubber::Statistics ChunkStoreScrubber::GetStatistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void ChunkStoreScrubber::ScrubLoop() {
+  for (;;) {
+    try {
+      if (!ScrubPass())
+        return;
+    } catch (const std::exception& e) {
+      LOG(kError) << "Chunk scrubbing pass failed: " << boost::diagnostic_information(e);
+    }
+    if (!WaitFor(kPassInterval))
+      return;
+  }
+}
+
+bool ChunkStoreScrubber::ScrubPass() {
+  for (std::uint32_t segment(0); segment != kSegmentCount; ++segment) {
+    std::vector<NameType> names;
+    {
+      auto cursor(chunk_store_.NamesPart(NameRange(), segment, kSegmentCount));
+      while (auto name = cursor->Next())
+        names.push_back(*name);
+    }
+    if (!Scrub(std::move(names)))
+      return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++statistics_.passes;
+  return true;
+}
+
+bool ChunkStoreScrubber::Scrub(std::vector<NameType> names) {
+  auto next(names.begin());
+  while (next != names.end()) {
+    std::vector<NameType> batch(next, next + std::min<std::ptrdiff_t>(kBatchSize,
+                                                                      names.end() - next));
+    auto results(chunk_store_.ScrubBatch(batch));
+    std::uint64_t bytes(0);
+    std::size_t checked(0);
+    for (; checked != results.size() && results[checked].checked; ++checked) {
+      bytes += results[checked].size;
+      if (results[checked].corrupt && kOnCorruption_)
+        kOnCorruption_(batch[checked]);
+    }
+    next += checked;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t i(0); i != checked; ++i) {
+        if (results[i].size != 0)
+          ++statistics_.chunks_checked;
+        if (results[i].corrupt)
+          ++statistics_.corrupt_chunks;
+      }
+      statistics_.bytes_checked += bytes;
+    }
+    // The store was busy before the whole batch was read.
+    if (checked != results.size() && !WaitFor(kYieldInterval))
+      return false;
+    if (!Throttle(bytes))
+      return false;
+  }
+  return true;
+}
+
+bool ChunkStoreScrubber::Throttle(std::uint64_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto kNow(std::chrono::steady_clock::now());
+  // Time spent idle doesn't build up credit for a later burst.
+  budget_time_ = std::max(budget_time_, kNow) +
+                 std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(static_cast<double>(bytes) /
+                                                   bytes_per_second_));
+  while (!stop_ && std::chrono::steady_clock::now() < budget_time_)
+    condition_.wait_until(lock, budget_time_);
+  return !stop_;
+}
+
+bool ChunkStoreScrubber::WaitFor(std::chrono::steady_clock::duration duration) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !condition_.wait_for(lock, duration, [this] { return stop_; });
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,95 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_CHUNK_STORE_SCRUBBER_H_
+#define MAIDSAFE_VAULT_CHUNK_STORE_SCRUBBER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "maidsafe/vault/chunk_store.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// Walks every chunk in a ChunkStore on a background thread, checking each with
+// ChunkStore::ScrubBatch, and repeats once the whole store has been covered.  Reads are paced so
+// that no more than 'bytes_per_second' of chunk content is read on average, and scrubbing backs off
+// while the store is serving other operations.  'on_corruption' is called, from the scrubbing
+// thread, with the name of each chunk quarantined.
+class ChunkStoreScrubber {
+ public:
+  using NameType = ChunkStore::NameType;
+
+  struct Statistics {
+    // Completed walks of the whole store.
+    std::uint64_t passes;
+    std::uint64_t chunks_checked, bytes_checked;
+    std::uint64_t corrupt_chunks;
+  };
+
+  static const std::chrono::steady_clock::duration kPassInterval;
+  // How long to back off for when the store is busy.
+  static const std::chrono::steady_clock::duration kYieldInterval;
+  static const std::size_t kBatchSize = 8;
+
+  ChunkStoreScrubber(ChunkStore& chunk_store, std::uint64_t bytes_per_second,
+                     std::function<void(const NameType&)> on_corruption);
+  ~ChunkStoreScrubber();
+  ChunkStoreScrubber(const ChunkStoreScrubber&) = delete;
+  ChunkStoreScrubber(ChunkStoreScrubber&&) = delete;
+  ChunkStoreScrubber& operator=(const ChunkStoreScrubber&) = delete;
+  ChunkStoreScrubber& operator=(ChunkStoreScrubber&&) = delete;
+
+  void SetBytesPerSecond(std::uint64_t bytes_per_second);
+  Statistics GetStatistics() const;
+
+ private:
+  void ScrubLoop();
+  // Returns false if stopped before the store was covered.
+  bool ScrubPass();
+  // Returns false if stopped before every name was checked.
+  bool Scrub(std::vector<NameType> names);
+  // Waits until reading another 'bytes' is within the budget.  Returns false if stopped first.
+  bool Throttle(std::uint64_t bytes);
+  // Returns false if stopped first.
+  bool WaitFor(std::chrono::steady_clock::duration duration);
+
+  ChunkStore& chunk_store_;
+  const std::function<void(const NameType&)> kOnCorruption_;
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_;
+  std::uint64_t bytes_per_second_;
+  // The time by which the bytes read so far are within the budget.
+  std::chrono::steady_clock::time_point budget_time_;
+  Statistics statistics_;
+  std::thread thread_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_CHUNK_STORE_SCRUBBER_H_
@@ -19,6 +19,13 @@
 #ifndef MAIDSAFE_VAULT_DATA_MANAGER_DATA_MANAGER_H_
 #define MAIDSAFE_VAULT_DATA_MANAGER_DATA_MANAGER_H_
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "maidsafe/common/types.h"
@@ -30,10 +37,24 @@ namespace maidsafe {
 
 namespace vault {
 
+// Churn is handled in the background by a fixed pool of workers.  For each pmid node which has
+// left, a worker walks the chunks it held, dropping it from their holders, asking new nodes to
+// copy any chunk left with fewer than Parameters::min_pmid_holders, and trimming any with more
+// than Parameters::max_pmid_holders.  Each chunk is a separate update, so foreground requests are
+// never held up for more than one.  Nodes joining don't change any record, since holders are only
+// chosen when a chunk is stored or re-replicated.
 template <typename FacadeType>
 class DataManager {
  public:
-  explicit DataManager(const boost::filesystem::path& vault_root_dir);
+  static const std::size_t kDefaultChurnWorkers = 2;
+
+  explicit DataManager(const boost::filesystem::path& vault_root_dir,
+                       std::size_t churn_workers = kDefaultChurnWorkers);
+  ~DataManager();
+  DataManager(const DataManager&) = delete;
+  DataManager(DataManager&&) = delete;
+  DataManager& operator=(const DataManager&) = delete;
+  DataManager& operator=(DataManager&&) = delete;
 
   template <typename DataType>
   routing::HandleGetReturn HandleGet(const routing::SourceAddress& from, const Identity& name);
@@ -47,38 +68,79 @@ class DataManager {
   HandlePutResponse(const Identity& name, const routing::DestinationAddress& from,
                     const maidsafe_error& return_code);
 
+  // 'difference' holds the nodes which joined, then those which left.  Queues the chunks held by
+  // those which left and returns without waiting for them to be handled.
   void HandleChurn(const routing::CloseGroupDifference& difference);
 
+  // Blocks until all queued churn has been handled.
+  void WaitForChurn();
+
+  // Stops the churn workers, abandoning any queued churn.  The facade should call this before
+  // destroying anything the workers call into.
+  void StopChurn();
+
  private:
+  struct ChurnedNode {
+    routing::Address pmid_node;
+    // Sorted.
+    std::shared_ptr<const std::vector<routing::Address>> departed;
+  };
+
   template <typename DataType>
   routing::HandlePutPostReturn Replicate(const Identity& name,
                                          const routing::DestinationAddress& exclude);
 
   void DownRank(const routing::DestinationAddress& /*address*/) {}
 
+  void ChurnLoop();
+  void HandleChurnedNode(const ChurnedNode& churned_node);
+  template <typename DataType>
+  void HandleChurnedChunk(const Identity& name, const std::vector<routing::Address>& departed);
+
   DataManagerDatabase db_;
-  routing::CloseGroupDifference close_group_;
+  std::mutex churn_mutex_;
+  std::condition_variable churn_condition_, churn_done_condition_;
+  std::deque<ChurnedNode> churn_queue_;
+  std::size_t active_churn_workers_;
+  bool stop_churn_;
+  std::vector<std::thread> churn_workers_;
 };
 
 template <typename FacadeType>
-DataManager<FacadeType>::DataManager(const boost::filesystem::path& vault_root_dir)
-    : db_(UniqueDbPath(vault_root_dir)) {}
+const std::size_t DataManager<FacadeType>::kDefaultChurnWorkers;
+
+template <typename FacadeType>
+DataManager<FacadeType>::DataManager(const boost::filesystem::path& vault_root_dir,
+                                     std::size_t churn_workers)
+    : db_(UniqueDbPath(vault_root_dir)),
+      churn_mutex_(),
+      churn_condition_(),
+      churn_done_condition_(),
+      churn_queue_(),
+      active_churn_workers_(0),
+      stop_churn_(false),
+      churn_workers_() {
+  for (std::size_t i(0); i < std::max(churn_workers, std::size_t(1)); ++i)
+    churn_workers_.emplace_back([this] { ChurnLoop(); });
+}
+
+template <typename FacadeType>
+DataManager<FacadeType>::~DataManager() {
+  StopChurn();
+}
 
 template <typename FacadeType>
 template <typename DataType>
 routing::HandlePutPostReturn DataManager<FacadeType>::HandlePut(
     const routing::SourceAddress& /*from*/, const DataType& data) {
-  if (!db_.Exist<DataType>(data.Name())) {
-     auto pmid_addresses(static_cast<FacadeType*>(this)
-                             ->template GetClosestNodes<DataType>(data.Name()));
-    db_.Put<DataType>(data.Name(), pmid_addresses);
-    std::vector<routing::DestinationAddress> dest_addresses;
-    for (const auto& pmid_address : pmid_addresses)
-      dest_addresses.emplace_back(std::make_pair(routing::Destination(pmid_address),
-                                                 boost::none));
-    return dest_addresses;
-  }
-  return boost::make_unexpected(MakeError(CommonErrors::success));
+  auto pmid_addresses(static_cast<FacadeType*>(this)
+                          ->template GetClosestNodes<DataType>(data.Name()));
+  if (!db_.PutIfAbsent<DataType>(data.Name(), pmid_addresses))
+    return boost::make_unexpected(MakeError(CommonErrors::success));
+  std::vector<routing::DestinationAddress> dest_addresses;
+  for (const auto& pmid_address : pmid_addresses)
+    dest_addresses.emplace_back(std::make_pair(routing::Destination(pmid_address), boost::none));
+  return dest_addresses;
 }
 
 template <typename FacadeType>
@@ -121,15 +183,24 @@ DataManager<FacadeType>::Replicate(const Identity& name,
     LOG(kError) << "Failed to find a valid close pmid node";
     return boost::make_unexpected(MakeError(CommonErrors::unable_to_handle_request));
   }
-  current_pmid_nodes.erase(std::remove(current_pmid_nodes.begin(), current_pmid_nodes.end(),
-                                       from.first.data),
-                           current_pmid_nodes.end());
-  current_pmid_nodes.insert(current_pmid_nodes.end(), new_pmid_nodes.begin(),
-                            new_pmid_nodes.end());
-  db_.ReplacePmidNodes<DataType>(name, current_pmid_nodes);
+  // The holders may have changed since they were read, so only those nodes not yet holding the
+  // chunk are added.
+  std::vector<routing::Address> added_pmid_nodes;
+  auto updated(db_.ModifyPmids<DataType>(name, [&](std::vector<routing::Address>& pmid_nodes) {
+    pmid_nodes.erase(std::remove(pmid_nodes.begin(), pmid_nodes.end(), from.first.data),
+                     pmid_nodes.end());
+    added_pmid_nodes.clear();
+    for (const auto& pmid_node : new_pmid_nodes) {
+      if (std::find(pmid_nodes.begin(), pmid_nodes.end(), pmid_node) == pmid_nodes.end())
+        added_pmid_nodes.push_back(pmid_node);
+    }
+    pmid_nodes.insert(pmid_nodes.end(), added_pmid_nodes.begin(), added_pmid_nodes.end());
+  }));
+  if (!updated.valid())
+    return boost::make_unexpected(updated.error());
 
   std::vector<routing::DestinationAddress> dest_addresses;
-  for (const auto& pmid_address : new_pmid_nodes)
+  for (const auto& pmid_address : added_pmid_nodes)
     dest_addresses.emplace_back(std::make_pair(routing::Destination(pmid_address), boost::none));
   return dest_addresses;
 }
@@ -152,6 +223,138 @@ routing::HandleGetReturn DataManager<FacadeType>::HandleGet(const routing::Sourc
   return routing::HandleGetReturn::value_type(dest_pmids);
 }
 
+template <typename FacadeType>
+void DataManager<FacadeType>::HandleChurn(const routing::CloseGroupDifference& difference) {
+  auto departed(std::make_shared<std::vector<routing::Address>>(difference.second));
+  std::sort(departed->begin(), departed->end());
+  {
+    std::lock_guard<std::mutex> lock(churn_mutex_);
+    for (const auto& pmid_node : *departed)
+      churn_queue_.push_back(ChurnedNode{pmid_node, departed});
+  }
+  churn_condition_.notify_all();
+}
+
+template <typename FacadeType>
+void DataManager<FacadeType>::WaitForChurn() {
+  std::unique_lock<std::mutex> lock(churn_mutex_);
+  churn_done_condition_.wait(lock, [this] {
+    return stop_churn_ || (churn_queue_.empty() && active_churn_workers_ == 0);
+  });
+}
+
+template <typename FacadeType>
+void DataManager<FacadeType>::StopChurn() {
+  {
+    std::lock_guard<std::mutex> lock(churn_mutex_);
+    if (stop_churn_)
+      return;
+    stop_churn_ = true;
+  }
+  churn_condition_.notify_all();
+  churn_done_condition_.notify_all();
+  for (auto& worker : churn_workers_)
+    worker.join();
+}
+
+template <typename FacadeType>
+void DataManager<FacadeType>::ChurnLoop() {
+  std::unique_lock<std::mutex> lock(churn_mutex_);
+  for (;;) {
+    churn_condition_.wait(lock, [this] { return stop_churn_ || !churn_queue_.empty(); });
+    if (stop_churn_)
+      return;
+    ChurnedNode churned_node(std::move(churn_queue_.front()));
+    churn_queue_.pop_front();
+    ++active_churn_workers_;
+    lock.unlock();
+    try {
+      HandleChurnedNode(churned_node);
+    } catch (const std::exception& e) {
+      LOG(kError) << "Failed handling churn: " << boost::diagnostic_information(e);
+    }
+    lock.lock();
+    --active_churn_workers_;
+    if (churn_queue_.empty() && active_churn_workers_ == 0)
+      churn_done_condition_.notify_all();
+  }
+}
+
+template <typename FacadeType>
+void DataManager<FacadeType>::HandleChurnedNode(const ChurnedNode& churned_node) {
+  auto cursor(db_.ChunksHeldBy(churned_node.pmid_node));
+  while (auto chunk = cursor.Next()) {
+    {
+      std::lock_guard<std::mutex> lock(churn_mutex_);
+      if (stop_churn_)
+        return;
+    }
+    if (chunk->type_id == detail::TypeId<ImmutableData>::value)
+      HandleChurnedChunk<ImmutableData>(chunk->name, *churned_node.departed);
+    else if (chunk->type_id == detail::TypeId<MutableData>::value)
+      HandleChurnedChunk<MutableData>(chunk->name, *churned_node.departed);
+    else
+      LOG(kError) << "Unexpected type of churned chunk: " << chunk->type_id;
+  }
+}
+
+template <typename FacadeType>
+template <typename DataType>
+void DataManager<FacadeType>::HandleChurnedChunk(const Identity& name,
+                                                 const std::vector<routing::Address>& departed) {
+  auto result(db_.GetPmids<DataType>(name));
+  if (!result.valid())
+    return;
+  auto is_departed([&](const routing::Address& holder) {
+    return std::binary_search(departed.begin(), departed.end(), holder);
+  });
+  if (std::none_of(result->begin(), result->end(), is_departed))
+    return;  // Another worker has handled this chunk already.
+
+  // Chooses replacements before taking the database lock, from the holders as they are now.
+  std::vector<routing::Address> candidates;
+  std::vector<routing::Address> survivors;
+  std::remove_copy_if(result->begin(), result->end(), std::back_inserter(survivors), is_departed);
+  if (!survivors.empty() && survivors.size() < Parameters::min_pmid_holders) {
+    candidates = static_cast<FacadeType*>(this)
+                     ->template GetClosestNodes<DataType>(name, survivors);
+  }
+
+  std::vector<routing::Address> sources, new_holders, trimmed_holders;
+  result = db_.ModifyPmids<DataType>(name, [&](std::vector<routing::Address>& holders) {
+    holders.erase(std::remove_if(holders.begin(), holders.end(), is_departed), holders.end());
+    sources = holders;
+    if (!holders.empty() && holders.size() < Parameters::min_pmid_holders) {
+      for (const auto& candidate : candidates) {
+        if (new_holders.size() + holders.size() == Parameters::min_pmid_holders)
+          break;
+        if (std::find(holders.begin(), holders.end(), candidate) == holders.end())
+          new_holders.push_back(candidate);
+      }
+    } else if (holders.size() > Parameters::max_pmid_holders) {
+      trimmed_holders.assign(holders.begin() + Parameters::max_pmid_holders, holders.end());
+      holders.resize(Parameters::max_pmid_holders);
+    }
+    holders.insert(holders.end(), new_holders.begin(), new_holders.end());
+  });
+  if (!result.valid())
+    return;
+
+  if (sources.empty()) {
+    LOG(kError) << "Every holder of " << HexSubstr(name.string()) << " has left";
+  } else if (sources.size() < Parameters::min_pmid_holders && new_holders.empty()) {
+    LOG(kError) << "Failed to find a valid close pmid node";
+  }
+  if (!new_holders.empty()) {
+    static_cast<FacadeType*>(this)
+        ->template SendReplicationRequest<DataType>(name, sources, new_holders);
+  }
+  if (!trimmed_holders.empty()) {
+    static_cast<FacadeType*>(this)
+        ->template SendDeleteRequest<DataType>(name, trimmed_holders);
+  }
+}
+
 }  // namespace vault
 
 }  // namespace maidsafe
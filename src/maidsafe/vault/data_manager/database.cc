@@ -16,6 +16,8 @@
     See the Licences for the specific language governing permissions and limitations relating to
     use of the MaidSafe Software.                                                                 */
 
+#include <algorithm>
+#include <initializer_list>
 #include <string>
 
 #include "boost/filesystem.hpp"
@@ -26,21 +28,115 @@ namespace maidsafe {
 
 namespace vault {
 
-DataManagerDatabase::DataManagerDatabase(const boost::filesystem::path& db_path)
-    : database_(), kDbPath_(db_path), write_operations_(0) {
+namespace {
+
+// The number of rows each read by a HeldChunksCursor fetches.
+const int kHeldChunksBatchSize(256);
+
+// Resets 'statement' for reuse and binds 'values' to its parameters in order.
+void Bind(sqlite::Statement& statement, std::initializer_list<std::string> values) {
+  statement.Reset();
+  int index(0);
+  for (const auto& value : values)
+    statement.BindText(++index, value);
+}
+
+// Reverses EncodeToString.
+Data::NameAndTypeId DecodeChunkName(const std::string& key) {
+  assert(key.size() == identity_size + PaddedWidth::value);
+  return Data::NameAndTypeId(
+      Identity(std::vector<byte>(key.begin(), key.begin() + identity_size)),
+      DataTypeId(static_cast<std::uint32_t>(static_cast<unsigned char>(key[identity_size]))));
+}
+
+}  // unnamed namespace
+
+struct DataManagerDatabase::Statements {
+  explicit Statements(sqlite::Database& database)
+      : chunk_id(database, "SELECT ChunkId FROM Chunks WHERE ChunkName = ?"),
+        insert_chunk(database, "INSERT OR IGNORE INTO Chunks (ChunkName) VALUES (?)"),
+        clear_holders(database, "DELETE FROM Holders WHERE ChunkId = ?"),
+        pmid_id(database, "SELECT PmidId FROM Pmids WHERE Pmid = ?"),
+        insert_pmid(database, "INSERT OR IGNORE INTO Pmids (Pmid) VALUES (?)"),
+        insert_holder(database,
+                      "INSERT OR IGNORE INTO Holders (ChunkId, PmidId, Position) VALUES (?, ?, ?)"),
+        holders(database,
+                "SELECT Pmids.Pmid FROM Holders JOIN Pmids ON Pmids.PmidId = Holders.PmidId "
+                "WHERE Holders.ChunkId = ? ORDER BY Holders.Position"),
+        count_holder(database,
+                     "SELECT Count(*) FROM Holders WHERE ChunkId = ? AND "
+                     "PmidId = (SELECT PmidId FROM Pmids WHERE Pmid = ?)"),
+        remove_holder(database,
+                      "DELETE FROM Holders WHERE ChunkId = ? AND "
+                      "PmidId = (SELECT PmidId FROM Pmids WHERE Pmid = ?)"),
+        held_chunks(database,
+                    "SELECT Chunks.ChunkId, Chunks.ChunkName FROM Holders JOIN Chunks "
+                    "ON Chunks.ChunkId = Holders.ChunkId WHERE "
+                    "Holders.PmidId = (SELECT PmidId FROM Pmids WHERE Pmid = ?) AND "
+                    "Holders.ChunkId > ? ORDER BY Holders.ChunkId LIMIT " +
+                        std::to_string(kHeldChunksBatchSize)),
+        savepoint(database, "SAVEPOINT Write"),
+        rollback_to_savepoint(database, "ROLLBACK TO Write"),
+        release_savepoint(database, "RELEASE Write") {}
+
+  sqlite::Statement chunk_id, insert_chunk, clear_holders, pmid_id, insert_pmid, insert_holder,
+      holders, count_holder, remove_holder, held_chunks, savepoint, rollback_to_savepoint,
+      release_savepoint;
+};
+
+const std::size_t DataManagerDatabase::kDefaultMaxBatchSize;
+const std::size_t DataManagerDatabase::kDefaultCachedRecords;
+
+DataManagerDatabase::DataManagerDatabase(const boost::filesystem::path& db_path,
+                                         std::chrono::steady_clock::duration batch_window,
+                                         std::size_t max_batch_size,
+                                         std::size_t cached_records)
+    : database_(),
+      statements_(),
+      pmid_ids_(),
+      kDbPath_(db_path),
+      write_operations_(0),
+      mutex_(),
+      cache_(cached_records),
+      kBatchWindow_(batch_window),
+      kMaxBatchSize_(std::max(max_batch_size, std::size_t(1))),
+      queue_mutex_(),
+      queue_condition_(),
+      queue_(),
+      stop_flushing_(false),
+      batch_count_(0),
+      flush_thread_() {
   database_.reset(new sqlite::Database(kDbPath_,
                                         sqlite::Mode::kReadWriteCreate));
-  std::string query(
-      "CREATE TABLE IF NOT EXISTS DataManagerAccounts ("
-      "ChunkName TEXT  PRIMARY KEY NOT NULL, PmidNodes TEXT NOT NULL);");
+  std::vector<std::string> queries = {
+      "CREATE TABLE IF NOT EXISTS Chunks ("
+      "ChunkId INTEGER PRIMARY KEY, ChunkName TEXT UNIQUE NOT NULL);",
+      "CREATE TABLE IF NOT EXISTS Pmids ("
+      "PmidId INTEGER PRIMARY KEY, Pmid TEXT UNIQUE NOT NULL);",
+      "CREATE TABLE IF NOT EXISTS Holders ("
+      "ChunkId INTEGER NOT NULL, PmidId INTEGER NOT NULL, Position INTEGER NOT NULL, "
+      "PRIMARY KEY (ChunkId, PmidId)) WITHOUT ROWID;",
+      "CREATE INDEX IF NOT EXISTS HoldersByPmid ON Holders (PmidId, ChunkId);"};
   sqlite::Transaction transaction{*database_};
-  sqlite::Statement statement{*database_, query};
-  statement.Step();
+  for (const auto& query : queries) {
+    sqlite::Statement statement{*database_, query};
+    statement.Step();
+  }
   transaction.Commit();
+
+  statements_.reset(new Statements(*database_));
+  flush_thread_ = std::thread([this] { FlushLoop(); });
 }
 
 DataManagerDatabase::~DataManagerDatabase() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_flushing_ = true;
+  }
+  queue_condition_.notify_one();
+  flush_thread_.join();
   try {
+    statements_.reset();
     database_.reset();
     boost::filesystem::remove_all(kDbPath_);
   }
@@ -49,8 +145,205 @@ DataManagerDatabase::~DataManagerDatabase() {
   }
 }
 
-void DataManagerDatabase::CheckPoint() {
-  if (++write_operations_ > 1000) {
+maidsafe_error DataManagerDatabase::Write(WriteOperation operation) {
+  std::unique_ptr<PendingWrite> pending(new PendingWrite(std::move(operation)));
+  auto result(pending->result.get_future());
+  bool wake_flusher(false);
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    queue_.push_back(std::move(pending));
+    // The flush thread only needs waking for the first write of a batch, or a full one.
+    wake_flusher = (queue_.size() == 1 || queue_.size() == kMaxBatchSize_);
+  }
+  if (wake_flusher)
+    queue_condition_.notify_one();
+  return result.get();
+}
+void DataManagerDatabase::FlushLoop() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  for (;;) {
+    queue_condition_.wait(lock, [this] { return stop_flushing_ || !queue_.empty(); });
+    if (queue_.empty())
+      return;
+    // Gives other writers the batch window to join, unless the batch fills first.
+    if (kBatchWindow_ != std::chrono::steady_clock::duration(0)) {
+      const auto kDeadline(std::chrono::steady_clock::now() + kBatchWindow_);
+      queue_condition_.wait_until(lock, kDeadline, [this] {
+        return stop_flushing_ || queue_.size() >= kMaxBatchSize_;
+      });
+    }
+    std::vector<std::unique_ptr<PendingWrite>> batch;
+    while (!queue_.empty() && batch.size() != kMaxBatchSize_) {
+      batch.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+    lock.unlock();
+    CommitBatch(batch);
+    lock.lock();
+  }
+}
+
+void DataManagerDatabase::CommitBatch(std::vector<std::unique_ptr<PendingWrite>>& batch) {
+  std::vector<maidsafe_error> results(batch.size(), maidsafe_error(CommonErrors::success));
+  std::vector<std::exception_ptr> errors(batch.size());
+  try {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CheckPoint(static_cast<int>(batch.size()));
+    sqlite::Transaction transaction{*database_};
+    // Each write gets a savepoint, so one which fails part way is undone without failing the
+    // rest of the batch.
+    for (std::size_t i(0); i != batch.size(); ++i) {
+      Bind(statements_->savepoint, {});
+      statements_->savepoint.Step();
+      try {
+        results[i] = batch[i]->operation();
+      } catch (...) {
+        errors[i] = std::current_exception();
+        Bind(statements_->rollback_to_savepoint, {});
+        statements_->rollback_to_savepoint.Step();
+        // Any pmid it interned has been rolled back.
+        pmid_ids_.clear();
+      }
+      Bind(statements_->release_savepoint, {});
+      statements_->release_savepoint.Step();
+    }
+    transaction.Commit();
+    ++batch_count_;
+  } catch (...) {
+    LOG(kError) << "Failed to commit a batch of " << batch.size() << " writes.";
+    {
+      // Any pmid interned by the batch has been rolled back, and records read from inside the
+      // batch may have been cached.
+      std::lock_guard<std::mutex> lock(mutex_);
+      pmid_ids_.clear();
+      cache_.Clear();
+    }
+    for (auto& error : errors)
+      error = std::current_exception();
+  }
+  for (std::size_t i(0); i != batch.size(); ++i) {
+    if (errors[i])
+      batch[i]->result.set_exception(errors[i]);
+    else
+      batch[i]->result.set_value(results[i]);
+  }
+}
+
+boost::optional<std::string> DataManagerDatabase::ChunkId(const std::string& key) {
+  auto& statement(statements_->chunk_id);
+  Bind(statement, {key});
+  boost::optional<std::string> chunk_id;
+  if (statement.Step() == sqlite::StepResult::kSqliteRow)
+    chunk_id = statement.ColumnText(0);
+  // Ends the statement's read of the database.
+  statement.Reset();
+  return chunk_id;
+}
+
+void DataManagerDatabase::PutRecord(const std::string& key, const std::vector<std::string>& pmids) {
+  cache_.Invalidate(key);
+  Bind(statements_->insert_chunk, {key});
+  statements_->insert_chunk.Step();
+  auto chunk_id(ChunkId(key));
+  if (!chunk_id)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_error));
+  Bind(statements_->clear_holders, {*chunk_id});
+  statements_->clear_holders.Step();
+  for (std::size_t position(0); position != pmids.size(); ++position) {
+    Bind(statements_->insert_holder,
+         {*chunk_id, PmidId(pmids[position]), std::to_string(position)});
+    statements_->insert_holder.Step();
+  }
+}
+
+std::string DataManagerDatabase::PmidId(const std::string& pmid) {
+  auto itr(pmid_ids_.find(pmid));
+  if (itr != pmid_ids_.end())
+    return itr->second;
+  Bind(statements_->insert_pmid, {pmid});
+  statements_->insert_pmid.Step();
+  auto& statement(statements_->pmid_id);
+  Bind(statement, {pmid});
+  if (statement.Step() != sqlite::StepResult::kSqliteRow)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_error));
+  std::string pmid_id(statement.ColumnText(0));
+  statement.Reset();
+  pmid_ids_.emplace(pmid, pmid_id);
+  return pmid_id;
+}
+
+boost::optional<std::vector<routing::Address>> DataManagerDatabase::GetRecord(
+    const std::string& key) {
+  auto chunk_id(ChunkId(key));
+  if (!chunk_id)
+    return boost::none;
+  auto& statement(statements_->holders);
+  Bind(statement, {*chunk_id});
+  std::vector<routing::Address> pmid_nodes;
+  while (statement.Step() == sqlite::StepResult::kSqliteRow) {
+    auto pmid(statement.ColumnText(0));
+    assert(pmid.size() == identity_size);
+    pmid_nodes.emplace_back(pmid);
+  }
+  statement.Reset();
+  return pmid_nodes;
+}
+
+maidsafe_error DataManagerDatabase::RemovePmidRecord(const std::string& key,
+                                                     const std::string& remove_pmid) {
+  auto chunk_id(ChunkId(key));
+  if (!chunk_id)
+    return MakeError(VaultErrors::no_such_account);
+  auto& count_holder(statements_->count_holder);
+  Bind(count_holder, {*chunk_id, remove_pmid});
+  bool held(count_holder.Step() == sqlite::StepResult::kSqliteRow &&
+            count_holder.ColumnText(0) != "0");
+  count_holder.Reset();
+  if (!held)
+    return maidsafe_error(CommonErrors::no_such_element);
+  cache_.Invalidate(key);
+  Bind(statements_->remove_holder, {*chunk_id, remove_pmid});
+  statements_->remove_holder.Step();
+  return maidsafe_error(CommonErrors::success);
+}
+
+DataManagerDatabase::HeldChunksCursor DataManagerDatabase::ChunksHeldBy(
+    const routing::Address& pmid_node) {
+  if (!database_)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
+  return HeldChunksCursor(*this, convert::ToString(pmid_node.string()));
+}
+
+DataManagerDatabase::HeldChunksCursor::HeldChunksCursor(DataManagerDatabase& database,
+                                                        std::string pmid)
+    : database_(database),
+      kPmid_(std::move(pmid)),
+      last_chunk_id_("0"),
+      batch_(),
+      exhausted_(false) {}
+
+boost::optional<Data::NameAndTypeId> DataManagerDatabase::HeldChunksCursor::Next() {
+  if (batch_.empty() && !exhausted_) {
+    std::lock_guard<std::mutex> lock(database_.mutex_);
+    auto& statement(database_.statements_->held_chunks);
+    Bind(statement, {kPmid_, last_chunk_id_});
+    while (statement.Step() == sqlite::StepResult::kSqliteRow) {
+      last_chunk_id_ = statement.ColumnText(0);
+      batch_.push_back(DecodeChunkName(statement.ColumnText(1)));
+    }
+    statement.Reset();
+    exhausted_ = (batch_.size() < static_cast<std::size_t>(kHeldChunksBatchSize));
+  }
+  if (batch_.empty())
+    return boost::none;
+  auto name(batch_.front());
+  batch_.pop_front();
+  return name;
+}
+
+void DataManagerDatabase::CheckPoint(int write_count) {
+  write_operations_ += write_count;
+  if (write_operations_ > 1000) {
     database_->CheckPoint();
     write_operations_ = 0;
   }
@@ -19,24 +19,92 @@
 #ifndef MAIDSAFE_VAULT_DATA_MANAGER_DATABASE_H_
 #define MAIDSAFE_VAULT_DATA_MANAGER_DATABASE_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "boost/optional/optional.hpp"
+
 #include "maidsafe/common/sqlite3_wrapper.h"
 
 #include "maidsafe/common/convert.h"
+#include "maidsafe/common/data_types/data.h"
 #include "maidsafe/routing/types.h"
 
 #include "maidsafe/vault/utils.h"
+#include "maidsafe/vault/data_manager/pmids_cache.h"
 
 namespace maidsafe {
 
 namespace vault {
 
+// Each chunk has a row in the Chunks table, and each of its holders a row in Holders giving the
+// holder's position in the chunk's list.  Holders is indexed by pmid node, so that the chunks held
+// by a departed node can be found without scanning every chunk.  Pmid nodes are interned: the
+// Pmids table assigns each an integer, which is what Holders stores in place of its address.
+//
+// Statements are prepared once at construction, then reset and rebound by each call, with calls
+// serialised on mutex_.
+//
+// GetPmids and Exist read through a PmidsCache of about 'cached_records' records (rounded up to
+// a whole number per shard), which also remembers names recently found to have no record.
+// Writes invalidate the record's entry while holding mutex_, before their transaction commits; a
+// reader which misses takes its cache ticket and reads the database under mutex_ too, so can't
+// cache what a write has since replaced.
+//
+// Writes are group committed: Put, PutIfAbsent, ReplacePmidNodes, ModifyPmids and RemovePmid
+// queue their change and block until a background thread has applied it in a transaction shared
+// with any other writes queued meanwhile.  Each change is applied whole, so one which reads the
+// record before updating it can't interleave with another, and inside its own savepoint, so one
+// which throws part way is rolled back without affecting the rest of the batch.  The thread waits
+// up to 'batch_window' after the first write of a batch for others to join it, or until
+// 'max_batch_size' are queued.  A longer window means fewer commits under concurrent load at the
+// cost of up to that much latency per write; with no window, writes only share a commit if
+// they're queued while the previous one is in progress.
 class DataManagerDatabase {
+  struct Statements;
+
  public:
   using GetPmidsResult = boost::expected<std::vector<routing::Address>, maidsafe_error>;
-  explicit DataManagerDatabase(const boost::filesystem::path& db_path);
+  using ModifyPmidsFunctor = std::function<void(std::vector<routing::Address>&)>;
+  static const std::size_t kDefaultMaxBatchSize = 256;
+  static const std::size_t kDefaultCachedRecords = 65536;
+
+  // Returns the chunks held by a pmid node, reading them from the database in batches as it
+  // advances rather than all at once.  Chunks whose holders change while it's open may or may not
+  // be returned.  Must not outlive the database.
+  class HeldChunksCursor {
+   public:
+    boost::optional<Data::NameAndTypeId> Next();
+
+   private:
+    friend class DataManagerDatabase;
+    HeldChunksCursor(DataManagerDatabase& database, std::string pmid);
+
+    DataManagerDatabase& database_;
+    const std::string kPmid_;
+    // The ChunkId of the last row read, which orders the index on Holders for each pmid.
+    std::string last_chunk_id_;
+    std::deque<Data::NameAndTypeId> batch_;
+    bool exhausted_;
+  };
+
+  explicit DataManagerDatabase(
+      const boost::filesystem::path& db_path,
+      std::chrono::steady_clock::duration batch_window = std::chrono::steady_clock::duration(0),
+      std::size_t max_batch_size = kDefaultMaxBatchSize,
+      std::size_t cached_records = kDefaultCachedRecords);
   ~DataManagerDatabase();
 
   template <typename DataType>
@@ -45,21 +113,71 @@ class DataManagerDatabase {
   template <typename DataType>
   void Put(const Identity& name, const std::vector<routing::Address>& pmid_nodes);
 
+  // Stores 'pmid_nodes' for 'name' unless it already has a record, checking and inserting in the
+  // same transaction.  Returns true if the record is new.
+  template <typename DataType>
+  bool PutIfAbsent(const Identity& name, const std::vector<routing::Address>& pmid_nodes);
+
   template <typename DataType>
   void ReplacePmidNodes(const Identity& name, const std::vector<routing::Address>& pmid_nodes);
 
+  // Reads the pmid nodes of 'name', lets 'modify' change them, and stores the result, all in the
+  // same transaction.  'modify' is called with the database locked, so mustn't use it.  Returns
+  // the stored pmid nodes, or no_such_account.
+  template <typename DataType>
+  GetPmidsResult ModifyPmids(const Identity& name, const ModifyPmidsFunctor& modify);
+
   template <typename DataType>
   maidsafe_error RemovePmid(const Identity& name, const routing::DestinationAddress& remove_pmid);
 
   template <typename DataType>
   GetPmidsResult GetPmids(const Identity& name);
 
+  HeldChunksCursor ChunksHeldBy(const routing::Address& pmid_node);
+
+  // The number of transactions committed by the write queue.
+  std::uint64_t BatchCount() const { return batch_count_; }
+  const PmidsCache& Cache() const { return cache_; }
+
  private:
-  void CheckPoint();
+  // Applied within the batch's transaction, with mutex_ held.
+  using WriteOperation = std::function<maidsafe_error()>;
+  struct PendingWrite {
+    explicit PendingWrite(WriteOperation operation_in)
+        : operation(std::move(operation_in)), result() {}
+    WriteOperation operation;
+    std::promise<maidsafe_error> result;
+  };
+
+  // Queues 'operation' and waits for its batch to commit, rethrowing any error.
+  maidsafe_error Write(WriteOperation operation);
+  void FlushLoop();
+  void CommitBatch(std::vector<std::unique_ptr<PendingWrite>>& batch);
+  // These expect mutex_ to be held.  Keys are chunk names encoded with EncodeToString.
+  boost::optional<std::string> ChunkId(const std::string& key);
+  // Returns the integer assigned to 'pmid', assigning the next one if it has none.
+  std::string PmidId(const std::string& pmid);
+  void PutRecord(const std::string& key, const std::vector<std::string>& pmids);
+  boost::optional<std::vector<routing::Address>> GetRecord(const std::string& key);
+  maidsafe_error RemovePmidRecord(const std::string& key, const std::string& remove_pmid);
+  void CheckPoint(int write_count);
 
   std::unique_ptr<sqlite::Database> database_;
+  std::unique_ptr<Statements> statements_;
+  // Caches PmidId.  There are only as many entries as nodes seen, so it's never trimmed.
+  std::unordered_map<std::string, std::string> pmid_ids_;
   const boost::filesystem::path kDbPath_;
   int write_operations_;
+  std::mutex mutex_;
+  PmidsCache cache_;
+  const std::chrono::steady_clock::duration kBatchWindow_;
+  const std::size_t kMaxBatchSize_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_condition_;
+  std::deque<std::unique_ptr<PendingWrite>> queue_;
+  bool stop_flushing_;
+  std::atomic<std::uint64_t> batch_count_;
+  std::thread flush_thread_;
 };
 
 template <typename DataType>
@@ -68,19 +186,61 @@ void DataManagerDatabase::Put(const Identity& name,
   if (!database_)
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
 
-  std::string pmids_str;
+  std::string key(EncodeToString<DataType>(name));
+  std::vector<std::string> pmids;
+  for (const auto& pmid_node : pmid_nodes)
+    pmids.push_back(convert::ToString(pmid_node.string()));
+  Write([this, key, pmids] {
+    PutRecord(key, pmids);
+    return maidsafe_error(CommonErrors::success);
+  });
+}
+
+template <typename DataType>
+bool DataManagerDatabase::PutIfAbsent(const Identity& name,
+                                      const std::vector<routing::Address>& pmid_nodes) {
+  if (!database_)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
 
-  CheckPoint();
-  sqlite::Transaction transaction{*database_};
-  std::string query(
-      "INSERT OR REPLACE INTO DataManagerAccounts (ChunkName, PmidNodes) VALUES (?, ?)");
-  sqlite::Statement statement{*database_, query};
-  statement.BindText(1, EncodeToString<DataType>(name));
+  std::string key(EncodeToString<DataType>(name));
+  std::vector<std::string> pmids;
   for (const auto& pmid_node : pmid_nodes)
-    pmids_str += convert::ToString(pmid_node.string());
-  statement.BindText(2, pmids_str);
-  statement.Step();
-  transaction.Commit();
+    pmids.push_back(convert::ToString(pmid_node.string()));
+  auto result(Write([this, key, pmids] {
+    if (ChunkId(key))
+      return MakeError(VaultErrors::data_already_exists);
+    PutRecord(key, pmids);
+    return maidsafe_error(CommonErrors::success);
+  }));
+  return result.code() == make_error_code(CommonErrors::success);
+}
+
+template <typename DataType>
+DataManagerDatabase::GetPmidsResult DataManagerDatabase::ModifyPmids(
+    const Identity& name, const ModifyPmidsFunctor& modify) {
+  if (!database_)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
+
+  std::string key(EncodeToString<DataType>(name));
+  std::vector<routing::Address> pmid_nodes;
+  // Write blocks until the operation has run, so it can refer to locals.
+  auto result(Write([&]() -> maidsafe_error {
+    auto current(GetRecord(key));
+    if (!current)
+      return MakeError(VaultErrors::no_such_account);
+    pmid_nodes = *current;
+    modify(pmid_nodes);
+    if (pmid_nodes != *current) {
+      std::vector<std::string> pmids;
+      for (const auto& pmid_node : pmid_nodes)
+        pmids.push_back(convert::ToString(pmid_node.string()));
+      PutRecord(key, pmids);
+    }
+    return maidsafe_error(CommonErrors::success);
+  }));
+  if (result.code() != make_error_code(CommonErrors::success))
+    return boost::make_unexpected(result);
+  return pmid_nodes;
 }
 
 template <typename DataType>
@@ -92,20 +252,12 @@ void DataManagerDatabase::ReplacePmidNodes(const Identity& name,
 template <typename DataType>
 maidsafe_error DataManagerDatabase::RemovePmid(const Identity& name,
                                                const routing::DestinationAddress& remove_pmid) {
-  auto result(GetPmids<DataType>(name));
-  if (!result.valid())
-    return result.error();
-
-  auto& pmid_nodes(*result);
-  if (std::any_of(pmid_nodes.begin(), pmid_nodes.end(), [&](const routing::Address& pmid_node) {
-        return pmid_node == remove_pmid.first.data;
-      })) {
-    pmid_nodes.erase(std::remove(pmid_nodes.begin(), pmid_nodes.end(), remove_pmid.first.data),
-                     pmid_nodes.end());
-    ReplacePmidNodes<DataType>(name, pmid_nodes);
-    return maidsafe_error(CommonErrors::success);
-  }
-  return maidsafe_error(CommonErrors::no_such_element);
+  if (!database_)
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
+
+  std::string key(EncodeToString<DataType>(name));
+  std::string pmid(convert::ToString(remove_pmid.first.data.string()));
+  return Write([this, key, pmid] { return RemovePmidRecord(key, pmid); });
 }
 
 template <typename DataType>
@@ -113,20 +265,23 @@ DataManagerDatabase::GetPmidsResult DataManagerDatabase::GetPmids(const Identity
   if (!database_)
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
 
-  std::vector<routing::Address> pmid_nodes;
-  std::string query("SELECT PmidNodes FROM DataManagerAccounts WHERE ChunkName = ?");
-  sqlite::Statement statement{*database_, query};
-  statement.BindText(1, EncodeToString<DataType>(name));
-
-  if (statement.Step() == sqlite::StepResult::kSqliteRow) {
-    assert(statement.ColumnText(0).size() % identity_size == 0);
-    size_t pmids_count(statement.ColumnText(0).size() / identity_size);
-    for (size_t index(0); index < pmids_count; ++index)
-      pmid_nodes.emplace_back(statement.ColumnText(0).substr(index * identity_size, identity_size));
-  } else {
-    return boost::make_unexpected(MakeError(VaultErrors::no_such_account));
+  std::string key(EncodeToString<DataType>(name));
+  auto cached(cache_.Get(key));
+  if (!cached.found) {
+    PmidsCache::Ticket ticket;
+    boost::optional<std::vector<routing::Address>> pmid_nodes;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ticket = cache_.GetTicket(key);
+      pmid_nodes = GetRecord(key);
+    }
+    if (pmid_nodes)
+      cached.value = std::make_shared<const std::vector<routing::Address>>(std::move(*pmid_nodes));
+    cache_.Insert(key, cached.value, ticket);
   }
-  return pmid_nodes;
+  if (!cached.value)
+    return boost::make_unexpected(MakeError(VaultErrors::no_such_account));
+  return *cached.value;
 }
 
 template <typename DataType>
@@ -134,16 +289,12 @@ bool DataManagerDatabase::Exist(const Identity& name) {
   if (!database_)
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::db_not_present));
 
-  std::string query("SELECT Count(*) FROM DataManagerAccounts WHERE ChunkName = ?");
-  sqlite::Statement statement{*database_, query};
-  statement.BindText(1, EncodeToString<DataType>(name));
-
-  if (statement.Step() == sqlite::StepResult::kSqliteRow) {
-    auto count(std::stoul(statement.ColumnText(0)));
-    assert(count <= 1);
-    return (count > 0);
-  }
-  return false;
+  std::string key(EncodeToString<DataType>(name));
+  auto cached(cache_.Get(key));
+  if (cached.found)
+    return static_cast<bool>(cached.value);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<bool>(ChunkId(key));
 }
 
 }  // namespace vault
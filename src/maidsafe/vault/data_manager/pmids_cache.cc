@@ -0,0 +1,121 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/data_manager/pmids_cache.h"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+namespace maidsafe {
+
+namespace vault {
+
+PmidsCache::PmidsCache(std::size_t max_records)
+    : kMaxShardRecords_((max_records + std::tuple_size<decltype(shards_)>::value - 1) /
+                        std::tuple_size<decltype(shards_)>::value),
+      kMaxShardMisses_(kMaxShardRecords_ == 0 ? 0 : std::max(kMaxShardRecords_ / 4,
+                                                              std::size_t(1))),
+      shards_(),
+      hits_(0),
+      misses_(0) {}
+
+PmidsCache::Lookup PmidsCache::Get(const std::string& key) {
+  if (kMaxShardRecords_ == 0)
+    return Lookup{false, nullptr};
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  for (auto lru : {&shard.records, &shard.missing}) {
+    auto itr(lru->index.find(key));
+    if (itr != lru->index.end()) {
+      ++hits_;
+      lru->entries.splice(lru->entries.begin(), lru->entries, itr->second);
+      return Lookup{true, itr->second->second};
+    }
+  }
+  ++misses_;
+  return Lookup{false, nullptr};
+}
+
+PmidsCache::Ticket PmidsCache::GetTicket(const std::string& key) {
+  if (kMaxShardRecords_ == 0)
+    return 0;
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.generation;
+}
+
+void PmidsCache::Insert(const std::string& key, Value value, Ticket ticket) {
+  if (kMaxShardRecords_ == 0)
+    return;
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (ticket != shard.generation)
+    return;
+  if (value)
+    Add(shard.records, key, std::move(value), kMaxShardRecords_);
+  else
+    Add(shard.missing, key, nullptr, kMaxShardMisses_);
+}
+
+void PmidsCache::Invalidate(const std::string& key) {
+  if (kMaxShardRecords_ == 0)
+    return;
+  Shard& shard(GetShard(key));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  ++shard.generation;
+  Remove(shard.records, key);
+  Remove(shard.missing, key);
+}
+
+void PmidsCache::Clear() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ++shard.generation;
+    shard.records = Lru();
+    shard.missing = Lru();
+  }
+}
+
+PmidsCache::Shard& PmidsCache::GetShard(const std::string& key) {
+  // Keys start with the chunk's name, which is a hash, so their first byte is evenly distributed.
+  return shards_[static_cast<unsigned char>(key[0]) % shards_.size()];
+}
+
+void PmidsCache::Add(Lru& lru, const std::string& key, Value value, std::size_t max_size) {
+  if (lru.index.count(key) != 0)
+    return;
+  if (lru.entries.size() == max_size) {
+    lru.index.erase(lru.entries.back().first);
+    lru.entries.pop_back();
+  }
+  lru.entries.emplace_front(key, std::move(value));
+  lru.index.emplace(key, lru.entries.begin());
+}
+
+void PmidsCache::Remove(Lru& lru, const std::string& key) {
+  auto itr(lru.index.find(key));
+  if (itr == lru.index.end())
+    return;
+  lru.entries.erase(itr->second);
+  lru.index.erase(itr);
+}
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,104 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_VAULT_DATA_MANAGER_PMIDS_CACHE_H_
+#define MAIDSAFE_VAULT_DATA_MANAGER_PMIDS_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "maidsafe/routing/types.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+// A cache of DataManagerDatabase records, keyed by encoded chunk name and split into independently
+// locked shards.  Each shard holds two LRU lists: the pmid nodes of recently read records, and
+// the keys recently found to have no record at all, so that repeated lookups of a missing chunk
+// don't reach the database either.  Misses are kept to a quarter of the capacity, so a run of
+// lookups for names which aren't held can't flush out the records which are.
+//
+// As with ChunkCache, readers take a Ticket before reading the database, and Insert only succeeds
+// if no Invalidate on the same shard has happened since.
+class PmidsCache {
+ public:
+  using Ticket = std::uint64_t;
+  // Null for a key known to have no record.
+  using Value = std::shared_ptr<const std::vector<routing::Address>>;
+  struct Lookup {
+    bool found;
+    Value value;
+  };
+
+  // 'max_records' is split between the shards and rounded up, so each shard holds at least one
+  // record unless it's 0, which disables the cache.
+  explicit PmidsCache(std::size_t max_records);
+  PmidsCache(const PmidsCache&) = delete;
+  PmidsCache(PmidsCache&&) = delete;
+  PmidsCache& operator=(const PmidsCache&) = delete;
+  PmidsCache& operator=(PmidsCache&&) = delete;
+
+  // 'found' is false on a miss; a hit with a null 'value' means the key has no record.
+  Lookup Get(const std::string& key);
+  Ticket GetTicket(const std::string& key);
+  void Insert(const std::string& key, Value value, Ticket ticket);
+  void Invalidate(const std::string& key);
+  // Invalidates every key, e.g. after a rolled back transaction.
+  void Clear();
+
+  std::uint64_t Hits() const { return hits_; }
+  std::uint64_t Misses() const { return misses_; }
+
+ private:
+  struct Lru {
+    using Entry = std::pair<std::string, Value>;
+    Lru() : entries(), index() {}
+    // Most recently used at the front.
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  };
+  struct Shard {
+    Shard() : mutex(), records(), missing(), generation(0) {}
+    std::mutex mutex;
+    Lru records, missing;
+    Ticket generation;
+  };
+
+  Shard& GetShard(const std::string& key);
+  static void Add(Lru& lru, const std::string& key, Value value, std::size_t max_size);
+  static void Remove(Lru& lru, const std::string& key);
+
+  const std::size_t kMaxShardRecords_, kMaxShardMisses_;
+  std::array<Shard, 16> shards_;
+  std::atomic<std::uint64_t> hits_, misses_;
+};
+
+}  // namespace vault
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_VAULT_DATA_MANAGER_PMIDS_CACHE_H_
@@ -18,6 +18,8 @@
 
 #include "maidsafe/vault/mpid_manager/handler.h"
 
+#include <utility>
+
 #include "maidsafe/common/convert.h"
 
 namespace maidsafe {
@@ -29,6 +31,10 @@ MpidManagerHandler::MpidManagerHandler(const boost::filesystem::path& vault_root
     : chunk_store_(vault_root_dir / "mpid_manager" / "permanent", max_disk_usage),
       db_() {}
 
+MpidManagerHandler::MpidManagerHandler(std::unique_ptr<ChunkStoreBackend> chunk_store_backend,
+                                       DiskUsage max_disk_usage)
+    : chunk_store_(std::move(chunk_store_backend), max_disk_usage), db_() {}
+
 void MpidManagerHandler::Put(const ImmutableData& data, const MpidName& mpid) {
   PutChunk(data);
   db_.Put(data.Name(), static_cast<uint32_t>(data.Value().size()), mpid);
@@ -47,9 +53,7 @@ bool MpidManagerHandler::Has(const MessageIdType& message_id) {
 bool MpidManagerHandler::HasAccount(const MpidName& mpid) {
   try {
     Identity account_name(db_.GetAccountChunkName(mpid));
-    Data::NameAndTypeId key(account_name, DataTypeId(0));
-    NonEmptyString result(chunk_store_.Get(key));
-    return result.IsInitialised();
+    return chunk_store_.Has(Data::NameAndTypeId(account_name, DataTypeId(0)));
   }
   catch (...) {
     return false;
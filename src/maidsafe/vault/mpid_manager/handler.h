@@ -19,6 +19,7 @@
 #ifndef MAIDSAFE_VAULT_MPID_MANAGER_HANDLER_H_
 #define MAIDSAFE_VAULT_MPID_MANAGER_HANDLER_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include "boost/filesystem.hpp"
@@ -42,6 +43,10 @@ using DbDataQueryResult = boost::expected<ImmutableData, maidsafe_error>;
 class MpidManagerHandler {
  public:
   MpidManagerHandler(const boost::filesystem::path& vault_root_dir, DiskUsage max_disk_usage);
+  // Holds the chunks in 'chunk_store_backend', which mustn't be persistent (e.g. a MemoryBackend,
+  // so that benchmarks measure the handler rather than the disk).
+  MpidManagerHandler(std::unique_ptr<ChunkStoreBackend> chunk_store_backend,
+                     DiskUsage max_disk_usage);
 
   void Put(const ImmutableData& data, const MpidName& mpid);
   void Delete(const MessageIdType& message_id);
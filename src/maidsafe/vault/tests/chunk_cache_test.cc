@@ -0,0 +1,117 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/chunk_cache.h"
+
+#include <memory>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+const std::uint64_t OneKB(1024);
+
+typedef std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> NameValueContainer;
+
+// Looks 'name' up, caching 'value' on a miss as ChunkStore::Get does.
+bool GetOrInsert(ChunkCache& cache, const Data::NameAndTypeId& name, const NonEmptyString& value) {
+  if (cache.Get(name))
+    return true;
+  cache.Insert(name, std::make_shared<const NonEmptyString>(value), cache.GetTicket(name));
+  return false;
+}
+
+TEST(ChunkCacheTest, BEH_ZeroSizeDisablesCache) {
+  ChunkCache cache(0);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, 100);
+  EXPECT_FALSE(GetOrInsert(cache, name_value_pairs[0].first, name_value_pairs[0].second));
+  EXPECT_FALSE(GetOrInsert(cache, name_value_pairs[0].first, name_value_pairs[0].second));
+  EXPECT_EQ(0U, cache.Size());
+  EXPECT_EQ(0U, cache.Hits());
+}
+
+TEST(ChunkCacheTest, BEH_HitsMissesAndInvalidation) {
+  ChunkCache cache(OneKB * OneKB);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, 100);
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_FALSE(GetOrInsert(cache, name_value.first, name_value.second));
+  for (const auto& name_value : name_value_pairs) {
+    auto cached(cache.Get(name_value.first));
+    ASSERT_TRUE(static_cast<bool>(cached));
+    EXPECT_TRUE(*cached == name_value.second);
+  }
+  EXPECT_EQ(10U, cache.Hits());
+  EXPECT_EQ(10U, cache.Misses());
+
+  cache.Invalidate(name_value_pairs[0].first);
+  EXPECT_FALSE(static_cast<bool>(cache.Get(name_value_pairs[0].first)));
+
+  // Content read before an invalidation mustn't be cached after it.
+  auto ticket(cache.GetTicket(name_value_pairs[0].first));
+  cache.Invalidate(name_value_pairs[0].first);
+  cache.Insert(name_value_pairs[0].first,
+               std::make_shared<const NonEmptyString>(name_value_pairs[0].second), ticket);
+  EXPECT_FALSE(static_cast<bool>(cache.Get(name_value_pairs[0].first)));
+}
+
+TEST(ChunkCacheTest, BEH_RespectsMaxBytes) {
+  const std::uint64_t kMaxBytes(64 * OneKB);
+  ChunkCache cache(kMaxBytes);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 200, OneKB);
+  for (int i(0); i != 3; ++i) {
+    for (const auto& name_value : name_value_pairs) {
+      GetOrInsert(cache, name_value.first, name_value.second);
+      EXPECT_LE(cache.Size(), kMaxBytes);
+    }
+  }
+  EXPECT_GT(cache.Size(), 0U);
+}
+
+TEST(ChunkCacheTest, BEH_ScanDoesNotEvictPopularEntries) {
+  ChunkCache cache(128 * OneKB);
+  NameValueContainer popular, scan;
+  AddRandomNameValuePairs(popular, 32, OneKB);
+  AddRandomNameValuePairs(scan, 1000, OneKB);
+  for (int i(0); i != 5; ++i) {
+    for (const auto& name_value : popular)
+      GetOrInsert(cache, name_value.first, name_value.second);
+  }
+  for (const auto& name_value : scan)
+    GetOrInsert(cache, name_value.first, name_value.second);
+
+  auto hits_before(cache.Hits());
+  for (const auto& name_value : popular)
+    EXPECT_TRUE(GetOrInsert(cache, name_value.first, name_value.second));
+  EXPECT_EQ(hits_before + popular.size(), cache.Hits());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,160 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/chunk_crypto.h"
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace pt = boost::posix_time;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+TEST(ChunkCryptoTest, BEH_KeyedByName) {
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, 1000);
+  auto content(EncryptChunk(name_value_pairs[0].first, name_value_pairs[0].second));
+  EXPECT_NE(name_value_pairs[0].second.string(), content);
+  EXPECT_TRUE(DecryptChunk(name_value_pairs[0].first, std::vector<byte>(content)) ==
+              name_value_pairs[0].second);
+  EXPECT_THROW(DecryptChunk(name_value_pairs[1].first, std::move(content)), maidsafe_error);
+}
+
+TEST(ChunkCryptoTest, BEH_BlocksDecryptSeparately) {
+  const Data::NameAndTypeId kName(GetRandomDataNameAndTypeId());
+  const std::uint64_t kOverhead(ChunkBlockOverhead());
+
+  // A value which fits in one block is encrypted as a whole.
+  NonEmptyString small_value(RandomBytes(static_cast<std::uint32_t>(kChunkBlockSize)));
+  EXPECT_TRUE(EncryptChunk(kName, small_value) ==
+              crypto::SymmEncrypt(small_value, ChunkKeyAndIv(kName)).data.string());
+
+  const std::uint64_t kValueSize(3 * kChunkBlockSize + kChunkBlockSize / 2);
+  NonEmptyString value(RandomBytes(static_cast<std::uint32_t>(kValueSize)));
+  auto content(EncryptChunk(kName, value));
+  ASSERT_EQ(kValueSize + 4 * kOverhead, content.size());
+  EXPECT_TRUE(DecryptChunk(kName, std::vector<byte>(content)) == value);
+
+  for (auto range : std::vector<std::pair<std::uint64_t, std::uint64_t>>{
+           {0, 1}, {kChunkBlockSize - 1, 2}, {kChunkBlockSize, kChunkBlockSize},
+           {2 * kChunkBlockSize + 10, kValueSize}}) {
+    auto span(ChunkBlockSpanFor(range.first, range.second));
+    EXPECT_EQ(range.first / kChunkBlockSize, span.first_block);
+    std::vector<byte> blocks(
+        content.begin() + std::min<std::uint64_t>(span.content_offset, content.size()),
+        content.begin() + std::min<std::uint64_t>(span.content_offset + span.content_length,
+                                                  content.size()));
+    auto plain(DecryptChunkBlocks(kName, span.first_block, blocks,
+                                  span.content_offset + span.content_length >= content.size()));
+    const std::uint64_t kStart(range.first - span.first_block * kChunkBlockSize),
+        kLength(std::min(range.second, kValueSize - range.first));
+    ASSERT_LE(kStart + kLength, plain.size());
+    EXPECT_TRUE(std::equal(plain.begin() + kStart, plain.begin() + kStart + kLength,
+                           value.string().begin() + range.first));
+  }
+
+  // Blocks only decrypt at their own index.
+  std::vector<byte> second_block(content.begin() + kChunkBlockSize + kOverhead,
+                                 content.begin() + 2 * (kChunkBlockSize + kOverhead));
+  EXPECT_THROW(DecryptChunkBlocks(kName, 0, second_block, false), maidsafe_error);
+  EXPECT_NO_THROW(DecryptChunkBlocks(kName, 1, second_block, false));
+  EXPECT_THROW(DecryptChunkBlocks(kName, 1, second_block, true), maidsafe_error);
+
+  // Chunks written as a single block by earlier versions still decrypt.
+  auto whole(crypto::SymmEncrypt(value, ChunkKeyAndIv(kName)).data.string());
+  EXPECT_TRUE(DecryptChunk(kName, std::move(whole)) == value);
+}
+
+TEST(ChunkCryptoTest, BEH_TruncatedContentDoesNotDecrypt) {
+  const Data::NameAndTypeId kName(GetRandomDataNameAndTypeId());
+  const std::uint64_t kSealedBlockSize(kChunkBlockSize + ChunkBlockOverhead());
+  for (std::uint64_t block_count : {2, 3}) {
+    // Both a short last block and one which fills the block exactly.
+    for (std::uint64_t last_block_size : {kChunkBlockSize / 2, kChunkBlockSize}) {
+      NonEmptyString value(RandomBytes(
+          static_cast<std::uint32_t>((block_count - 1) * kChunkBlockSize + last_block_size)));
+      auto content(EncryptChunk(kName, value));
+      EXPECT_TRUE(DecryptChunk(kName, std::vector<byte>(content)) == value);
+      // Drop the last block.
+      content.resize((block_count - 1) * kSealedBlockSize);
+      EXPECT_THROW(DecryptChunk(kName, std::move(content)), maidsafe_error);
+    }
+  }
+}
+
+// Reports encryption and decryption throughput per core, with one thread and with one thread per
+// core.  Each thread times its encryptions and decryptions separately.
+TEST(ChunkCryptoTest, FUNC_ThroughputPerCore) {
+  const std::uint32_t kChunkSize(1024 * 1024), kChunksPerThread(64);
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 4, kChunkSize);
+  for (unsigned int thread_count : std::set<unsigned int>{1U, Concurrency()}) {
+    std::vector<std::future<std::pair<pt::time_duration, pt::time_duration>>> threads;
+    for (unsigned int i(0); i != thread_count; ++i) {
+      threads.push_back(std::async(std::launch::async, [&] {
+        pt::time_duration encryption_time, decryption_time;
+        for (std::uint32_t j(0); j != kChunksPerThread; ++j) {
+          const auto& name_value(name_value_pairs[j % name_value_pairs.size()]);
+          pt::ptime start_time(pt::microsec_clock::universal_time());
+          auto content(EncryptChunk(name_value.first, name_value.second));
+          pt::ptime encrypted_time(pt::microsec_clock::universal_time());
+          DecryptChunk(name_value.first, std::move(content));
+          encryption_time += encrypted_time - start_time;
+          decryption_time += pt::microsec_clock::universal_time() - encrypted_time;
+        }
+        return std::make_pair(encryption_time, decryption_time);
+      }));
+    }
+    pt::time_duration encryption_time, decryption_time;
+    for (auto& thread : threads) {
+      auto times(thread.get());
+      encryption_time += times.first;
+      decryption_time += times.second;
+    }
+    // Each rate is the data one thread handled over the average time a thread spent on it.
+    auto per_core_rate([&](const pt::time_duration& total_time) {
+      double seconds(static_cast<double>(total_time.total_microseconds() + 1) / 1e6 /
+                     thread_count);
+      return static_cast<double>(kChunkSize) * kChunksPerThread / 1e9 / seconds;
+    });
+    std::cout << thread_count << " thread(s): " << per_core_rate(encryption_time)
+              << " GB/s per core encrypting, " << per_core_rate(decryption_time)
+              << " GB/s per core decrypting." << std::endl;
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,124 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace {
+
+// Counted per thread, so that other threads' allocations don't skew the figures.
+thread_local std::uint64_t allocation_count(0), allocated_bytes(0);
+
+}  // unnamed namespace
+
+// Counts every allocation made by this test executable, which holds no other tests so that the
+// replacement can't affect them.
+void* operator new(std::size_t size) {
+  ++allocation_count;
+  allocated_bytes += size;
+  if (void* allocation = std::malloc(size == 0 ? 1 : size))
+    return allocation;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* allocation) noexcept { std::free(allocation); }
+
+void operator delete(void* allocation, std::size_t) noexcept { std::free(allocation); }
+
+namespace pt = boost::posix_time;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+namespace {
+
+const std::uint64_t OneKB(1024);
+
+struct Allocations {
+  Allocations() : count(allocation_count), bytes(allocated_bytes) {}
+  std::uint64_t count, bytes;
+};
+
+template <typename Functor>
+void Measure(const std::string& label, std::uint32_t operations, Functor functor) {
+  Allocations before;
+  pt::ptime start_time(pt::microsec_clock::universal_time());
+  functor();
+  pt::ptime stop_time(pt::microsec_clock::universal_time());
+  Allocations after;
+  std::uint64_t duration((stop_time - start_time).total_microseconds());
+  std::cout << "  " << label << ": " << (after.count - before.count) / operations
+            << " allocations, " << (after.bytes - before.bytes) / operations
+            << " bytes allocated, " << duration / operations << " us per get." << std::endl;
+}
+
+}  // unnamed namespace
+
+// Allocation counts show how many times each get copies the chunk: with no copies beyond reading
+// and decrypting, a miss allocates about twice the chunk size and a shared hit nothing of size.
+TEST(ChunkStoreAllocationTest, FUNC_GetAllocations) {
+  const std::uint32_t kChunkCount(16);
+  for (std::uint64_t chunk_size : {4 * OneKB, 64 * OneKB, OneKB * OneKB}) {
+    maidsafe::test::TestPath test_path(
+        maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStoreAllocation"));
+    std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> name_value_pairs;
+    AddRandomNameValuePairs(name_value_pairs, kChunkCount, static_cast<std::uint32_t>(chunk_size));
+    std::cout << chunk_size / OneKB << " KB chunks:" << std::endl;
+    for (bool shared : {false, true}) {
+      ChunkStore chunk_store(*test_path / (shared ? "shared" : "copied"),
+                             DiskUsage(OneKB * OneKB * OneKB), MemoryUsage(64 * OneKB * OneKB));
+      for (const auto& name_value : name_value_pairs)
+        chunk_store.Put(name_value.first, name_value.second);
+      for (const char* pass : {"miss", "hit"}) {
+        Measure(std::string(shared ? "GetShared " : "Get ") + pass, kChunkCount, [&] {
+          for (const auto& name_value : name_value_pairs) {
+            if (shared)
+              EXPECT_EQ(chunk_size, chunk_store.GetShared(name_value.first)->string().size());
+            else
+              EXPECT_EQ(chunk_size, chunk_store.Get(name_value.first).string().size());
+          }
+        });
+      }
+      if (shared) {
+        // A hit hands out the cached value itself.
+        Allocations before;
+        auto value(chunk_store.GetShared(name_value_pairs.front().first));
+        EXPECT_LT(Allocations().bytes - before.bytes, chunk_size);
+      }
+    }
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,279 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store_scrubber.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "boost/filesystem/operations.hpp"
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store/memory_backend.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+// Holds each write while stalled, so that the store has an operation in progress.
+class StallingBackend : public MemoryBackend {
+ public:
+  StallingBackend() : mutex_(), condition_(), stall_(false), stalled_(false) {}
+
+  void Stall() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stall_ = true;
+  }
+
+  void WaitUntilStalled() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return stalled_; });
+  }
+
+  void Release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stall_ = false;
+    }
+    condition_.notify_all();
+  }
+
+  void Write(const NameType& name, const std::vector<byte>& content) override {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stalled_ = stall_;
+      condition_.notify_all();
+      condition_.wait(lock, [this] { return !stall_; });
+      stalled_ = false;
+    }
+    MemoryBackend::Write(name, content);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stall_, stalled_;
+};
+
+class ChunkStoreScrubberTest : public testing::Test {
+ protected:
+  typedef std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> NameValueContainer;
+
+  ChunkStoreScrubberTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStoreScrubber")),
+        chunk_store_(new ChunkStore(*test_path_, DiskUsage(10 * 1024 * 1024))),
+        mutex_(),
+        corrupt_names_() {}
+
+  // Immutable chunks, named by the hash of their content, and mutable chunks with random names.
+  NameValueContainer PutChunks(std::uint32_t count, std::uint32_t size) {
+    NameValueContainer name_value_pairs;
+    for (std::uint32_t i(0); i != count; ++i) {
+      NonEmptyString value(RandomBytes(size));
+      if (i % 2 == 0) {
+        name_value_pairs.emplace_back(ImmutableData(value).NameAndType(), value);
+      } else {
+        name_value_pairs.emplace_back(
+            Data::NameAndTypeId(MakeIdentity(), DataTypeId(detail::TypeId<MutableData>::value)),
+            value);
+      }
+      chunk_store_->Put(name_value_pairs.back().first, value);
+    }
+    return name_value_pairs;
+  }
+
+  fs::path ChunkFile(const Data::NameAndTypeId& name) {
+    for (fs::recursive_directory_iterator it(*test_path_), end; it != end; ++it) {
+      if (it->path().filename() == ".metadata")
+        it.no_push();
+      else if (it->path().filename() == detail::GetFileName(name))
+        return it->path();
+    }
+    return fs::path();
+  }
+
+  void Corrupt(const Data::NameAndTypeId& name) {
+    fs::path path(ChunkFile(name));
+    ASSERT_FALSE(path.empty());
+    ASSERT_TRUE(WriteFile(path, RandomBytes(static_cast<std::uint32_t>(fs::file_size(path)))));
+  }
+
+  std::function<void(const Data::NameAndTypeId&)> OnCorruption() {
+    return [this](const Data::NameAndTypeId& name) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      corrupt_names_.insert(name);
+    };
+  }
+
+  bool WaitForPasses(const ChunkStoreScrubber& scrubber, std::uint64_t passes) {
+    const auto kDeadline(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    while (scrubber.GetStatistics().passes < passes) {
+      if (std::chrono::steady_clock::now() > kDeadline)
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+  }
+
+  maidsafe::test::TestPath test_path_;
+  std::unique_ptr<ChunkStore> chunk_store_;
+  std::mutex mutex_;
+  std::set<Data::NameAndTypeId> corrupt_names_;
+};
+
+TEST_F(ChunkStoreScrubberTest, BEH_ScrubBatch) {
+  auto name_value_pairs(PutChunks(6, 1024));
+  Corrupt(name_value_pairs[0].first);
+  // A mutable chunk's content isn't named by its hash, but it must still decrypt.
+  Corrupt(name_value_pairs[1].first);
+  // An immutable name holding different content.
+  NonEmptyString value(RandomBytes(1024));
+  Data::NameAndTypeId mismatched(ImmutableData(NonEmptyString(RandomBytes(1024))).NameAndType());
+  chunk_store_->Put(mismatched, value);
+  const std::uint64_t kUsage(chunk_store_->CurrentDiskUsage().data);
+
+  std::vector<Data::NameAndTypeId> names;
+  for (const auto& name_value : name_value_pairs)
+    names.push_back(name_value.first);
+  names.push_back(mismatched);
+  names.push_back(GetRandomDataNameAndTypeId());
+  auto results(chunk_store_->ScrubBatch(names));
+  ASSERT_EQ(names.size(), results.size());
+  std::uint64_t corrupt_size(0);
+  for (std::size_t i(0); i != names.size(); ++i) {
+    EXPECT_TRUE(results[i].checked);
+    const bool kCorrupt(i < 2 || i == 6);
+    EXPECT_EQ(kCorrupt, results[i].corrupt) << i;
+    EXPECT_EQ(i != 7, results[i].size != 0) << i;
+    EXPECT_EQ(!kCorrupt && i != 7, chunk_store_->Has(names[i])) << i;
+    EXPECT_EQ(kCorrupt, fs::exists(chunk_store_->QuarantinePath() / detail::GetFileName(names[i])))
+        << i;
+    if (kCorrupt)
+      corrupt_size += results[i].size;
+  }
+  EXPECT_EQ(kUsage - corrupt_size, chunk_store_->CurrentDiskUsage().data);
+  for (std::size_t i(2); i != name_value_pairs.size(); ++i)
+    EXPECT_EQ(name_value_pairs[i].second, chunk_store_->Get(name_value_pairs[i].first));
+
+  // Nothing is left to quarantine.
+  for (const auto& result : chunk_store_->ScrubBatch(names))
+    EXPECT_FALSE(result.corrupt);
+}
+
+TEST_F(ChunkStoreScrubberTest, BEH_QuarantinesCorruptChunks) {
+  auto name_value_pairs(PutChunks(40, 1024));
+  Corrupt(name_value_pairs[4].first);
+  Corrupt(name_value_pairs[9].first);
+  {
+    ChunkStoreScrubber scrubber(*chunk_store_, 100 * 1024 * 1024, OnCorruption());
+    ASSERT_TRUE(WaitForPasses(scrubber, 1));
+    auto statistics(scrubber.GetStatistics());
+    EXPECT_EQ(40U, statistics.chunks_checked);
+    EXPECT_EQ(2U, statistics.corrupt_chunks);
+    EXPECT_LE(40U * 1024, statistics.bytes_checked);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_EQ((std::set<Data::NameAndTypeId>{name_value_pairs[4].first, name_value_pairs[9].first}),
+            corrupt_names_);
+  for (std::size_t i(0); i != name_value_pairs.size(); ++i)
+    EXPECT_EQ(i != 4 && i != 9, chunk_store_->Has(name_value_pairs[i].first)) << i;
+}
+
+TEST_F(ChunkStoreScrubberTest, BEH_YieldsToForegroundOperations) {
+  StallingBackend* backend(new StallingBackend);
+  chunk_store_.reset(new ChunkStore(std::unique_ptr<ChunkStoreBackend>(backend),
+                                    DiskUsage(10 * 1024 * 1024)));
+  std::vector<Data::NameAndTypeId> names;
+  for (const auto& name_value : PutChunks(20, 1024))
+    names.push_back(name_value.first);
+
+  backend->Stall();
+  auto put(std::async(std::launch::async, [this] {
+    chunk_store_->Put(
+        Data::NameAndTypeId(MakeIdentity(), DataTypeId(detail::TypeId<MutableData>::value)),
+        NonEmptyString(RandomBytes(1024)));
+  }));
+  backend->WaitUntilStalled();
+  for (const auto& result : chunk_store_->ScrubBatch(names))
+    EXPECT_FALSE(result.checked);
+
+  ChunkStoreScrubber scrubber(*chunk_store_, 100 * 1024 * 1024, OnCorruption());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto statistics(scrubber.GetStatistics());
+  EXPECT_EQ(0U, statistics.chunks_checked);
+  EXPECT_EQ(0U, statistics.passes);
+
+  // The scrubber carries on once the write is done.
+  backend->Release();
+  put.get();
+  ASSERT_TRUE(WaitForPasses(scrubber, 1));
+  statistics = scrubber.GetStatistics();
+  EXPECT_EQ(21U, statistics.chunks_checked);
+  EXPECT_EQ(0U, statistics.corrupt_chunks);
+}
+
+TEST_F(ChunkStoreScrubberTest, BEH_StopsPromptly) {
+  PutChunks(20, 64 * 1024);
+  const auto kStart(std::chrono::steady_clock::now());
+  {
+    // Slow enough that a pass would take minutes.
+    ChunkStoreScrubber scrubber(*chunk_store_, 1024, OnCorruption());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(0U, scrubber.GetStatistics().passes);
+  }
+  EXPECT_GT(std::chrono::seconds(2), std::chrono::steady_clock::now() - kStart);
+}
+
+TEST_F(ChunkStoreScrubberTest, FUNC_RespectsByteBudget) {
+  const std::uint32_t kChunkCount(40), kChunkSize(64 * 1024);
+  const std::uint64_t kBytesPerSecond(1024 * 1024);
+  PutChunks(kChunkCount, kChunkSize);
+  const auto kStart(std::chrono::steady_clock::now());
+  ChunkStoreScrubber scrubber(*chunk_store_, kBytesPerSecond, OnCorruption());
+  ASSERT_TRUE(WaitForPasses(scrubber, 1));
+  const auto kElapsed(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - kStart));
+  auto statistics(scrubber.GetStatistics());
+  std::cout << statistics.bytes_checked << " bytes scrubbed at a budget of " << kBytesPerSecond
+            << " bytes/s in " << kElapsed.count() << " ms" << std::endl;
+  // The last batch's bytes are paid for after it's read.
+  const std::uint64_t kLastBatchBytes(ChunkStoreScrubber::kBatchSize * (kChunkSize + 1024));
+  EXPECT_LE((statistics.bytes_checked - kLastBatchBytes) * 1000 / kBytesPerSecond,
+            static_cast<std::uint64_t>(kElapsed.count()));
+  EXPECT_EQ(0U, statistics.corrupt_chunks);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -18,7 +18,13 @@
 
 #include "maidsafe/vault/chunk_store.h"
 
+#include <atomic>
+#include <deque>
+#include <future>
 #include <memory>
+#include <set>
+#include <stdexcept>
+#include <thread>
 
 #include "boost/filesystem/path.hpp"
 #include "boost/filesystem/operations.hpp"
@@ -29,6 +35,7 @@
 #include "maidsafe/common/error.h"
 #include "maidsafe/common/test.h"
 #include "maidsafe/common/utils.h"
+#include "maidsafe/vault/chunk_store/chunk_crypto.h"
 #include "maidsafe/vault/tests/chunk_store_test_utils.h"
 
 namespace fs = boost::filesystem;
@@ -74,6 +81,18 @@ class ChunkStoreTest : public testing::Test {
     return true;
   }
 
+  // The chunk files under 'path', leaving out the store's metadata.
+  std::set<fs::path> ChunkFiles(const fs::path& path) {
+    std::set<fs::path> files;
+    for (fs::recursive_directory_iterator it(path), end; it != end; ++it) {
+      if (it->path().filename() == ".metadata")
+        it.no_push();
+      else if (fs::is_regular_file(it->path()))
+        files.insert(it->path());
+    }
+    return files;
+  }
+
   NameValueContainer PopulateChunkStore(std::uint32_t num_entries, std::uint32_t disk_entries,
                                         const fs::path& test_path) {
     boost::system::error_code error_code;
@@ -138,6 +157,8 @@ TEST_F(ChunkStoreTest, BEH_RemoveDiskStore) {
   NonEmptyString small_value(RandomBytes(kSize));
   ASSERT_NO_THROW(chunk_store_->Put(name, small_value));
   ASSERT_NO_THROW(chunk_store_->Delete(name));
+  // The root with a single level of chunk directories, since the store is small, and the metadata
+  // directory holding the layout descriptor and the usage journal's files.
   EXPECT_TRUE(6 == fs::remove_all(chunk_store_path, error_code));
   ASSERT_FALSE(fs::exists(chunk_store_path, error_code));
   NameType name1(MakeIdentity(), DataTypeId(RandomUint32()));
@@ -221,6 +242,1075 @@ TEST_F(ChunkStoreTest, FUNC_Restart) {
   EXPECT_EQ((num_entries * (OneKB + AesPadding)), chunk_store_->CurrentDiskUsage().data);
 }
 
+TEST_F(ChunkStoreTest, BEH_RestartRecoversUsageFromJournal) {
+  NameValueContainer name_value_pairs(PopulateChunkStore(4, 4, chunk_store_path_));
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  const std::uint64_t kUsage(chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(3 * (OneKB + AesPadding), kUsage);
+  chunk_store_.reset();
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_EQ(kUsage, chunk_store_->CurrentDiskUsage().data);
+
+  // A second restart without any intervening writes must give the same result.
+  chunk_store_.reset();
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_EQ(kUsage, chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, BEH_RestartAfterUncleanShutdownRescans) {
+  PopulateChunkStore(2, 4, chunk_store_path_);
+  const std::uint64_t kUsage(chunk_store_->CurrentDiskUsage().data);
+  chunk_store_.reset();
+  // Simulate a crash by removing the clean-shutdown marker, and make the snapshot wrong so only a
+  // rescan can produce the right answer.
+  fs::path metadata_path(chunk_store_path_ / ".metadata");
+  ASSERT_TRUE(fs::remove(metadata_path / "clean"));
+  ASSERT_TRUE(WriteFile(metadata_path / "usage", convert::ToByteVector("0 0")));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  EXPECT_EQ(kUsage, chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, BEH_RestartAfterCrashChecksInFlightChunks) {
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 3, OneKB);
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second));
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[1].first, name_value_pairs[1].second));
+  auto files(ChunkFiles(chunk_store_path_));
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[2].first, name_value_pairs[2].second));
+  auto new_files(ChunkFiles(chunk_store_path_));
+  ASSERT_EQ(3U, new_files.size());
+  for (const auto& file : files)
+    new_files.erase(file);
+  const fs::path kTornChunk(*new_files.begin());
+  chunk_store_.reset();
+
+  // Simulate a crash while the last two chunks were being overwritten, which has torn the last of
+  // them and left a temporary file behind.
+  fs::path metadata_path(chunk_store_path_ / ".metadata");
+  {
+    UsageJournal journal(metadata_path);
+    auto recovery(journal.Recover());
+    ASSERT_TRUE(recovery && recovery->clean);
+    journal.Open(recovery->usage);
+    journal.Begin(name_value_pairs[1].first, OneKB + AesPadding);
+    journal.Begin(name_value_pairs[2].first, OneKB + AesPadding);
+  }
+  ASSERT_TRUE(fs::remove(metadata_path / "clean"));
+  ASSERT_TRUE(WriteFile(kTornChunk, RandomBytes(10)));
+  const fs::path kTempFile(kTornChunk.parent_path() / ('.' + kTornChunk.filename().string() +
+                                                       ".tmp"));
+  ASSERT_TRUE(WriteFile(kTempFile, RandomBytes(OneKB)));
+
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  EXPECT_EQ(2 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[0].first) == name_value_pairs[0].second);
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[1].first) == name_value_pairs[1].second);
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[2].first));
+  EXPECT_FALSE(fs::exists(kTornChunk));
+  EXPECT_FALSE(fs::exists(kTempFile));
+  EXPECT_EQ(2U, ReadNames(*chunk_store_->Names()).size());
+
+  // The recovered store is journalled like any other.
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[2].first, name_value_pairs[2].second));
+  chunk_store_.reset();
+  ASSERT_TRUE(fs::remove(metadata_path / "clean"));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  EXPECT_EQ(3 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[2].first) == name_value_pairs[2].second);
+}
+
+TEST_F(ChunkStoreTest, BEH_NameFilterRebuildFailureFallsBackToDisk) {
+  NameValueContainer name_value_pairs(PopulateChunkStore(4, 4, chunk_store_path_));
+  chunk_store_.reset();
+  // A file whose name can't be decoded makes listing the names throw, and an unclean restart
+  // rebuilds the filter in the background.
+  auto files(ChunkFiles(chunk_store_path_));
+  ASSERT_FALSE(files.empty());
+  ASSERT_TRUE(WriteFile(files.begin()->parent_path() / "stray", RandomBytes(10)));
+  ASSERT_TRUE(fs::remove(chunk_store_path_ / ".metadata" / "clean"));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, max_disk_usage_));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_TRUE(chunk_store_->Has(name_value.first));
+    EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+  }
+  EXPECT_FALSE(chunk_store_->Has(GetRandomDataNameAndTypeId()));
+}
+
+TEST_F(ChunkStoreTest, BEH_CrashWhileFoldingJournalIntoSnapshot) {
+  fs::path metadata_path(*test_path / "metadata"), crashed_path(*test_path / "crashed");
+  ASSERT_TRUE(fs::create_directories(crashed_path));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 4, OneKB);
+  {
+    // The log is folded into a new snapshot at the third End.
+    UsageJournal journal(metadata_path, 4);
+    journal.Open(0);
+    // Keeps what a crash after writing the new snapshot, before starting its log, would leave.
+    journal.SetSnapshotWrittenHook([&] {
+      for (const char* file_name : {"usage", "usage.journal"}) {
+        auto content(ReadFile(metadata_path / file_name));
+        EXPECT_TRUE(content && WriteFile(crashed_path / file_name, *content));
+      }
+    });
+    for (const auto& name_value : name_value_pairs) {
+      journal.Begin(name_value.first, 0);
+      journal.End(name_value.first, 100);
+    }
+  }
+
+  // The old log mustn't be replayed over the snapshot which already includes it, so a rescan is
+  // needed.
+  EXPECT_EQ(0U, convert::ToString(*ReadFile(crashed_path / "usage")).find("300 "));
+  UsageJournal crashed_journal(crashed_path);
+  EXPECT_FALSE(static_cast<bool>(crashed_journal.Recover()));
+
+  UsageJournal journal(metadata_path);
+  auto recovery(journal.Recover());
+  ASSERT_TRUE(recovery && recovery->clean);
+  EXPECT_EQ(400U, recovery->usage);
+  EXPECT_TRUE(recovery->in_flight.empty());
+}
+
+TEST_F(ChunkStoreTest, FUNC_StartupTimeByChunkCount) {
+  for (std::uint32_t num_entries(1000); num_entries <= 16000; num_entries *= 4) {
+    maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStore"));
+    PopulateChunkStore(num_entries, num_entries, *test_path / "store");
+    DiskUsage disk_usage(chunk_store_->MaxDiskUsage());
+    chunk_store_.reset();
+
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, disk_usage));
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    std::cout << num_entries << " chunks, clean restart: ";
+    PrintResult(start_time, stop_time);
+    EXPECT_EQ(num_entries * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+    chunk_store_.reset();
+
+    ASSERT_TRUE(fs::remove(chunk_store_path_ / ".metadata" / "clean"));
+    start_time = pt::microsec_clock::universal_time();
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, disk_usage));
+    stop_time = pt::microsec_clock::universal_time();
+    std::cout << num_entries << " chunks, unclean restart: ";
+    PrintResult(start_time, stop_time);
+    EXPECT_EQ(num_entries * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+    chunk_store_.reset();
+
+    ASSERT_TRUE(fs::remove(chunk_store_path_ / ".metadata" / "clean"));
+    ASSERT_TRUE(fs::remove(chunk_store_path_ / ".metadata" / "usage.journal"));
+    start_time = pt::microsec_clock::universal_time();
+    chunk_store_.reset(new ChunkStore(chunk_store_path_, disk_usage));
+    stop_time = pt::microsec_clock::universal_time();
+    std::cout << num_entries << " chunks, restart with rescan: ";
+    PrintResult(start_time, stop_time);
+    EXPECT_EQ(num_entries * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+    chunk_store_.reset();
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_FanOutFromCapacity) {
+  auto recorded_layout([](const fs::path& store_path) {
+    return convert::ToString(*ReadFile(store_path / ".metadata" / "layout"));
+  });
+  // Deep enough for the capacity's worth of 256KB chunks, at a few hundred per directory.
+  ChunkStore(*test_path / "small", DiskUsage(OneKB * OneKB));
+  EXPECT_EQ("files 1", recorded_layout(*test_path / "small"));
+  ChunkStore(*test_path / "large", DiskUsage(std::uint64_t(64) * OneKB * OneKB * OneKB));
+  EXPECT_EQ("files 3", recorded_layout(*test_path / "large"));
+
+  // A store recorded before the depth was keeps five levels.
+  fs::path legacy_path(*test_path / "legacy");
+  fs::create_directories(legacy_path / ".metadata");
+  ASSERT_TRUE(WriteFile(legacy_path / ".metadata" / "layout", convert::ToByteVector("files")));
+  chunk_store_.reset(new ChunkStore(legacy_path, DiskUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[0].second));
+  chunk_store_.reset();
+  int chunk_file_level(-1);
+  for (fs::recursive_directory_iterator itr(legacy_path); itr != fs::recursive_directory_iterator();
+       ++itr) {
+    if (itr->path().filename() == ".metadata")
+      itr.no_push();
+    else if (fs::is_regular_file(itr->path()))
+      chunk_file_level = itr.level();
+  }
+  EXPECT_EQ(5, chunk_file_level);
+  EXPECT_EQ("files", recorded_layout(legacy_path));
+}
+
+TEST_F(ChunkStoreTest, BEH_PackFileLayout) {
+  fs::path pack_store_path(*test_path / "pack_store");
+  chunk_store_.reset(new ChunkStore(pack_store_path, max_disk_usage_, MemoryUsage(0),
+                                    ChunkStore::Layout::kPackFile));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 3, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  NonEmptyString new_value(RandomBytes(OneKB / 2));
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, new_value));
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[1].first));
+  const std::uint64_t kUsage((OneKB / 2 + AesPadding) + (OneKB + AesPadding));
+  EXPECT_EQ(kUsage, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(2U, ReadNames(*chunk_store_->Names()).size());
+
+  // Reopen uncleanly, so the index is rebuilt from the segment files and the usage from the
+  // journal.
+  chunk_store_.reset();
+  ASSERT_TRUE(fs::remove(pack_store_path / ".metadata" / "clean"));
+  chunk_store_.reset(new ChunkStore(pack_store_path, max_disk_usage_, MemoryUsage(0),
+                                    ChunkStore::Layout::kPackFile));
+  EXPECT_EQ(kUsage, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[0].first) == new_value);
+  EXPECT_THROW(chunk_store_->Get(name_value_pairs[1].first), maidsafe_error);
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[2].first) == name_value_pairs[2].second);
+  EXPECT_THROW(chunk_store_->Delete(name_value_pairs[1].first), maidsafe_error);
+  chunk_store_.reset();
+
+  // A store can only be opened with the layout it was created with.
+  EXPECT_THROW(ChunkStore(pack_store_path, max_disk_usage_), maidsafe_error);
+  PopulateChunkStore(1, 1, *test_path / "file_store");
+  EXPECT_THROW(ChunkStore(*test_path / "file_store", max_disk_usage_, MemoryUsage(0),
+                          ChunkStore::Layout::kPackFile), maidsafe_error);
+}
+
+TEST_F(ChunkStoreTest, BEH_StripedDiskRoots) {
+  std::vector<ChunkStore::DiskRoot> disk_roots{
+      {*test_path / "disk0", DiskUsage(256 * OneKB)},
+      {*test_path / "disk1", DiskUsage(256 * OneKB)},
+      {*test_path / "disk2", DiskUsage(512 * OneKB)}};
+  chunk_store_.reset(new ChunkStore(disk_roots));
+  EXPECT_EQ(1024 * OneKB, chunk_store_->MaxDiskUsage().data);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 200, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+
+  // Chunks are spread in proportion to capacity.
+  auto devices(chunk_store_->Devices());
+  ASSERT_EQ(3U, devices.size());
+  std::uint64_t usage(0), writes(0);
+  for (const auto& device : devices) {
+    EXPECT_FALSE(device.failing);
+    EXPECT_GT(device.writes, 0U);
+    EXPECT_EQ(device.writes * (OneKB + AesPadding), device.usage);
+    usage += device.usage;
+    writes += device.writes;
+  }
+  EXPECT_EQ(200U, writes);
+  EXPECT_EQ(chunk_store_->CurrentDiskUsage().data, usage);
+  EXPECT_GT(devices[2].writes, devices[0].writes);
+  EXPECT_GT(devices[2].writes, devices[1].writes);
+
+  // Reopen, with the roots in a different order.
+  chunk_store_.reset();
+  std::swap(disk_roots[0], disk_roots[2]);
+  chunk_store_.reset(new ChunkStore(disk_roots));
+  EXPECT_EQ(usage, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(devices[2].usage, chunk_store_->Devices()[0].usage);
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+  std::uint64_t bytes_read(0);
+  for (const auto& device : chunk_store_->Devices())
+    bytes_read += device.bytes_read;
+  EXPECT_EQ(usage, bytes_read);
+  EXPECT_EQ(200U, ReadNames(*chunk_store_->Names()).size());
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Delete(name_value.first));
+  for (const auto& device : chunk_store_->Devices())
+    EXPECT_EQ(0U, device.usage);
+
+  disk_roots.push_back(disk_roots.front());
+  EXPECT_THROW(ChunkStore{disk_roots}, maidsafe_error);
+  EXPECT_THROW(ChunkStore{std::vector<ChunkStore::DiskRoot>()}, maidsafe_error);
+}
+
+TEST_F(ChunkStoreTest, BEH_StripedFullDiskRoot) {
+  chunk_store_.reset(new ChunkStore(std::vector<ChunkStore::DiskRoot>{
+      {*test_path / "small", DiskUsage(4 * OneKB)},
+      {*test_path / "large", DiskUsage(OneKB * OneKB)}}));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  auto devices(chunk_store_->Devices());
+  EXPECT_LE(devices[0].usage, 4 * OneKB);
+  EXPECT_EQ(100 * (OneKB + AesPadding), devices[0].usage + devices[1].usage);
+
+  // Chunks which no longer fit where they are move to another device.
+  for (auto& name_value : name_value_pairs) {
+    name_value.second = NonEmptyString(RandomBytes(2 * OneKB));
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  }
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+  devices = chunk_store_->Devices();
+  EXPECT_LE(devices[0].usage, 4 * OneKB);
+  EXPECT_EQ(100 * (2 * OneKB + AesPadding), devices[0].usage + devices[1].usage);
+  EXPECT_EQ(0U, chunk_store_->Devices()[0].errors);
+}
+
+TEST_F(ChunkStoreTest, BEH_StripedFailingDiskRoot) {
+  fs::path failing_root(*test_path / "failing");
+  chunk_store_.reset(new ChunkStore(std::vector<ChunkStore::DiskRoot>{
+      {*test_path / "working", DiskUsage(OneKB * OneKB)},
+      {failing_root, DiskUsage(OneKB * OneKB)}}));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, OneKB);
+  for (std::size_t i(0); i != 50; ++i)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[i].first, name_value_pairs[i].second));
+  ASSERT_GT(chunk_store_->Devices()[1].writes, 0U);
+
+  // Swap the root for a file, so that every write to it fails.
+  fs::remove_all(failing_root);
+  ASSERT_TRUE(WriteFile(failing_root, convert::ToByteVector("not a directory")));
+  for (std::size_t i(50); i != 100; ++i)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[i].first, name_value_pairs[i].second));
+  auto devices(chunk_store_->Devices());
+  EXPECT_FALSE(devices[0].failing);
+  EXPECT_TRUE(devices[1].failing);
+  EXPECT_GT(devices[1].errors, 0U);
+  for (std::size_t i(50); i != 100; ++i)
+    EXPECT_TRUE(chunk_store_->Get(name_value_pairs[i].first) == name_value_pairs[i].second);
+  fs::remove(failing_root);
+}
+
+// Throws from every call while failing.
+class FlakyBackend : public MemoryBackend {
+ public:
+  FlakyBackend() : failing(false) {}
+
+  std::uint64_t Size(const NameType& name) const override {
+    Check();
+    return MemoryBackend::Size(name);
+  }
+  void Write(const NameType& name, const std::vector<byte>& content) override {
+    Check();
+    MemoryBackend::Write(name, content);
+  }
+  boost::optional<std::vector<byte>> Read(const NameType& name) const override {
+    Check();
+    return MemoryBackend::Read(name);
+  }
+  std::uint64_t Remove(const NameType& name) override {
+    Check();
+    return MemoryBackend::Remove(name);
+  }
+
+  std::atomic<bool> failing;
+
+ private:
+  void Check() const {
+    if (failing)
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+};
+
+TEST_F(ChunkStoreTest, BEH_StripedDeviceRejoinsWithoutStaleCopies) {
+  const std::chrono::milliseconds kRetryInterval(100);
+  std::vector<FlakyBackend*> backends{new FlakyBackend, new FlakyBackend};
+  std::vector<StripedBackend::Device> devices;
+  for (std::size_t i(0); i != backends.size(); ++i) {
+    fs::path root(*test_path / ("device" + std::to_string(i)));
+    devices.push_back(StripedBackend::Device{root, root / ".metadata", OneKB * OneKB,
+                                             std::unique_ptr<ChunkStoreBackend>(backends[i])});
+  }
+  StripedBackend striped_backend(std::move(devices), kRetryInterval);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 20, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    striped_backend.Write(name_value.first, name_value.second.string());
+  // Two of the chunks held by the first device.
+  std::vector<NameType> names;
+  for (const auto& name_value : name_value_pairs) {
+    if (backends[0]->Size(name_value.first) != 0)
+      names.push_back(name_value.first);
+  }
+  ASSERT_LE(2U, names.size());
+  names.resize(2);
+
+  // Both are overwritten, so go to the second device, and the second is then removed.
+  backends[0]->failing = true;
+  EXPECT_FALSE(static_cast<bool>(striped_backend.Read(names[0])));
+  EXPECT_TRUE(striped_backend.Statistics()[0].failing);
+  const std::vector<byte> kNewContent(RandomBytes(OneKB));
+  for (const auto& name : names)
+    striped_backend.Write(name, kNewContent);
+  EXPECT_EQ(kNewContent.size(), striped_backend.Remove(names[1]));
+
+  backends[0]->failing = false;
+  std::this_thread::sleep_for(kRetryInterval * 2);
+  EXPECT_FALSE(striped_backend.Statistics()[0].failing);
+  EXPECT_TRUE(*striped_backend.Read(names[0]) == kNewContent);
+  EXPECT_FALSE(static_cast<bool>(striped_backend.Read(names[1])));
+  EXPECT_EQ(0U, striped_backend.Size(names[1]));
+  EXPECT_THROW(striped_backend.Remove(names[1]), maidsafe_error);
+  EXPECT_EQ(0U, backends[0]->Size(names[0]));
+  EXPECT_EQ(0U, backends[0]->Size(names[1]));
+  EXPECT_EQ(19U, ReadNames(*striped_backend.Names(NameRange(), 1).front()).size());
+  std::uint64_t usage(0);
+  for (const auto& device : striped_backend.Statistics())
+    usage += device.usage;
+  EXPECT_EQ(backends[0]->ScanUsage() + backends[1]->ScanUsage(), usage);
+}
+
+TEST_F(ChunkStoreTest, BEH_TieredDiskRoots) {
+  const ChunkStore::DiskRoot kFastTier{*test_path / "fast", DiskUsage(4 * (OneKB + AesPadding))};
+  const ChunkStore::DiskRoot kSlowTier{*test_path / "slow", DiskUsage(OneKB * OneKB)};
+  chunk_store_.reset(new ChunkStore(kFastTier, kSlowTier));
+  EXPECT_EQ(kFastTier.capacity.data + kSlowTier.capacity.data,
+            chunk_store_->MaxDiskUsage().data);
+  EXPECT_TRUE(chunk_store_->Devices().empty());
+
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+
+  // The background mover may have demoted some of the chunks by now.
+  auto check_tiers([&] {
+    auto tiers(chunk_store_->Tiers());
+    ASSERT_EQ(2U, tiers.size());
+    EXPECT_EQ(kFastTier.path, tiers[0].root);
+    EXPECT_LE(tiers[0].usage, kFastTier.capacity.data);
+    EXPECT_NE(0U, tiers[1].usage);
+    // A chunk being moved is counted by both tiers.
+    EXPECT_LE(chunk_store_->CurrentDiskUsage().data, tiers[0].usage + tiers[1].usage);
+  });
+  check_tiers();
+  EXPECT_EQ(10 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(10U, ReadNames(*chunk_store_->Names()).size());
+
+  chunk_store_.reset();
+  chunk_store_.reset(new ChunkStore(kFastTier, kSlowTier));
+  check_tiers();
+  EXPECT_EQ(10 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Delete(name_value.first));
+  EXPECT_EQ(0U, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_EQ(0U, chunk_store_->Tiers()[0].usage + chunk_store_->Tiers()[1].usage);
+}
+
+TEST_F(ChunkStoreTest, BEH_MemoryBackend) {
+  EXPECT_THROW(ChunkStore(std::unique_ptr<ChunkStoreBackend>(new MemoryBackend),
+                          DiskUsage(OneKB), MemoryUsage(0), *test_path / "store"),
+               maidsafe_error);
+  chunk_store_.reset(new ChunkStore(std::unique_ptr<ChunkStoreBackend>(new MemoryBackend),
+                                    DiskUsage(4 * (OneKB + AesPadding))));
+  EXPECT_TRUE(chunk_store_->DiskPath().empty());
+
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 5, OneKB);
+  for (std::size_t i(0); i != 4; ++i)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[i].first, name_value_pairs[i].second));
+  EXPECT_EQ(4 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+  EXPECT_THROW(chunk_store_->Put(name_value_pairs[4].first, name_value_pairs[4].second),
+               maidsafe_error);
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[4].first));
+  for (std::size_t i(0); i != 4; ++i) {
+    EXPECT_TRUE(chunk_store_->Has(name_value_pairs[i].first));
+    EXPECT_TRUE(chunk_store_->Get(name_value_pairs[i].first) == name_value_pairs[i].second);
+  }
+  EXPECT_EQ(4U, ReadNames(*chunk_store_->Names()).size());
+
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[4].first, name_value_pairs[4].second));
+  EXPECT_EQ(4 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+
+  // Nothing survives the store.
+  chunk_store_.reset(new ChunkStore(std::unique_ptr<ChunkStoreBackend>(new MemoryBackend),
+                                    DiskUsage(OneKB * OneKB)));
+  EXPECT_EQ(0U, chunk_store_->CurrentDiskUsage().data);
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[4].first));
+}
+
+TEST_F(ChunkStoreTest, BEH_RangeReads) {
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  const std::uint64_t kValueSize(5 * kChunkBlockSize / 2);
+  NameType name(MakeIdentity(), DataTypeId(RandomUint32()));
+  NonEmptyString value(RandomBytes(static_cast<std::uint32_t>(kValueSize)));
+  ASSERT_NO_THROW(chunk_store_->Put(name, value));
+  auto expected([&](std::uint64_t offset, std::uint64_t length) {
+    return NonEmptyString(std::vector<byte>(
+        value.string().begin() + offset,
+        value.string().begin() + offset + std::min(length, kValueSize - offset)));
+  });
+  for (auto range : std::vector<std::pair<std::uint64_t, std::uint64_t>>{
+           {0, 1}, {10, 100}, {kChunkBlockSize - 5, 10}, {kChunkBlockSize, kChunkBlockSize},
+           {kValueSize - 1, 1}, {kChunkBlockSize + 7, kValueSize}}) {
+    EXPECT_TRUE(chunk_store_->GetRange(name, range.first, range.second) ==
+                expected(range.first, range.second))
+        << range.first << " " << range.second;
+  }
+  EXPECT_THROW(chunk_store_->GetRange(name, kValueSize, 1), maidsafe_error);
+  EXPECT_THROW(chunk_store_->GetRange(name, 0, 0), maidsafe_error);
+  EXPECT_THROW(chunk_store_->GetRange(NameType(MakeIdentity(), DataTypeId(0)), 0, 1),
+               maidsafe_error);
+
+  // Small values and cached values are served too.
+  NameType small_name(MakeIdentity(), DataTypeId(RandomUint32()));
+  NonEmptyString small_value(RandomBytes(100));
+  ASSERT_NO_THROW(chunk_store_->Put(small_name, small_value));
+  EXPECT_TRUE(chunk_store_->GetRange(small_name, 90, 20) ==
+              NonEmptyString(std::vector<byte>(small_value.string().begin() + 90,
+                                               small_value.string().end())));
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB), MemoryUsage(OneKB * OneKB)));
+  ASSERT_NO_THROW(chunk_store_->Get(name));
+  EXPECT_TRUE(chunk_store_->GetRange(name, 3, kChunkBlockSize) == expected(3, kChunkBlockSize));
+}
+
+TEST_F(ChunkStoreTest, BEH_StreamingWrites) {
+  const std::uint64_t kValueSize(2 * kChunkBlockSize + 3);
+  NonEmptyString value(RandomBytes(static_cast<std::uint32_t>(kValueSize)));
+  // Whole blocks, pieces straddling blocks, and empty pieces.
+  auto write([&](ChunkStore::Writer& writer) {
+    const std::vector<std::uint64_t> kPieceSizes{1000, 0, kChunkBlockSize, 2, kChunkBlockSize};
+    std::uint64_t offset(0);
+    for (auto piece_size : kPieceSizes) {
+      piece_size = std::min(piece_size, kValueSize - offset);
+      writer.Append(std::vector<byte>(value.string().begin() + offset,
+                                      value.string().begin() + offset + piece_size));
+      offset += piece_size;
+    }
+    writer.Append(std::vector<byte>(value.string().begin() + offset, value.string().end()));
+  });
+
+  std::vector<std::unique_ptr<ChunkStore>> stores;
+  stores.emplace_back(new ChunkStore(*test_path / "file_per_chunk", DiskUsage(OneKB * OneKB)));
+  stores.emplace_back(new ChunkStore(*test_path / "pack_file", DiskUsage(OneKB * OneKB),
+                                     MemoryUsage(0), ChunkStore::Layout::kPackFile));
+  stores.emplace_back(new ChunkStore(std::unique_ptr<ChunkStoreBackend>(new MemoryBackend),
+                                     DiskUsage(OneKB * OneKB)));
+  stores.emplace_back(new ChunkStore(std::vector<ChunkStore::DiskRoot>{
+      {*test_path / "device0", DiskUsage(OneKB * OneKB)},
+      {*test_path / "device1", DiskUsage(OneKB * OneKB)}}));
+  stores.emplace_back(
+      new ChunkStore(ChunkStore::DiskRoot{*test_path / "fast", DiskUsage(OneKB * OneKB)},
+                     ChunkStore::DiskRoot{*test_path / "slow", DiskUsage(OneKB * OneKB)}));
+  // Striped and tiered backends pass the pieces straight on to a writer on one of their children,
+  // which reserves space for them there.
+  auto child_usage([](const ChunkStore& chunk_store) {
+    std::uint64_t usage(0);
+    for (const auto& device : chunk_store.Devices())
+      usage += device.usage;
+    for (const auto& tier : chunk_store.Tiers())
+      usage += tier.usage;
+    return usage;
+  });
+  for (auto& chunk_store : stores) {
+    NameType name(MakeIdentity(), DataTypeId(RandomUint32()));
+    ASSERT_NO_THROW(chunk_store->Put(name, NonEmptyString(RandomBytes(OneKB))));
+    const bool kHasChildren(child_usage(*chunk_store) != 0);
+    {
+      // An abandoned writer stores nothing.
+      auto writer(chunk_store->OpenWriter(name));
+      write(*writer);
+      EXPECT_LT(OneKB + AesPadding, chunk_store->CurrentDiskUsage().data);
+      if (kHasChildren) {
+        EXPECT_LT(OneKB + AesPadding, child_usage(*chunk_store));
+      }
+    }
+    EXPECT_EQ(OneKB + AesPadding, chunk_store->CurrentDiskUsage().data);
+    if (kHasChildren) {
+      EXPECT_EQ(OneKB + AesPadding, child_usage(*chunk_store));
+    }
+    EXPECT_EQ(OneKB, chunk_store->Get(name).string().size());
+
+    auto writer(chunk_store->OpenWriter(name));
+    write(*writer);
+    ASSERT_NO_THROW(writer->Commit());
+    EXPECT_THROW(writer->Commit(), maidsafe_error);
+    writer.reset();
+    EXPECT_TRUE(chunk_store->Get(name) == value);
+    EXPECT_TRUE(chunk_store->GetRange(name, kChunkBlockSize, 10) ==
+                NonEmptyString(std::vector<byte>(value.string().begin() + kChunkBlockSize,
+                                                 value.string().begin() + kChunkBlockSize + 10)));
+    EXPECT_EQ(kValueSize + 3 * AesPadding, chunk_store->CurrentDiskUsage().data);
+    if (kHasChildren) {
+      EXPECT_EQ(kValueSize + 3 * AesPadding, child_usage(*chunk_store));
+    }
+    EXPECT_TRUE(chunk_store->Has(name));
+    EXPECT_THROW(chunk_store->OpenWriter(name)->Commit(), maidsafe_error);
+
+    // A value which exactly fills its last block, appended a block at a time.
+    NonEmptyString whole_blocks(RandomBytes(static_cast<std::uint32_t>(2 * kChunkBlockSize)));
+    writer = chunk_store->OpenWriter(name);
+    writer->Append(std::vector<byte>(whole_blocks.string().begin(),
+                                     whole_blocks.string().begin() + kChunkBlockSize));
+    writer->Append(std::vector<byte>(whole_blocks.string().begin() + kChunkBlockSize,
+                                     whole_blocks.string().end()));
+    ASSERT_NO_THROW(writer->Commit());
+    EXPECT_TRUE(chunk_store->Get(name) == whole_blocks);
+    EXPECT_TRUE(chunk_store->GetRange(name, 0, 1) ==
+                NonEmptyString(std::vector<byte>(1, whole_blocks.string().front())));
+    EXPECT_TRUE(chunk_store->GetRange(name, kChunkBlockSize, kChunkBlockSize) ==
+                NonEmptyString(std::vector<byte>(whole_blocks.string().begin() + kChunkBlockSize,
+                                                 whole_blocks.string().end())));
+  }
+  stores.clear();
+
+  // A value which outgrows the store is rejected as it's appended.
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(kChunkBlockSize)));
+  auto writer(chunk_store_->OpenWriter(NameType(MakeIdentity(), DataTypeId(RandomUint32()))));
+  EXPECT_THROW(write(*writer), maidsafe_error);
+  writer.reset();
+  EXPECT_EQ(0U, chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, FUNC_SmallChunkLayoutThroughput) {
+  const std::uint32_t kNumEntries(4000), kValueSize(512);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kNumEntries, kValueSize);
+  for (auto layout : {ChunkStore::Layout::kFilePerChunk, ChunkStore::Layout::kPackFile}) {
+    maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStore"));
+    chunk_store_.reset(new ChunkStore(*test_path / "store", DiskUsage(OneKB * OneKB * OneKB),
+                                      MemoryUsage(0), layout));
+    std::cout << (layout == ChunkStore::Layout::kPackFile ? "Pack file" : "File per chunk")
+              << " layout, " << kNumEntries << " x " << kValueSize << " byte chunks" << std::endl;
+
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    for (const auto& name_value : name_value_pairs)
+      chunk_store_->Put(name_value.first, name_value.second);
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    std::cout << "  Put: ";
+    PrintResult(start_time, stop_time);
+
+    start_time = pt::microsec_clock::universal_time();
+    for (const auto& name_value : name_value_pairs)
+      EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+    stop_time = pt::microsec_clock::universal_time();
+    std::cout << "  Get: ";
+    PrintResult(start_time, stop_time);
+    chunk_store_.reset();
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_ConcurrentPutsRespectMaxDiskUsage) {
+  const std::uint32_t kThreadCount(8);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kThreadCount, OneKB);
+  std::atomic<std::uint32_t> stored_count(0);
+  std::vector<std::thread> threads;
+  for (const auto& name_value : name_value_pairs) {
+    threads.emplace_back([&, name_value] {
+      try {
+        chunk_store_->Put(name_value.first, name_value.second);
+        ++stored_count;
+      } catch (const maidsafe_error&) {}
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  // Only four 1KB chunks fit in the default max disk usage.
+  EXPECT_EQ(4U, stored_count);
+  EXPECT_EQ(kDefaultMaxDiskUsage, chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, FUNC_MultiThreadedThroughput) {
+  const std::uint32_t kOpsPerThread(200), kValueSize(4 * OneKB);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(1000 * OneKB * OneKB)));
+  for (std::uint32_t thread_count(1); thread_count <= 16; thread_count *= 2) {
+    std::vector<NameValueContainer> name_value_pairs(thread_count);
+    for (auto& thread_name_values : name_value_pairs)
+      AddRandomNameValuePairs(thread_name_values, kOpsPerThread, kValueSize);
+    std::vector<std::thread> threads;
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    for (const auto& thread_name_values : name_value_pairs) {
+      threads.emplace_back([&] {
+        for (const auto& name_value : thread_name_values) {
+          chunk_store_->Put(name_value.first, name_value.second);
+          EXPECT_TRUE(chunk_store_->Get(name_value.first) == name_value.second);
+          chunk_store_->Delete(name_value.first);
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    std::uint64_t duration((stop_time - start_time).total_microseconds());
+    if (duration == 0)
+      duration = 1;
+    std::cout << thread_count << " thread(s): "
+              << (3 * kOpsPerThread * thread_count * 1000000.0) / duration << " ops/sec."
+              << std::endl;
+    EXPECT_EQ(0U, chunk_store_->CurrentDiskUsage().data);
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_HasAndNames) {
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 20, OneKB);
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_FALSE(chunk_store_->Has(name_value.first));
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+    EXPECT_TRUE(chunk_store_->Has(name_value.first));
+  }
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[0].first));
+  EXPECT_FALSE(chunk_store_->Has(name_value_pairs[0].first));
+  name_value_pairs.erase(name_value_pairs.begin());
+
+  auto check_names([&] {
+    std::set<NameType> expected, actual;
+    for (const auto& name_value : name_value_pairs) {
+      EXPECT_TRUE(chunk_store_->Has(name_value.first));
+      expected.insert(name_value.first);
+    }
+    for (const auto& name : ReadNames(*chunk_store_->Names()))
+      actual.insert(name);
+    EXPECT_TRUE(expected == actual);
+  });
+  check_names();
+
+  // The name filter is saved over a clean restart and rebuilt in the background after an unclean
+  // one.
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  check_names();
+  chunk_store_.reset();
+  ASSERT_TRUE(fs::remove(chunk_store_path_ / ".metadata" / "clean"));
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB)));
+  check_names();
+}
+
+TEST_F(ChunkStoreTest, FUNC_AbsentNameLookup) {
+  const std::uint32_t kNumEntries(1000), kNumLookups(20000);
+  PopulateChunkStore(kNumEntries, 2 * kNumEntries, chunk_store_path_);
+  NameValueContainer absent;
+  AddRandomNameValuePairs(absent, kNumLookups, 1);
+  pt::ptime start_time(pt::microsec_clock::universal_time());
+  for (const auto& name_value : absent)
+    EXPECT_FALSE(chunk_store_->Has(name_value.first));
+  pt::ptime stop_time(pt::microsec_clock::universal_time());
+  std::cout << kNumLookups << " lookups of absent names: ";
+  PrintResult(start_time, stop_time);
+}
+
+TEST_F(ChunkStoreTest, BEH_BatchOperations) {
+  for (auto layout : {ChunkStore::Layout::kFilePerChunk, ChunkStore::Layout::kPackFile}) {
+    maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStore"));
+    const std::uint64_t kMaxDiskUsage(50 * (OneKB + AesPadding));
+    chunk_store_.reset(new ChunkStore(*test_path / "store", DiskUsage(kMaxDiskUsage),
+                                      MemoryUsage(0), layout));
+    NameValueContainer name_value_pairs;
+    AddRandomNameValuePairs(name_value_pairs, 40, OneKB);
+    ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, NonEmptyString(RandomBytes(10))));
+    // A repeated name only stores its last value.
+    NameValueContainer batch(name_value_pairs);
+    batch.insert(batch.begin(),
+                 std::make_pair(name_value_pairs[1].first, name_value_pairs[2].second));
+    ASSERT_NO_THROW(chunk_store_->PutBatch(batch));
+    EXPECT_EQ(40 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+
+    // A batch which doesn't fit stores nothing.
+    NameValueContainer too_big;
+    AddRandomNameValuePairs(too_big, 11, OneKB);
+    EXPECT_THROW(chunk_store_->PutBatch(too_big), maidsafe_error);
+    EXPECT_EQ(40 * (OneKB + AesPadding), chunk_store_->CurrentDiskUsage().data);
+    for (const auto& name_value : too_big)
+      EXPECT_FALSE(chunk_store_->Has(name_value.first));
+
+    std::vector<NameType> names;
+    for (const auto& name_value : name_value_pairs)
+      names.push_back(name_value.first);
+    names.push_back(too_big[0].first);
+    auto results(chunk_store_->GetBatch(names));
+    ASSERT_EQ(names.size(), results.size());
+    for (std::size_t i(0); i != name_value_pairs.size(); ++i) {
+      ASSERT_TRUE(static_cast<bool>(results[i]));
+      EXPECT_TRUE(*results[i] == name_value_pairs[i].second);
+    }
+    EXPECT_FALSE(static_cast<bool>(results.back()));
+
+    // Everything held is deleted, even though one name isn't.
+    EXPECT_THROW(chunk_store_->DeleteBatch(names), maidsafe_error);
+    EXPECT_EQ(0U, chunk_store_->CurrentDiskUsage().data);
+    EXPECT_TRUE(ReadNames(*chunk_store_->Names()).empty());
+  }
+}
+
+// Throws a std::runtime_error, rather than a maidsafe_error, when removing 'poisoned_name'.
+class PoisonedRemoveBackend : public MemoryBackend {
+ public:
+  std::uint64_t Remove(const NameType& name) override {
+    if (name == poisoned_name)
+      throw std::runtime_error("Failed to remove");
+    return MemoryBackend::Remove(name);
+  }
+
+  NameType poisoned_name;
+};
+
+TEST_F(ChunkStoreTest, BEH_DeleteBatchAccountsForRemovalsWhenAnythingThrows) {
+  auto backend(new PoisonedRemoveBackend);
+  chunk_store_.reset(new ChunkStore(std::unique_ptr<ChunkStoreBackend>(backend),
+                                    DiskUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 8, OneKB);
+  std::vector<NameType> names;
+  for (const auto& name_value : name_value_pairs) {
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+    names.push_back(name_value.first);
+  }
+  backend->poisoned_name = names[3];
+  EXPECT_THROW(chunk_store_->DeleteBatch(names), std::runtime_error);
+  EXPECT_EQ(OneKB + AesPadding, chunk_store_->CurrentDiskUsage().data);
+  for (const auto& name : names)
+    EXPECT_EQ(name == names[3], chunk_store_->Has(name));
+}
+
+TEST_F(ChunkStoreTest, FUNC_BatchPut) {
+  const std::uint32_t kNumEntries(1024), kValueSize(4 * OneKB);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kNumEntries, kValueSize);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB * OneKB)));
+  pt::ptime start_time(pt::microsec_clock::universal_time());
+  for (const auto& name_value : name_value_pairs)
+    chunk_store_->Put(name_value.first, name_value.second);
+  pt::ptime stop_time(pt::microsec_clock::universal_time());
+  std::cout << kNumEntries << " individual puts (each synced): ";
+  PrintResult(start_time, stop_time);
+
+  for (std::uint32_t batch_size(1); batch_size <= kNumEntries; batch_size *= 4) {
+    std::vector<NameType> names;
+    for (const auto& name_value : name_value_pairs)
+      names.push_back(name_value.first);
+    chunk_store_->DeleteBatch(names);
+    start_time = pt::microsec_clock::universal_time();
+    for (std::uint32_t i(0); i < kNumEntries; i += batch_size) {
+      chunk_store_->PutBatch(
+          NameValueContainer(name_value_pairs.begin() + i,
+                             name_value_pairs.begin() + std::min(i + batch_size, kNumEntries)));
+    }
+    stop_time = pt::microsec_clock::universal_time();
+    double duration(static_cast<double>((stop_time - start_time).total_microseconds()) + 1);
+    std::uint32_t batch_count((kNumEntries + batch_size - 1) / batch_size);
+    std::cout << "Batches of " << batch_size << ": " << duration / batch_count / 1000.0
+              << " ms per batch, " << kNumEntries * 1000000.0 / duration << " puts/sec."
+              << std::endl;
+  }
+}
+
+TEST_F(ChunkStoreTest, FUNC_BatchGet) {
+  const std::uint32_t kNumEntries(256), kValueSize(256 * OneKB);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kNumEntries, kValueSize);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(OneKB * OneKB * OneKB)));
+  chunk_store_->PutBatch(name_value_pairs);
+  std::vector<NameType> names;
+  for (const auto& name_value : name_value_pairs)
+    names.push_back(name_value.first);
+
+  pt::ptime start_time(pt::microsec_clock::universal_time());
+  for (const auto& name : names)
+    chunk_store_->Get(name);
+  pt::ptime stop_time(pt::microsec_clock::universal_time());
+  std::cout << kNumEntries << " individual gets: ";
+  PrintResult(start_time, stop_time);
+
+  start_time = pt::microsec_clock::universal_time();
+  auto results(chunk_store_->GetBatch(names));
+  stop_time = pt::microsec_clock::universal_time();
+  std::cout << "Batch of " << kNumEntries << " gets: ";
+  PrintResult(start_time, stop_time);
+  for (std::size_t i(0); i != names.size(); ++i) {
+    ASSERT_TRUE(static_cast<bool>(results[i]));
+    EXPECT_TRUE(*results[i] == name_value_pairs[i].second);
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_NameCursors) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 300, 10);
+  auto target(MakeIdentity());
+  std::vector<NameRange> ranges = {NameRange(), NameRange::Prefix(target, 0),
+                                   NameRange::Prefix(target, 1), NameRange::Prefix(target, 3),
+                                   NameRange(target, MakeIdentity())};
+  for (auto layout : {ChunkStore::Layout::kFilePerChunk, ChunkStore::Layout::kPackFile}) {
+    maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStore"));
+    chunk_store_.reset(new ChunkStore(*test_path / "store", DiskUsage(OneKB * OneKB),
+                                      MemoryUsage(0), layout));
+    ASSERT_NO_THROW(chunk_store_->PutBatch(name_value_pairs));
+    for (const auto& range : ranges) {
+      std::set<NameType> expected;
+      for (const auto& name_value : name_value_pairs) {
+        if (range.Contains(name_value.first.name))
+          expected.insert(name_value.first);
+      }
+      auto names(ReadNames(*chunk_store_->Names(range)));
+      EXPECT_EQ(expected.size(), names.size());
+      EXPECT_TRUE(expected == std::set<NameType>(names.begin(), names.end()));
+
+      // Split cursors return disjoint parts of the range.
+      std::vector<NameType> split_names;
+      for (auto& cursor : chunk_store_->Names(range, 7)) {
+        auto part(ReadNames(*cursor));
+        split_names.insert(split_names.end(), part.begin(), part.end());
+      }
+      EXPECT_EQ(expected.size(), split_names.size());
+      EXPECT_TRUE(expected == std::set<NameType>(split_names.begin(), split_names.end()));
+    }
+  }
+  EXPECT_EQ(300U, ReadNames(*chunk_store_->Names(NameRange::Prefix(target, 0))).size());
+  EXPECT_EQ(0U, ReadNames(*chunk_store_->Names(NameRange::Prefix(MakeIdentity(), 512))).size());
+}
+
+TEST_F(ChunkStoreTest, BEH_GetUsesCache) {
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, max_disk_usage_, MemoryUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, OneKB);
+  const auto& name(name_value_pairs[0].first);
+  ASSERT_NO_THROW(chunk_store_->Put(name, name_value_pairs[0].second));
+  EXPECT_TRUE(chunk_store_->Get(name) == name_value_pairs[0].second);
+  EXPECT_TRUE(chunk_store_->Get(name) == name_value_pairs[0].second);
+  EXPECT_EQ(1U, chunk_store_->CacheMisses());
+  EXPECT_EQ(1U, chunk_store_->CacheHits());
+
+  // Put and Delete invalidate the cached content.
+  NonEmptyString new_value(RandomBytes(OneKB));
+  ASSERT_NO_THROW(chunk_store_->Put(name, new_value));
+  EXPECT_TRUE(chunk_store_->Get(name) == new_value);
+  EXPECT_EQ(2U, chunk_store_->CacheMisses());
+  ASSERT_NO_THROW(chunk_store_->Delete(name));
+  EXPECT_THROW(chunk_store_->Get(name), maidsafe_error);
+  EXPECT_EQ(1U, chunk_store_->CacheHits());
+}
+
+TEST_F(ChunkStoreTest, BEH_GetSharedSharesCachedValue) {
+  chunk_store_.reset(
+      new ChunkStore(chunk_store_path_, max_disk_usage_, MemoryUsage(OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, OneKB);
+  for (const auto& name_value : name_value_pairs)
+    ASSERT_NO_THROW(chunk_store_->Put(name_value.first, name_value.second));
+
+  auto first(chunk_store_->GetShared(name_value_pairs[0].first));
+  auto second(chunk_store_->GetShared(name_value_pairs[0].first));
+  EXPECT_TRUE(*first == name_value_pairs[0].second);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_TRUE(chunk_store_->Get(name_value_pairs[0].first) == name_value_pairs[0].second);
+
+  // Replacing the chunk leaves values already handed out untouched.
+  ASSERT_NO_THROW(chunk_store_->Put(name_value_pairs[0].first, name_value_pairs[1].second));
+  EXPECT_TRUE(*chunk_store_->GetShared(name_value_pairs[0].first) == name_value_pairs[1].second);
+  EXPECT_TRUE(*first == name_value_pairs[0].second);
+  ASSERT_NO_THROW(chunk_store_->Delete(name_value_pairs[1].first));
+  EXPECT_THROW(chunk_store_->GetShared(name_value_pairs[1].first), maidsafe_error);
+}
+
+TEST_F(ChunkStoreTest, FUNC_HotChunkGet) {
+  const std::uint32_t kHotChunks(100), kGetsPerChunk(100), kValueSize(64 * OneKB);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kHotChunks, kValueSize);
+  for (auto cache_size : {MemoryUsage(0), MemoryUsage(64 * OneKB * OneKB)}) {
+    maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_ChunkStore"));
+    chunk_store_.reset(new ChunkStore(*test_path / "store", DiskUsage(OneKB * OneKB * OneKB),
+                                      cache_size));
+    for (const auto& name_value : name_value_pairs)
+      chunk_store_->Put(name_value.first, name_value.second);
+
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    for (std::uint32_t i(0); i != kGetsPerChunk; ++i) {
+      for (const auto& name_value : name_value_pairs)
+        chunk_store_->Get(name_value.first);
+    }
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    std::cout << "Cache size " << cache_size.data << ", " << kHotChunks * kGetsPerChunk
+              << " gets (" << chunk_store_->CacheHits() << " hits): ";
+    PrintResult(start_time, stop_time);
+  }
+}
+
+TEST_F(ChunkStoreTest, BEH_AsyncPutAndGet) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 20, 1024);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(20 * (1024 + AesPadding) + 10)));
+
+  std::vector<std::future<void>> puts;
+  for (const auto& name_value : name_value_pairs)
+    puts.push_back(chunk_store_->AsyncPut(name_value.first, name_value.second));
+  for (auto& put : puts)
+    EXPECT_NO_THROW(put.get());
+
+  std::vector<std::future<NonEmptyString>> gets;
+  for (const auto& name_value : name_value_pairs)
+    gets.push_back(chunk_store_->AsyncGet(name_value.first));
+  for (std::size_t i(0); i != gets.size(); ++i)
+    EXPECT_TRUE(gets[i].get() == name_value_pairs[i].second);
+
+  // Failures are reported through the future.
+  NameValueContainer extra_name_value_pairs;
+  AddRandomNameValuePairs(extra_name_value_pairs, 1, 1024);
+  EXPECT_THROW(chunk_store_->AsyncGet(extra_name_value_pairs[0].first).get(), maidsafe_error);
+  EXPECT_THROW(chunk_store_->AsyncPut(extra_name_value_pairs[0].first,
+                                      extra_name_value_pairs[0].second).get(),
+               maidsafe_error);
+
+  // Operations still queued when the store is destroyed are completed.
+  puts.clear();
+  for (const auto& name_value : name_value_pairs)
+    chunk_store_->Delete(name_value.first);
+  for (const auto& name_value : name_value_pairs)
+    puts.push_back(chunk_store_->AsyncPut(name_value.first, name_value.second));
+  chunk_store_.reset();
+  for (auto& put : puts)
+    EXPECT_NO_THROW(put.get());
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(20 * (1024 + AesPadding) + 10)));
+  EXPECT_EQ(20 * (1024 + AesPadding), chunk_store_->CurrentDiskUsage().data);
+}
+
+TEST_F(ChunkStoreTest, FUNC_AsyncQueueDepth) {
+  const std::uint32_t kOpCount(2000), kValueSize(4 * OneKB);
+  chunk_store_.reset(new ChunkStore(chunk_store_path_, DiskUsage(1000 * OneKB * OneKB)));
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, kOpCount, kValueSize);
+  for (std::uint32_t queue_depth(1); queue_depth <= 32; queue_depth *= 2) {
+    std::deque<std::future<void>> in_flight;
+    pt::ptime start_time(pt::microsec_clock::universal_time());
+    for (const auto& name_value : name_value_pairs) {
+      if (in_flight.size() == queue_depth) {
+        in_flight.front().get();
+        in_flight.pop_front();
+      }
+      in_flight.push_back(chunk_store_->AsyncPut(name_value.first, name_value.second));
+    }
+    while (!in_flight.empty()) {
+      in_flight.front().get();
+      in_flight.pop_front();
+    }
+    pt::ptime stop_time(pt::microsec_clock::universal_time());
+    std::cout << "Queue depth " << queue_depth << ", " << kOpCount << " puts: ";
+    PrintResult(start_time, stop_time);
+
+    std::deque<std::future<NonEmptyString>> gets_in_flight;
+    start_time = pt::microsec_clock::universal_time();
+    for (const auto& name_value : name_value_pairs) {
+      if (gets_in_flight.size() == queue_depth) {
+        gets_in_flight.front().get();
+        gets_in_flight.pop_front();
+      }
+      gets_in_flight.push_back(chunk_store_->AsyncGet(name_value.first));
+    }
+    while (!gets_in_flight.empty()) {
+      gets_in_flight.front().get();
+      gets_in_flight.pop_front();
+    }
+    stop_time = pt::microsec_clock::universal_time();
+    std::cout << "Queue depth " << queue_depth << ", " << kOpCount << " gets: ";
+    PrintResult(start_time, stop_time);
+
+    for (const auto& name_value : name_value_pairs)
+      chunk_store_->Delete(name_value.first);
+  }
+}
+
 }  // namespace test
 
 }  // namespace vault
@@ -40,6 +40,13 @@ Data::NameAndTypeId GetRandomDataNameAndTypeId() {
   return Data::NameAndTypeId(MakeIdentity(), DataTypeId(RandomUint32() % 8));
 }
 
+std::vector<Data::NameAndTypeId> ReadNames(ChunkStoreBackend::NameCursor& cursor) {
+  std::vector<Data::NameAndTypeId> names;
+  while (auto name = cursor.Next())
+    names.push_back(*name);
+  return names;
+}
+
 }  // namespace test
 
 }  // namespace vault
@@ -26,6 +26,8 @@
 #include "maidsafe/common/types.h"
 #include "maidsafe/common/data_types/data.h"
 
+#include "maidsafe/vault/chunk_store/backend.h"
+
 namespace maidsafe {
 
 namespace vault {
@@ -37,6 +39,9 @@ void AddRandomNameValuePairs(std::vector<std::pair<Data::NameAndTypeId, NonEmpty
 
 Data::NameAndTypeId GetRandomDataNameAndTypeId();
 
+// Reads every remaining name from 'cursor'.
+std::vector<Data::NameAndTypeId> ReadNames(ChunkStoreBackend::NameCursor& cursor);
+
 }  // namespace test
 
 }  // namespace vault
@@ -16,6 +16,14 @@
     See the Licences for the specific language governing permissions and limitations relating to
     use of the MaidSafe Software.                                                                 */
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
 #include "boost/filesystem.hpp"
 #include "boost/variant.hpp"
 
@@ -89,6 +97,197 @@ TEST_F(DataManagerTest, BEH_HandlePostResponse) {
                            }));
 }
 
+// Sets a Parameters value for the rest of the scope, restoring it even if the test fails part way.
+template <typename T>
+class ScopedParameter {
+ public:
+  ScopedParameter(T& parameter, T value) : parameter_(parameter), kOldValue_(parameter) {
+    parameter_ = value;
+  }
+  ~ScopedParameter() { parameter_ = kOldValue_; }
+  ScopedParameter(const ScopedParameter&) = delete;
+  ScopedParameter& operator=(const ScopedParameter&) = delete;
+
+ private:
+  T& parameter_;
+  const T kOldValue_;
+};
+
+// Runs a DataManager over FakeRouting alone.
+class ChurnFacade : public DataManager<ChurnFacade>,
+                    public routing::test::FakeRouting<ChurnFacade> {
+ public:
+  explicit ChurnFacade(const boost::filesystem::path& vault_root_dir)
+      : DataManager<ChurnFacade>(vault_root_dir), routing::test::FakeRouting<ChurnFacade>() {}
+  ~ChurnFacade() { StopChurn(); }
+};
+
+class DataManagerChurnTest : public testing::Test {
+ protected:
+  DataManagerChurnTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Vault_DataManager")),
+        from_(routing::NodeAddress(MakeIdentity()), boost::none, boost::none),
+        network_(),
+        facade_(*test_path_) {}
+
+  void SetNetwork(int node_count) {
+    for (int i(0); i < node_count; ++i)
+      network_.emplace_back(MakeIdentity());
+    facade_.SetNetwork(network_);
+  }
+
+  Identity Put() {
+    ImmutableData data(NonEmptyString(RandomString(64)));
+    EXPECT_TRUE(facade_.HandlePut(from_, data).valid());
+    return data.Name();
+  }
+
+  std::vector<routing::Address> Holders(const Identity& name) {
+    std::vector<routing::Address> holders;
+    auto result(facade_.HandleGet<ImmutableData>(from_, name));
+    if (result.valid()) {
+      for (const auto& holder :
+           boost::get<std::vector<routing::DestinationAddress>>(result.value()))
+        holders.push_back(holder.first.data);
+    }
+    return holders;
+  }
+
+  maidsafe::test::TestPath test_path_;
+  routing::SourceAddress from_;
+  std::vector<routing::Address> network_;
+  ChurnFacade facade_;
+};
+
+TEST_F(DataManagerChurnTest, BEH_ReplicatesChunksOfDepartedNodes) {
+  SetNetwork(20);
+  std::vector<Identity> names;
+  for (int i(0); i < 50; ++i)
+    names.push_back(Put());
+  std::vector<std::vector<routing::Address>> holders_before;
+  for (const auto& name : names)
+    holders_before.push_back(Holders(name));
+
+  routing::CloseGroupDifference difference;
+  difference.first.emplace_back(MakeIdentity());
+  difference.second.assign(network_.begin(), network_.begin() + 3);
+  std::uint64_t expected_requests(0);
+  for (const auto& holders : holders_before) {
+    for (const auto& departed : difference.second)
+      expected_requests += std::count(holders.begin(), holders.end(), departed);
+  }
+  facade_.Churn(difference);
+  facade_.WaitForChurn();
+
+  EXPECT_EQ(expected_requests, facade_.ReplicationRequestCount());
+  EXPECT_EQ(0U, facade_.DeleteRequestCount());
+  for (std::size_t i(0); i < names.size(); ++i) {
+    auto holders(Holders(names[i]));
+    EXPECT_EQ(Parameters::min_pmid_holders, holders.size());
+    for (const auto& departed : difference.second)
+      EXPECT_EQ(holders.end(), std::find(holders.begin(), holders.end(), departed));
+    // Surviving holders keep their place ahead of the new ones.
+    for (const auto& holder : holders_before[i]) {
+      if (std::find(difference.second.begin(), difference.second.end(), holder) ==
+          difference.second.end()) {
+        EXPECT_NE(holders.end(), std::find(holders.begin(), holders.end(), holder));
+      }
+    }
+  }
+}
+
+TEST_F(DataManagerChurnTest, BEH_TrimsExcessHolders) {
+  ScopedParameter<std::size_t> max_pmid_holders(Parameters::max_pmid_holders, 5);
+  SetNetwork(20);
+  auto name(Put());
+  // A failed store replaces its holder with four new ones, leaving seven.
+  auto holders(Holders(name));
+  ASSERT_TRUE(facade_
+                  .HandlePutResponse<ImmutableData>(
+                      name, routing::DestinationAddress(routing::Destination(holders[0]),
+                                                        boost::none),
+                      MakeError(VaultErrors::data_already_exists))
+                  .valid());
+  holders = Holders(name);
+  ASSERT_EQ(7U, holders.size());
+
+  routing::CloseGroupDifference difference;
+  difference.second.push_back(holders[0]);
+  facade_.Churn(difference);
+  facade_.WaitForChurn();
+  auto trimmed(Holders(name));
+  EXPECT_EQ(5U, trimmed.size());
+  EXPECT_TRUE(std::equal(trimmed.begin(), trimmed.end(), holders.begin() + 1));
+  EXPECT_EQ(0U, facade_.ReplicationRequestCount());
+  EXPECT_EQ(1U, facade_.DeleteRequestCount());
+}
+
+// Puts a large number of chunks, then has a tenth of the network leave and as many join in quick
+// succession, comparing HandleGet latency while the churn is being handled against before.
+TEST_F(DataManagerChurnTest, FUNC_ChurnStorm) {
+  namespace pt = boost::posix_time;
+  const int kNetworkSize(1000), kChunks(20000), kDifferences(10);
+  const int kDepartedPerDifference(kNetworkSize / 10 / kDifferences);
+  SetNetwork(kNetworkSize);
+  std::vector<Identity> names;
+  for (int i(0); i < kChunks; ++i)
+    names.push_back(Put());
+
+  auto get_latencies([&](std::function<bool()> keep_going) {
+    std::vector<std::int64_t> latencies;
+    for (std::size_t i(0); keep_going(); ++i) {
+      pt::ptime start(pt::microsec_clock::universal_time());
+      EXPECT_TRUE(facade_.HandleGet<ImmutableData>(from_, names[i % names.size()]).valid());
+      latencies.push_back((pt::microsec_clock::universal_time() - start).total_microseconds());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+  });
+  auto report([](const std::string& when, const std::vector<std::int64_t>& latencies) {
+    if (latencies.empty()) {
+      std::cout << "HandleGet " << when << ": no calls." << std::endl;
+      return;
+    }
+    std::cout << "HandleGet " << when << ": " << latencies.size() << " calls, median "
+              << latencies[latencies.size() / 2] << " us, 99th percentile "
+              << latencies[latencies.size() * 99 / 100] << " us, max " << latencies.back()
+              << " us." << std::endl;
+  });
+  std::size_t calls(0);
+  report("before churn", get_latencies([&] { return calls++ < names.size(); }));
+
+  std::vector<routing::Address> departed;
+  pt::ptime start(pt::microsec_clock::universal_time());
+  for (int i(0); i < kDifferences; ++i) {
+    routing::CloseGroupDifference difference;
+    for (int j(0); j < kDepartedPerDifference; ++j) {
+      difference.first.emplace_back(MakeIdentity());
+      difference.second.push_back(network_[i * kDepartedPerDifference + j]);
+    }
+    departed.insert(departed.end(), difference.second.begin(), difference.second.end());
+    facade_.Churn(difference);
+  }
+  std::atomic<bool> churning(true);
+  auto churn_done(std::async(std::launch::async, [&] {
+    facade_.WaitForChurn();
+    churning = false;
+  }));
+  report("during churn", get_latencies([&] { return churning.load(); }));
+  churn_done.get();
+  std::cout << "Handled " << departed.size() << " departed nodes of " << kNetworkSize << " in "
+            << (pt::microsec_clock::universal_time() - start).total_milliseconds() << " ms, "
+            << facade_.ReplicationRequestCount() << " replication requests for " << kChunks
+            << " chunks." << std::endl;
+
+  std::sort(departed.begin(), departed.end());
+  for (const auto& name : names) {
+    auto holders(Holders(name));
+    EXPECT_EQ(Parameters::min_pmid_holders, holders.size());
+    for (const auto& holder : holders)
+      EXPECT_FALSE(std::binary_search(departed.begin(), departed.end(), holder));
+  }
+}
+
 }  // namespace test
 
 }  // namespace vault
@@ -19,6 +19,11 @@
 #ifndef MAIDSAFE_VAULT_TESTS_FAKE_ROUTING_H_
 #define MAIDSAFE_VAULT_TESTS_FAKE_ROUTING_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
 #include <vector>
 
 #include "maidsafe/common/utils.h"
@@ -35,7 +40,7 @@ namespace test {
 template <typename Child>
 class FakeRouting {
  public:
-  FakeRouting() {}
+  FakeRouting() : network_mutex_(), network_(), replication_requests_(0), delete_requests_(0) {}
 
   FakeRouting(const FakeRouting&) = delete;
   FakeRouting(FakeRouting&&) = delete;
@@ -50,15 +55,80 @@ class FakeRouting {
                                                 data_name);
   }
 
+  // With no network set, returns made-up nodes.  Otherwise returns the four nodes of the network
+  // closest to 'name', skipping those in 'exclude'.
   template <typename DataType>
   std::vector<routing::Address> GetClosestNodes(
-      Identity /*name*/,
-      const std::vector<routing::Address>& /*exclude*/ = std::vector<routing::Address>()) {
+      Identity name,
+      const std::vector<routing::Address>& exclude = std::vector<routing::Address>()) {
     std::vector<routing::Address> close_nodes;
+    {
+      std::lock_guard<std::mutex> lock(network_mutex_);
+      if (!network_.empty()) {
+        std::copy_if(network_.begin(), network_.end(), std::back_inserter(close_nodes),
+                     [&](const routing::Address& node) {
+                       return std::find(exclude.begin(), exclude.end(), node) == exclude.end();
+                     });
+        const auto& target(name.string());
+        auto closer([&](const routing::Address& lhs, const routing::Address& rhs) {
+          const auto& lhs_bytes(lhs.string());
+          const auto& rhs_bytes(rhs.string());
+          for (std::size_t i(0); i != identity_size; ++i) {
+            if (lhs_bytes[i] != rhs_bytes[i])
+              return (lhs_bytes[i] ^ target[i]) < (rhs_bytes[i] ^ target[i]);
+          }
+          return false;
+        });
+        auto count(std::min(close_nodes.size(), std::size_t(4)));
+        std::partial_sort(close_nodes.begin(), close_nodes.begin() + count, close_nodes.end(),
+                          closer);
+        close_nodes.resize(count);
+        return close_nodes;
+      }
+    }
     while (close_nodes.size() < 4)
       close_nodes.emplace_back(RandomString(identity_size));
     return close_nodes;
   }
+
+  // Sets the nodes GetClosestNodes chooses from.
+  void SetNetwork(std::vector<routing::Address> nodes) {
+    std::lock_guard<std::mutex> lock(network_mutex_);
+    network_ = std::move(nodes);
+  }
+
+  // Adds and removes the nodes of 'difference' from the network, then passes it to the child.
+  void Churn(const CloseGroupDifference& difference) {
+    {
+      std::lock_guard<std::mutex> lock(network_mutex_);
+      network_.insert(network_.end(), difference.first.begin(), difference.first.end());
+      for (const auto& node : difference.second)
+        network_.erase(std::remove(network_.begin(), network_.end(), node), network_.end());
+    }
+    static_cast<Child*>(this)->HandleChurn(difference);
+  }
+
+  // Asks 'targets' to fetch a copy of the chunk from one of 'sources'.  Only counted here.
+  template <typename DataType>
+  void SendReplicationRequest(const Identity& /*name*/,
+                              const std::vector<routing::Address>& /*sources*/,
+                              const std::vector<routing::Address>& targets) {
+    replication_requests_ += targets.size();
+  }
+
+  // Asks 'holders' to delete their copy of the chunk.  Only counted here.
+  template <typename DataType>
+  void SendDeleteRequest(const Identity& /*name*/, const std::vector<routing::Address>& holders) {
+    delete_requests_ += holders.size();
+  }
+
+  std::uint64_t ReplicationRequestCount() const { return replication_requests_; }
+  std::uint64_t DeleteRequestCount() const { return delete_requests_; }
+
+ private:
+  std::mutex network_mutex_;
+  std::vector<routing::Address> network_;
+  std::atomic<std::uint64_t> replication_requests_, delete_requests_;
 };
 
 }  // namespace test
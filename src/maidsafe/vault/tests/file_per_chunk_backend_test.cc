@@ -0,0 +1,377 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/file_per_chunk_backend.h"
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+class FilePerChunkBackendTest : public testing::Test {
+ protected:
+  typedef std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> NameValueContainer;
+
+  FilePerChunkBackendTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_FilePerChunkBackend")),
+        backend_(*test_path_, false) {}
+
+  std::size_t EntryCount() const {
+    return static_cast<std::size_t>(std::distance(fs::recursive_directory_iterator(*test_path_),
+                                                  fs::recursive_directory_iterator()));
+  }
+
+  maidsafe::test::TestPath test_path_;
+  FilePerChunkBackend backend_;
+};
+
+TEST_F(FilePerChunkBackendTest, BEH_LookupsDontCreateDirectories) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, 100);
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_EQ(0U, backend_.Size(name_value.first));
+    EXPECT_FALSE(static_cast<bool>(backend_.Read(name_value.first)));
+    EXPECT_THROW(backend_.Remove(name_value.first), maidsafe_error);
+  }
+  EXPECT_EQ(0U, EntryCount());
+  EXPECT_EQ(0U, backend_.GetIoCounts().directory_creations);
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_IoCountsPerOperation) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, 100);
+  for (const auto& name_value : name_value_pairs)
+    backend_.Write(name_value.first, name_value.second.string());
+  // Each write opens and syncs the temporary file and then the directory it's renamed into.
+  auto after_writes(backend_.GetIoCounts());
+  EXPECT_EQ(200U, after_writes.opens);
+  EXPECT_EQ(200U, after_writes.syncs);
+  EXPECT_EQ(100U, after_writes.renames);
+  EXPECT_EQ(0U, after_writes.stats);
+  EXPECT_GE(after_writes.directory_creations, 100U);
+
+  // Each directory is only created once.
+  for (const auto& name_value : name_value_pairs)
+    backend_.Write(name_value.first, name_value.second.string());
+  auto after_rewrites(backend_.GetIoCounts());
+  EXPECT_EQ(after_writes.directory_creations, after_rewrites.directory_creations);
+  EXPECT_EQ(after_writes.opens + 200, after_rewrites.opens);
+
+  // A read is a single open, and nothing else.
+  auto before_reads(backend_.GetIoCounts());
+  for (const auto& name_value : name_value_pairs) {
+    auto content(backend_.Read(name_value.first));
+    ASSERT_TRUE(static_cast<bool>(content));
+    EXPECT_TRUE(*content == name_value.second.string());
+  }
+  auto after_reads(backend_.GetIoCounts());
+  EXPECT_EQ(before_reads.opens + 100, after_reads.opens);
+  EXPECT_EQ(before_reads.stats, after_reads.stats);
+  EXPECT_EQ(before_reads.syncs, after_reads.syncs);
+  EXPECT_EQ(before_reads.directory_creations, after_reads.directory_creations);
+
+  // A size lookup is a single stat.
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_EQ(100U, backend_.Size(name_value.first));
+  auto after_sizes(backend_.GetIoCounts());
+  EXPECT_EQ(after_reads.stats + 100, after_sizes.stats);
+  EXPECT_EQ(after_reads.opens, after_sizes.opens);
+
+  // A removal is a stat for the size and an unlink.
+  for (const auto& name_value : name_value_pairs)
+    EXPECT_EQ(100U, backend_.Remove(name_value.first));
+  auto after_removes(backend_.GetIoCounts());
+  EXPECT_EQ(after_sizes.stats + 100, after_removes.stats);
+  EXPECT_EQ(after_sizes.removes + 100, after_removes.removes);
+  EXPECT_EQ(after_sizes.opens, after_removes.opens);
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_SyncSyncsEachFileAndDirectoryOnce) {
+  FilePerChunkBackend backend(*test_path_ / "shallow", false, 1);
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, 100);
+  // Written twice, so each file and directory is left for Sync more than once.
+  for (int round(0); round != 2; ++round) {
+    for (const auto& name_value : name_value_pairs)
+      backend.WriteUnsynced(name_value.first, name_value.second.string());
+  }
+  auto after_writes(backend.GetIoCounts());
+  EXPECT_EQ(200U, after_writes.opens);
+  EXPECT_EQ(0U, after_writes.syncs);
+
+  std::set<fs::path> directories;
+  for (fs::recursive_directory_iterator it(*test_path_ / "shallow"), end; it != end; ++it) {
+    if (fs::is_regular_file(it->status()))
+      directories.insert(it->path().parent_path());
+  }
+  ASSERT_GE(16U, directories.size());
+  backend.Sync();
+  auto after_sync(backend.GetIoCounts());
+  EXPECT_EQ(after_writes.syncs + 100 + directories.size(), after_sync.syncs);
+  EXPECT_EQ(after_writes.opens + 100 + directories.size(), after_sync.opens);
+
+  // Removals only leave their directories to sync.
+  for (const auto& name_value : name_value_pairs)
+    backend.Remove(name_value.first);
+  backend.Sync();
+  auto after_removes(backend.GetIoCounts());
+  EXPECT_EQ(after_sync.syncs + directories.size(), after_removes.syncs);
+
+  // Nothing is left to sync.
+  backend.Sync();
+  EXPECT_EQ(after_removes.syncs, backend.GetIoCounts().syncs);
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_IncompleteWritesAreIgnored) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, 100);
+  const auto& name(name_value_pairs.front().first);
+  backend_.Write(name, name_value_pairs.front().second.string());
+  fs::path chunk_file;
+  for (fs::recursive_directory_iterator it(*test_path_), end; it != end; ++it) {
+    if (fs::is_regular_file(it->path()))
+      chunk_file = it->path();
+  }
+  ASSERT_FALSE(chunk_file.empty());
+
+  // As left by a crash part way through overwriting the chunk.
+  fs::path temp_file(chunk_file.parent_path() / ('.' + chunk_file.filename().string() + ".tmp"));
+  ASSERT_TRUE(WriteFile(temp_file, RandomBytes(50)));
+  EXPECT_EQ(100U, backend_.ScanUsage());
+  auto names(ReadNames(*backend_.Names(NameRange(), 1).front()));
+  ASSERT_EQ(1U, names.size());
+  EXPECT_TRUE(names.front() == name);
+
+  backend_.DiscardIncompleteWrites({name});
+  EXPECT_FALSE(fs::exists(temp_file));
+  EXPECT_TRUE(*backend_.Read(name) == name_value_pairs.front().second.string());
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_RecreatesRemovedDirectory) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, 100);
+  const auto& name(name_value_pairs[0].first);
+  backend_.Write(name, name_value_pairs[0].second.string());
+  for (fs::directory_iterator itr(*test_path_); itr != fs::directory_iterator(); ++itr)
+    fs::remove_all(itr->path());
+  ASSERT_EQ(0U, EntryCount());
+  EXPECT_NO_THROW(backend_.Write(name, name_value_pairs[0].second.string()));
+  EXPECT_EQ(100U, backend_.Size(name));
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_StreamedWritesAndRangeReads) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 1, 1000);
+  const auto& name(name_value_pairs[0].first);
+  const auto& content(name_value_pairs[0].second.string());
+  {
+    auto writer(backend_.OpenWriter(name));
+    writer->Append(std::vector<byte>(content.begin(), content.begin() + 400));
+    EXPECT_EQ(0U, backend_.Size(name));
+  }
+  // The abandoned writer's file is gone, leaving just the directory it was streamed to.
+  EXPECT_EQ(1U, EntryCount());
+
+  auto writer(backend_.OpenWriter(name));
+  writer->Append(std::vector<byte>(content.begin(), content.begin() + 400));
+  writer->Append(std::vector<byte>(content.begin() + 400, content.end()));
+  EXPECT_EQ(0U, backend_.Size(name));
+  writer->Commit();
+  writer.reset();
+  EXPECT_EQ(content.size(), backend_.Size(name));
+  EXPECT_TRUE(*backend_.Read(name) == content);
+
+  EXPECT_TRUE(*backend_.ReadRange(name, 10, 20) ==
+              std::vector<byte>(content.begin() + 10, content.begin() + 30));
+  EXPECT_TRUE(*backend_.ReadRange(name, 990, 20) ==
+              std::vector<byte>(content.begin() + 990, content.end()));
+  EXPECT_TRUE(backend_.ReadRange(name, 1000, 1)->empty());
+  EXPECT_FALSE(backend_.ReadRange(GetRandomDataNameAndTypeId(), 0, 1));
+
+  // Anything left streaming by a previous session is removed.
+  auto abandoned(backend_.OpenWriter(GetRandomDataNameAndTypeId()));
+  abandoned->Append(std::vector<byte>(10, 0));
+  FilePerChunkBackend reopened(*test_path_, false);
+  EXPECT_TRUE(*reopened.Read(name) == content);
+  EXPECT_FALSE(fs::exists(*test_path_ / ".streams"));
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_DepthFromExpectedChunkCount) {
+  EXPECT_EQ(1U, FilePerChunkBackend::DepthFor(0));
+  EXPECT_EQ(1U, FilePerChunkBackend::DepthFor(16 * FilePerChunkBackend::kChunksPerDirectory));
+  EXPECT_EQ(2U, FilePerChunkBackend::DepthFor(16 * FilePerChunkBackend::kChunksPerDirectory + 1));
+  EXPECT_EQ(4U, FilePerChunkBackend::DepthFor(4 * 1024 * 1024));
+  EXPECT_EQ(FilePerChunkBackend::kMaxDepth, FilePerChunkBackend::DepthFor(~std::uint64_t(0)));
+  EXPECT_THROW(FilePerChunkBackend(*test_path_, false, 0), maidsafe_error);
+  EXPECT_THROW(FilePerChunkBackend(*test_path_, false, FilePerChunkBackend::kMaxDepth + 1),
+               maidsafe_error);
+  EXPECT_THROW(FilePerChunkBackend(*test_path_, false, 2, 2), maidsafe_error);
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_MigratesToDeeperFanOut) {
+  std::mutex mutex;
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> recorded;
+  const fs::path kStorePath(*test_path_ / "store");
+  FilePerChunkBackend backend(kStorePath, false, 1, 0,
+                              [&](std::uint32_t depth, std::uint32_t migrating_from) {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                recorded.emplace_back(depth, migrating_from);
+                              });
+  auto write([&backend](const NameValueContainer::value_type& name_value) {
+    backend.Write(name_value.first, name_value.second.string());
+  });
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, 100);
+  for (const auto& name_value : name_value_pairs)
+    write(name_value);
+  EXPECT_FALSE(backend.Migrate(1));
+
+  // The layout switches straight away, but moving the chunks waits for open cursors.
+  auto cursors(backend.Names(NameRange(), 2));
+  ASSERT_TRUE(backend.Migrate(2));
+  EXPECT_FALSE(backend.Migrate(3));
+  while (!backend.Migrating())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(2U, backend.Depth());
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_EQ(100U, backend.Size(name_value.first));
+    EXPECT_TRUE(*backend.Read(name_value.first) == name_value.second.string());
+  }
+  NameValueContainer added;
+  AddRandomNameValuePairs(added, 20, 100);
+  for (const auto& name_value : added)
+    write(name_value);
+  name_value_pairs[0].second = added[0].second;
+  write(name_value_pairs[0]);
+  EXPECT_EQ(100U, backend.Remove(name_value_pairs[1].first));
+  const auto kRemoved(name_value_pairs[1].first);
+  name_value_pairs.erase(name_value_pairs.begin() + 1);
+  name_value_pairs.insert(name_value_pairs.end(), added.begin(), added.end());
+  cursors.clear();
+
+  backend.WaitForMigration();
+  EXPECT_EQ(2U, backend.Depth());
+  EXPECT_FALSE(backend.Migrating());
+  ASSERT_EQ(2U, recorded.size());
+  EXPECT_TRUE(recorded[0] == std::make_pair(2U, 1U));
+  EXPECT_TRUE(recorded[1] == std::make_pair(2U, 0U));
+  std::set<Data::NameAndTypeId> expected_names;
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_TRUE(*backend.Read(name_value.first) == name_value.second.string());
+    expected_names.insert(name_value.first);
+  }
+  EXPECT_EQ(0U, backend.Size(kRemoved));
+  std::set<Data::NameAndTypeId> names;
+  for (auto& cursor : backend.Names(NameRange(), 3)) {
+    for (const auto& name : ReadNames(*cursor))
+      EXPECT_TRUE(names.insert(name).second);
+  }
+  EXPECT_TRUE(names == expected_names);
+  // Only the new layout's directories are left below the first level.
+  for (fs::directory_iterator itr(kStorePath); itr != fs::directory_iterator(); ++itr) {
+    if (itr->path().filename().string()[0] == '.')
+      continue;
+    for (fs::directory_iterator inner(itr->path()); inner != fs::directory_iterator(); ++inner)
+      EXPECT_TRUE(fs::is_directory(inner->path()));
+  }
+}
+
+TEST_F(FilePerChunkBackendTest, BEH_ResumesInterruptedMigration) {
+  for (bool hashed_file_names : {false, true}) {
+    const fs::path kStorePath(*test_path_ / (hashed_file_names ? "hashed" : "named"));
+    NameValueContainer name_value_pairs;
+    AddRandomNameValuePairs(name_value_pairs, 50, 100);
+    {
+      FilePerChunkBackend interrupted(kStorePath, hashed_file_names, 1);
+      for (const auto& name_value : name_value_pairs)
+        interrupted.Write(name_value.first, name_value.second.string());
+    }
+    // A chunk rewritten in the new layout before the restart keeps its new content.
+    {
+      FilePerChunkBackend rewriter(kStorePath, hashed_file_names, 2);
+      rewriter.Write(name_value_pairs[0].first, std::vector<byte>(10, 1));
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> recorded;
+    FilePerChunkBackend resumed(kStorePath, hashed_file_names, 2, 1,
+                                [&](std::uint32_t depth, std::uint32_t migrating_from) {
+                                  recorded.emplace_back(depth, migrating_from);
+                                });
+    resumed.WaitForMigration();
+    EXPECT_FALSE(resumed.Migrating());
+    ASSERT_EQ(1U, recorded.size());
+    EXPECT_TRUE(recorded[0] == std::make_pair(2U, 0U));
+    EXPECT_TRUE(*resumed.Read(name_value_pairs[0].first) == std::vector<byte>(10, 1));
+    for (std::size_t i(1); i != name_value_pairs.size(); ++i) {
+      EXPECT_TRUE(*resumed.Read(name_value_pairs[i].first) == name_value_pairs[i].second.string());
+    }
+    EXPECT_EQ(50U, ReadNames(*resumed.Names(NameRange(), 1).front()).size());
+  }
+}
+
+TEST_F(FilePerChunkBackendTest, FUNC_LookupLatencyByFanOut) {
+  const std::uint32_t kLookups(20000);
+  for (std::uint32_t chunk_count : {1000U, 10000U, 50000U}) {
+    NameValueContainer name_value_pairs, absent;
+    AddRandomNameValuePairs(name_value_pairs, chunk_count, 1);
+    AddRandomNameValuePairs(absent, kLookups, 1);
+    for (std::uint32_t depth(1); depth <= FilePerChunkBackend::kDefaultDepth; ++depth) {
+      maidsafe::test::TestPath test_path(
+          maidsafe::test::CreateTestPath("MaidSafe_Test_FilePerChunkBackend"));
+      FilePerChunkBackend backend(*test_path, false, depth);
+      for (const auto& name_value : name_value_pairs)
+        backend.Write(name_value.first, std::vector<byte>(1, 0));
+
+      pt::ptime start_time(pt::microsec_clock::universal_time());
+      for (std::uint32_t i(0); i != kLookups; ++i)
+        EXPECT_EQ(1U, backend.Size(name_value_pairs[i % chunk_count].first));
+      pt::ptime hits_time(pt::microsec_clock::universal_time());
+      for (const auto& name_value : absent)
+        EXPECT_EQ(0U, backend.Size(name_value.first));
+      pt::ptime misses_time(pt::microsec_clock::universal_time());
+      std::cout << chunk_count << " chunks, depth " << depth << ": "
+                << static_cast<double>((hits_time - start_time).total_microseconds()) / kLookups
+                << " us per lookup of a stored chunk, "
+                << static_cast<double>((misses_time - hits_time).total_microseconds()) / kLookups
+                << " us per lookup of an absent one." << std::endl;
+    }
+  }
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,97 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/memory_backend.h"
+
+#include <set>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+TEST(MemoryBackendTest, BEH_WriteReadRemove) {
+  MemoryBackend backend;
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 100, 128);
+  std::uint64_t usage(0);
+  for (const auto& name_value : name_value_pairs) {
+    backend.Write(name_value.first, name_value.second.string());
+    usage += name_value.second.string().size();
+  }
+  EXPECT_EQ(usage, backend.ScanUsage());
+  for (const auto& name_value : name_value_pairs) {
+    EXPECT_EQ(name_value.second.string().size(), backend.Size(name_value.first));
+    auto content(backend.Read(name_value.first));
+    ASSERT_TRUE(static_cast<bool>(content));
+    EXPECT_TRUE(*content == name_value.second.string());
+  }
+
+  // Overwriting replaces the content.
+  std::vector<byte> replacement(RandomBytes(64));
+  backend.Write(name_value_pairs[0].first, replacement);
+  EXPECT_EQ(64U, backend.Size(name_value_pairs[0].first));
+  EXPECT_TRUE(*backend.Read(name_value_pairs[0].first) == replacement);
+
+  EXPECT_EQ(64U, backend.Remove(name_value_pairs[0].first));
+  EXPECT_EQ(0U, backend.Size(name_value_pairs[0].first));
+  EXPECT_FALSE(backend.Read(name_value_pairs[0].first));
+  EXPECT_THROW(backend.Remove(name_value_pairs[0].first), maidsafe_error);
+  EXPECT_FALSE(backend.Persistent());
+}
+
+TEST(MemoryBackendTest, BEH_NameCursors) {
+  MemoryBackend backend;
+  std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> name_value_pairs;
+  // Enough for the cursors to refill from a shard more than once.
+  AddRandomNameValuePairs(name_value_pairs, 20000, 1);
+  std::set<Data::NameAndTypeId> expected;
+  for (const auto& name_value : name_value_pairs) {
+    backend.Write(name_value.first, name_value.second.string());
+    expected.insert(name_value.first);
+  }
+
+  for (std::uint32_t count : {1U, 3U, 64U, 300U}) {
+    std::set<Data::NameAndTypeId> names;
+    for (auto& cursor : backend.Names(NameRange(), count)) {
+      for (const auto& name : ReadNames(*cursor))
+        EXPECT_TRUE(names.insert(name).second);
+    }
+    EXPECT_TRUE(names == expected) << count;
+  }
+
+  const Identity kTarget(name_value_pairs.front().first.name);
+  const NameRange kRange(NameRange::Prefix(kTarget, 4));
+  std::size_t in_range(0);
+  for (const auto& name : expected)
+    in_range += kRange.Contains(name.name) ? 1 : 0;
+  EXPECT_EQ(in_range, ReadNames(*backend.Names(kRange, 1).front()).size());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,107 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/name_filter.h"
+
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+std::vector<Data::NameAndTypeId> RandomNames(std::uint32_t count) {
+  std::vector<Data::NameAndTypeId> names;
+  for (std::uint32_t i(0); i != count; ++i)
+    names.push_back(GetRandomDataNameAndTypeId());
+  return names;
+}
+
+TEST(NameFilterTest, BEH_AddAndRemove) {
+  NameFilter filter(1000);
+  auto names(RandomNames(1000));
+  for (const auto& name : names)
+    filter.Add(name);
+  for (const auto& name : names)
+    EXPECT_TRUE(filter.MayContain(name));
+  EXPECT_EQ(1000U, filter.Count());
+
+  for (std::size_t i(0); i != 500; ++i)
+    filter.Remove(names[i]);
+  for (std::size_t i(500); i != names.size(); ++i)
+    EXPECT_TRUE(filter.MayContain(names[i]));
+  std::size_t false_positives(0);
+  for (std::size_t i(0); i != 500; ++i)
+    false_positives += filter.MayContain(names[i]) ? 1 : 0;
+  EXPECT_LT(false_positives, 10U);
+  EXPECT_EQ(500U, filter.Count());
+}
+
+TEST(NameFilterTest, BEH_FalsePositiveRate) {
+  const std::uint32_t kCount(10000), kProbes(100000);
+  NameFilter filter(kCount);
+  for (const auto& name : RandomNames(kCount))
+    filter.Add(name);
+  EXPECT_FALSE(filter.NeedsResize());
+  std::uint32_t false_positives(0);
+  for (const auto& name : RandomNames(kProbes))
+    false_positives += filter.MayContain(name) ? 1 : 0;
+  EXPECT_LT(false_positives, kProbes / 100);
+
+  // Holding far more names than it was sized for, the filter should be rebuilt.
+  for (const auto& name : RandomNames(4 * kCount))
+    filter.Add(name);
+  EXPECT_TRUE(filter.NeedsResize());
+}
+
+TEST(NameFilterTest, BEH_SaveAndLoad) {
+  maidsafe::test::TestPath test_path(maidsafe::test::CreateTestPath("MaidSafe_Test_NameFilter"));
+  fs::path filter_path(*test_path / "names");
+  EXPECT_FALSE(NameFilter::Load(filter_path));
+
+  NameFilter filter(100);
+  auto names(RandomNames(100));
+  for (const auto& name : names)
+    filter.Add(name);
+  ASSERT_TRUE(filter.Save(filter_path));
+  auto loaded(NameFilter::Load(filter_path));
+  ASSERT_TRUE(static_cast<bool>(loaded));
+  EXPECT_EQ(100U, loaded->Count());
+  for (const auto& name : names)
+    EXPECT_TRUE(loaded->MayContain(name));
+  // A saved filter can only be loaded once.
+  EXPECT_FALSE(fs::exists(filter_path));
+
+  ASSERT_TRUE(WriteFile(filter_path, RandomBytes(100)));
+  EXPECT_FALSE(NameFilter::Load(filter_path));
+  EXPECT_FALSE(fs::exists(filter_path));
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,178 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/pack_file_backend.h"
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/operations.hpp"
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+class PackFileBackendTest : public testing::Test {
+ protected:
+  typedef std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> NameValueContainer;
+
+  PackFileBackendTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_PackFileBackend")),
+        backend_(new PackFileBackend(*test_path_, kMaxSegmentSize)) {}
+
+  void Write(const NameValueContainer& name_value_pairs) {
+    for (const auto& name_value : name_value_pairs)
+      backend_->Write(name_value.first, name_value.second.string());
+  }
+
+  void ExpectHeld(const NameValueContainer& name_value_pairs) {
+    for (const auto& name_value : name_value_pairs) {
+      auto content(backend_->Read(name_value.first));
+      ASSERT_TRUE(static_cast<bool>(content));
+      EXPECT_TRUE(*content == name_value.second.string());
+    }
+  }
+
+  static const std::uint64_t kMaxSegmentSize = 4096;
+  maidsafe::test::TestPath test_path_;
+  std::unique_ptr<PackFileBackend> backend_;
+};
+
+TEST_F(PackFileBackendTest, BEH_CompactsAfterDelete) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 40, 512);
+  Write(name_value_pairs);
+  const std::size_t kSegmentCount(backend_->SegmentCount());
+  ASSERT_GT(kSegmentCount, 4U);
+
+  // Delete all but the last few records, leaving the older segments entirely dead.
+  NameValueContainer kept(name_value_pairs.end() - 4, name_value_pairs.end());
+  for (auto itr(name_value_pairs.begin()); itr != name_value_pairs.end() - 4; ++itr)
+    EXPECT_EQ(itr->second.string().size(), backend_->Remove(itr->first));
+
+  for (int i(0); i != 500 && backend_->SegmentCount() >= kSegmentCount; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_LT(backend_->SegmentCount(), kSegmentCount);
+  ExpectHeld(kept);
+  EXPECT_EQ(4U, ReadNames(*backend_->Names(NameRange(), 1).front()).size());
+  EXPECT_EQ(4 * 512U, backend_->ScanUsage());
+
+  backend_.reset();
+  backend_.reset(new PackFileBackend(*test_path_, kMaxSegmentSize));
+  ExpectHeld(kept);
+  EXPECT_EQ(4U, ReadNames(*backend_->Names(NameRange(), 1).front()).size());
+  EXPECT_FALSE(static_cast<bool>(backend_->Read(name_value_pairs.front().first)));
+}
+
+TEST_F(PackFileBackendTest, BEH_OverwriteSurvivesRestart) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 3, 100);
+  Write(name_value_pairs);
+  name_value_pairs[1].second = NonEmptyString(RandomBytes(200));
+  Write(NameValueContainer(1, name_value_pairs[1]));
+  EXPECT_EQ(200U, backend_->Size(name_value_pairs[1].first));
+
+  backend_.reset(new PackFileBackend(*test_path_, kMaxSegmentSize));
+  ExpectHeld(name_value_pairs);
+  EXPECT_EQ(400U, backend_->ScanUsage());
+}
+
+TEST_F(PackFileBackendTest, BEH_DropsTornRecordAtStartup) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, 100);
+  Write(name_value_pairs);
+  backend_.reset();
+
+  // Simulate a crash part way through appending a record.
+  fs::path segment_path;
+  for (fs::directory_iterator itr(*test_path_); itr != fs::directory_iterator(); ++itr)
+    segment_path = itr->path();
+  std::uint64_t segment_size(fs::file_size(segment_path));
+  {
+    std::ofstream segment(segment_path.string(), std::ios::binary | std::ios::app);
+    segment << "MSPK partial record";
+  }
+
+  backend_.reset(new PackFileBackend(*test_path_, kMaxSegmentSize));
+  EXPECT_EQ(segment_size, fs::file_size(segment_path));
+  ExpectHeld(name_value_pairs);
+  NameValueContainer more_name_value_pairs;
+  AddRandomNameValuePairs(more_name_value_pairs, 2, 100);
+  Write(more_name_value_pairs);
+  ExpectHeld(more_name_value_pairs);
+}
+
+TEST_F(PackFileBackendTest, BEH_ConcurrentWritesSurviveCompaction) {
+  // Each writer overwrites its own names, so older segments keep going dead and being compacted
+  // while other writers are rolling over to new ones.
+  const int kWriters(4), kNames(8), kRounds(40);
+  std::vector<NameValueContainer> latest(kWriters);
+  std::vector<std::thread> writers;
+  for (int writer(0); writer != kWriters; ++writer) {
+    AddRandomNameValuePairs(latest[writer], kNames, 256);
+    writers.emplace_back([&, writer] {
+      for (int round(0); round != kRounds; ++round) {
+        for (auto& name_value : latest[writer]) {
+          name_value.second = NonEmptyString(RandomBytes(256));
+          backend_->Write(name_value.first, name_value.second.string());
+        }
+      }
+    });
+  }
+  for (auto& writer : writers)
+    writer.join();
+  backend_->Sync();
+
+  // Stops the compaction thread before the directory is scanned again.
+  backend_.reset();
+  backend_.reset(new PackFileBackend(*test_path_, kMaxSegmentSize));
+  for (const auto& name_value_pairs : latest)
+    ExpectHeld(name_value_pairs);
+  EXPECT_EQ(kWriters * kNames * 256U, backend_->ScanUsage());
+}
+
+TEST_F(PackFileBackendTest, BEH_IgnoresStrayPackFiles) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, 100);
+  Write(name_value_pairs);
+  backend_.reset();
+  for (const auto& stray : {"backup.pack", "99999999999.pack", ".pack"})
+    std::ofstream(((*test_path_) / stray).string()) << "not a segment";
+
+  backend_.reset(new PackFileBackend(*test_path_, kMaxSegmentSize));
+  ExpectHeld(name_value_pairs);
+  EXPECT_EQ(200U, backend_->ScanUsage());
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,139 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/data_manager/pmids_cache.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+PmidsCache::Value MakeHolders() {
+  return std::make_shared<const std::vector<routing::Address>>(4, MakeIdentity());
+}
+
+std::string MakeKey() { return RandomString(identity_size + 1); }
+
+TEST(PmidsCacheTest, BEH_ZeroSizeDisablesCache) {
+  PmidsCache cache(0);
+  const std::string kKey(MakeKey());
+  cache.Insert(kKey, MakeHolders(), cache.GetTicket(kKey));
+  EXPECT_FALSE(cache.Get(kKey).found);
+  EXPECT_EQ(0U, cache.Hits());
+}
+
+TEST(PmidsCacheTest, BEH_FewerRecordsThanShardsStillCaches) {
+  PmidsCache cache(1);
+  const std::string kKey(MakeKey());
+  auto holders(MakeHolders());
+  cache.Insert(kKey, holders, cache.GetTicket(kKey));
+  auto lookup(cache.Get(kKey));
+  EXPECT_TRUE(lookup.found);
+  EXPECT_EQ(holders, lookup.value);
+}
+
+TEST(PmidsCacheTest, BEH_CachesRecordsAndMisses) {
+  PmidsCache cache(1024);
+  const std::string kKey(MakeKey()), kMissingKey(MakeKey());
+  auto holders(MakeHolders());
+  EXPECT_FALSE(cache.Get(kKey).found);
+  cache.Insert(kKey, holders, cache.GetTicket(kKey));
+  auto lookup(cache.Get(kKey));
+  EXPECT_TRUE(lookup.found);
+  EXPECT_EQ(holders, lookup.value);
+
+  // A key with no record is cached as a hit with no value.
+  EXPECT_FALSE(cache.Get(kMissingKey).found);
+  cache.Insert(kMissingKey, nullptr, cache.GetTicket(kMissingKey));
+  lookup = cache.Get(kMissingKey);
+  EXPECT_TRUE(lookup.found);
+  EXPECT_FALSE(lookup.value);
+  EXPECT_EQ(2U, cache.Hits());
+  EXPECT_EQ(2U, cache.Misses());
+
+  cache.Invalidate(kKey);
+  cache.Invalidate(kMissingKey);
+  EXPECT_FALSE(cache.Get(kKey).found);
+  EXPECT_FALSE(cache.Get(kMissingKey).found);
+}
+
+TEST(PmidsCacheTest, BEH_InvalidateRejectsStaleInsert) {
+  PmidsCache cache(1024);
+  const std::string kKey(MakeKey());
+  // A reader takes its ticket, then a writer changes the record before the reader inserts.
+  auto ticket(cache.GetTicket(kKey));
+  cache.Invalidate(kKey);
+  cache.Insert(kKey, MakeHolders(), ticket);
+  EXPECT_FALSE(cache.Get(kKey).found);
+  cache.Insert(kKey, MakeHolders(), cache.GetTicket(kKey));
+  EXPECT_TRUE(cache.Get(kKey).found);
+}
+
+TEST(PmidsCacheTest, BEH_ClearInvalidatesEverything) {
+  PmidsCache cache(64);
+  std::vector<std::string> keys;
+  for (int i(0); i < 8; ++i) {
+    keys.push_back(MakeKey());
+    cache.Insert(keys.back(), nullptr, cache.GetTicket(keys.back()));
+  }
+  const PmidsCache::Ticket kTicket(cache.GetTicket(keys[0]));
+  cache.Clear();
+  for (const auto& key : keys)
+    EXPECT_FALSE(cache.Get(key).found);
+  cache.Insert(keys[0], nullptr, kTicket);
+  EXPECT_FALSE(cache.Get(keys[0]).found);
+}
+
+TEST(PmidsCacheTest, BEH_MissesDoNotEvictRecords) {
+  const std::size_t kMaxRecords(16 * 8);
+  PmidsCache cache(kMaxRecords);
+  std::vector<std::string> keys;
+  for (std::size_t i(0); i < kMaxRecords * 4; ++i) {
+    keys.push_back(MakeKey());
+    cache.Insert(keys.back(), MakeHolders(), cache.GetTicket(keys.back()));
+  }
+  std::size_t cached(0);
+  for (const auto& key : keys)
+    cached += cache.Get(key).found ? 1 : 0;
+  // Each shard holds at most its share, however the keys fall.
+  EXPECT_LE(cached, kMaxRecords);
+  EXPECT_GT(cached, 0U);
+
+  for (std::size_t i(0); i < kMaxRecords * 4; ++i) {
+    auto key(MakeKey());
+    cache.Insert(key, nullptr, cache.GetTicket(key));
+  }
+  std::size_t still_cached(0);
+  for (const auto& key : keys)
+    still_cached += cache.Get(key).found ? 1 : 0;
+  EXPECT_EQ(cached, still_cached);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
@@ -0,0 +1,224 @@
+/*  Copyright 2015 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/vault/chunk_store/tiered_backend.h"
+
+#include <chrono>
+#include <set>
+
+#include "boost/filesystem/operations.hpp"
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/vault/chunk_store/file_per_chunk_backend.h"
+#include "maidsafe/vault/chunk_store/usage_journal.h"
+#include "maidsafe/vault/tests/chunk_store_test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace vault {
+
+namespace test {
+
+const std::uint64_t kChunkSize(100);
+const std::uint64_t kFastCapacity(10 * kChunkSize);
+const std::uint64_t kSlowCapacity(100 * kChunkSize);
+
+class TieredBackendTest : public testing::Test {
+ protected:
+  typedef std::vector<std::pair<Data::NameAndTypeId, NonEmptyString>> NameValueContainer;
+
+  TieredBackendTest()
+      : test_path_(maidsafe::test::CreateTestPath("MaidSafe_Test_TieredBackend")),
+        fast_(nullptr),
+        slow_(nullptr),
+        backend_() {
+    fs::create_directories(*test_path_ / "fast");
+    fs::create_directories(*test_path_ / "slow");
+    Open();
+  }
+
+  // Chunks are only moved by MoveChunks, so that the tests can see where they are.
+  void Open() {
+    backend_.reset();
+    std::unique_ptr<FilePerChunkBackend> fast(new FilePerChunkBackend(*test_path_ / "fast", false));
+    std::unique_ptr<FilePerChunkBackend> slow(new FilePerChunkBackend(*test_path_ / "slow", false));
+    fast_ = fast.get();
+    slow_ = slow.get();
+    backend_.reset(new TieredBackend(
+        TieredBackend::Tier{*test_path_ / "fast", *test_path_ / "fast_metadata", kFastCapacity,
+                            std::move(fast)},
+        TieredBackend::Tier{*test_path_ / "slow", *test_path_ / "slow_metadata", kSlowCapacity,
+                            std::move(slow)},
+        std::chrono::seconds(0)));
+  }
+
+  void Write(const NameValueContainer& name_value_pairs) {
+    for (const auto& name_value : name_value_pairs)
+      backend_->Write(name_value.first, name_value.second.string());
+  }
+
+  void ExpectHeld(const NameValueContainer& name_value_pairs) {
+    for (const auto& name_value : name_value_pairs) {
+      auto content(backend_->Read(name_value.first));
+      ASSERT_TRUE(static_cast<bool>(content));
+      EXPECT_TRUE(*content == name_value.second.string());
+    }
+  }
+
+  bool OnFastTier(const Data::NameAndTypeId& name) const {
+    bool on_fast(fast_->Size(name) != 0);
+    EXPECT_NE(on_fast, slow_->Size(name) != 0);
+    return on_fast;
+  }
+
+  maidsafe::test::TestPath test_path_;
+  FilePerChunkBackend* fast_;
+  FilePerChunkBackend* slow_;
+  std::unique_ptr<TieredBackend> backend_;
+};
+
+TEST_F(TieredBackendTest, BEH_WritesFillFastTierFirst) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 11, kChunkSize);
+  Write(name_value_pairs);
+  for (std::size_t i(0); i != 10; ++i)
+    EXPECT_TRUE(OnFastTier(name_value_pairs[i].first));
+  EXPECT_FALSE(OnFastTier(name_value_pairs[10].first));
+  auto statistics(backend_->Statistics());
+  ASSERT_EQ(2U, statistics.size());
+  EXPECT_EQ(kFastCapacity, statistics[0].usage);
+  EXPECT_EQ(kChunkSize, statistics[1].usage);
+  EXPECT_EQ(11 * kChunkSize, backend_->ScanUsage());
+  ExpectHeld(name_value_pairs);
+
+  // Once there's room, an overwrite moves the chunk to the fast tier.
+  EXPECT_EQ(kChunkSize, backend_->Remove(name_value_pairs[0].first));
+  backend_->Write(name_value_pairs[10].first, name_value_pairs[10].second.string());
+  EXPECT_TRUE(OnFastTier(name_value_pairs[10].first));
+  EXPECT_EQ(0U, backend_->Statistics()[1].usage);
+  name_value_pairs.erase(name_value_pairs.begin());
+  ExpectHeld(name_value_pairs);
+  EXPECT_EQ(10U, ReadNames(*backend_->Names(NameRange(), 1).front()).size());
+}
+
+TEST_F(TieredBackendTest, BEH_DemotesLeastRecentlyUsed) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, kChunkSize);
+  Write(name_value_pairs);
+  for (std::size_t i(0); i != 5; ++i)
+    backend_->Read(name_value_pairs[i].first);
+
+  // Demotes down to the low watermark, coldest first.
+  backend_->MoveChunks();
+  for (std::size_t i(0); i != 10; ++i)
+    EXPECT_EQ(i < 5 || i > 7, OnFastTier(name_value_pairs[i].first)) << i;
+  auto statistics(backend_->Statistics());
+  EXPECT_EQ(7 * kChunkSize, statistics[0].usage);
+  EXPECT_EQ(3U, statistics[0].moves_out);
+  EXPECT_EQ(3 * kChunkSize, statistics[0].bytes_moved_out);
+  EXPECT_EQ(3U, statistics[1].moves_in);
+  EXPECT_EQ(3 * kChunkSize, statistics[1].usage);
+  EXPECT_EQ(10 * kChunkSize, backend_->ScanUsage());
+  ExpectHeld(name_value_pairs);
+
+  // Under the high watermark nothing moves.
+  backend_->MoveChunks();
+  EXPECT_EQ(3U, backend_->Statistics()[1].moves_in);
+}
+
+TEST_F(TieredBackendTest, BEH_PromotesFrequentlyRead) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, kChunkSize);
+  Write(name_value_pairs);
+  backend_->MoveChunks();
+  ASSERT_FALSE(OnFastTier(name_value_pairs[0].first));
+  ASSERT_FALSE(OnFastTier(name_value_pairs[1].first));
+  for (std::size_t i(5); i != 10; ++i)
+    backend_->Remove(name_value_pairs[i].first);
+  name_value_pairs.resize(5);
+
+  for (std::uint32_t i(0); i != TieredBackend::kPromotionReads; ++i)
+    backend_->Read(name_value_pairs[0].first);
+  backend_->Read(name_value_pairs[1].first);
+  backend_->MoveChunks();
+  EXPECT_TRUE(OnFastTier(name_value_pairs[0].first));
+  EXPECT_FALSE(OnFastTier(name_value_pairs[1].first));
+  auto statistics(backend_->Statistics());
+  EXPECT_EQ(1U, statistics[0].moves_in);
+  EXPECT_EQ(1U, statistics[1].moves_out);
+  EXPECT_EQ(5 * kChunkSize, backend_->ScanUsage());
+  ExpectHeld(name_value_pairs);
+}
+
+TEST_F(TieredBackendTest, BEH_NoMovesWhileCursorOpen) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 10, kChunkSize);
+  Write(name_value_pairs);
+  {
+    auto cursors(backend_->Names(NameRange(), 2));
+    backend_->MoveChunks();
+    EXPECT_EQ(0U, backend_->Statistics()[1].moves_in);
+    std::set<Data::NameAndTypeId> names;
+    for (auto& cursor : cursors) {
+      for (const auto& name : ReadNames(*cursor))
+        EXPECT_TRUE(names.insert(name).second);
+    }
+    EXPECT_EQ(10U, names.size());
+  }
+  backend_->MoveChunks();
+  EXPECT_EQ(3U, backend_->Statistics()[1].moves_in);
+}
+
+TEST_F(TieredBackendTest, BEH_RestartRemovesDuplicateLeftByCrash) {
+  NameValueContainer name_value_pairs;
+  AddRandomNameValuePairs(name_value_pairs, 2, kChunkSize);
+  Write(name_value_pairs);
+  backend_.reset();
+
+  // Simulate a crash part way through demoting the first chunk: it has been copied to the slow
+  // tier but not yet removed from the fast one.
+  {
+    UsageJournal journal(*test_path_ / "slow_metadata");
+    auto recovery(journal.Recover());
+    ASSERT_TRUE(static_cast<bool>(recovery));
+    journal.Open(recovery->usage);
+    journal.Begin(name_value_pairs[0].first, 0);
+    FilePerChunkBackend slow(*test_path_ / "slow", false);
+    slow.Write(name_value_pairs[0].first, name_value_pairs[0].second.string());
+  }
+  ASSERT_TRUE(fs::remove(*test_path_ / "slow_metadata" / "clean"));
+
+  Open();
+  EXPECT_TRUE(OnFastTier(name_value_pairs[0].first));
+  EXPECT_TRUE(OnFastTier(name_value_pairs[1].first));
+  auto statistics(backend_->Statistics());
+  EXPECT_EQ(2 * kChunkSize, statistics[0].usage);
+  EXPECT_EQ(0U, statistics[1].usage);
+  ExpectHeld(name_value_pairs);
+}
+
+}  // namespace test
+
+}  // namespace vault
+
+}  // namespace maidsafe
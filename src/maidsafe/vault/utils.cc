@@ -67,6 +67,7 @@ boost::filesystem::path UniqueDbPath(const boost::filesystem::path& vault_root_d
 }
 
 size_t Parameters::min_pmid_holders = 4;
+size_t Parameters::max_pmid_holders = 6;
 
 }  // namespace vault
 
@@ -120,6 +120,7 @@ std::string EncodeToString(const Identity& name) {
 
 struct Parameters {
   static size_t min_pmid_holders;
+  static size_t max_pmid_holders;
 };
 
 }  // namespace vault
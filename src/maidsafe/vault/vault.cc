@@ -112,6 +112,10 @@ routing::HandlePutPostReturn VaultFacade::HandlePut(routing::SourceAddress from,
   return boost::make_unexpected(MakeError(VaultErrors::failed_to_handle_request));
 }
 
+void VaultFacade::HandleChurn(routing::CloseGroupDifference diff) {
+  DataManager::HandleChurn(diff);
+}
+
 bool VaultFacade::HandlePost(const routing::SerialisedMessage& message) {
   return VersionHandler::HandlePost(message);
 }
@@ -61,7 +61,7 @@ class VaultFacade : public MaidManager<VaultFacade>,
         MpidManager<VaultFacade>(VaultDir(), DiskUsage(10000000000)),
         routing::test::FakeRouting<VaultFacade>() {}
 
-  ~VaultFacade() = default;
+  ~VaultFacade() { DataManager::StopChurn(); }
 
   enum class FunctorType { FunctionOne, FunctionTwo };
 
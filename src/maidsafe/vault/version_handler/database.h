@@ -19,6 +19,8 @@
 #ifndef MAIDSAFE_VAULT_VERSION_HANDLER_DATABASE_H_
 #define MAIDSAFE_VAULT_VERSION_HANDLER_DATABASE_H_
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -28,6 +30,7 @@ namespace maidsafe {
 
 namespace vault {
 
+// Put, Get and Delete each reuse a statement prepared at construction, serialised on mutex_.
 class VersionHandlerDatabase {
   typedef std::string VALUE;
  public:
@@ -44,9 +47,11 @@ class VersionHandlerDatabase {
   void CheckPoint();
 
   std::unique_ptr<sqlite::Database> database_;
+  std::unique_ptr<sqlite::Statement> put_statement_, get_statement_, delete_statement_;
   std::unique_ptr<sqlite::Statement> seeking_statement_;
   const boost::filesystem::path kDbPath_;
   int write_operations_;
+  std::mutex mutex_;
 };
 
 }  // namespace vault